@@ -0,0 +1,636 @@
+#include "atlas.h"
+#include "log.h"
+#include "pool.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Archive layout: header, entries sorted by name, the name block and the
+// RGBA pages, every page aligned for mapping. Native byte order, the archive
+// is built on the machine it is used on.
+#define ATLAS_ARCHIVE_MAGIC 0x4b504d42 // "BMPK"
+#define ATLAS_ARCHIVE_VERSION 1
+#define ARCHIVE_ALIGNMENT 4096
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numPages;
+  uint32_t numEntries;
+  // Byte offsets from the start of the archive
+  uint64_t namesOffset;
+  uint64_t namesSize;
+  uint64_t pageOffset[ATLAS_MAX_PAGES];
+  uint32_t pageHeight[ATLAS_MAX_PAGES];
+  uint64_t size;
+} ArchiveHeader;
+
+typedef struct {
+  // Offset into the name block
+  uint32_t name;
+  uint32_t page;
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+} ArchiveEntry;
+
+typedef struct {
+  int index;
+  int width;
+  int height;
+} PackItem;
+
+typedef struct {
+  int page;
+  int x;
+  int y;
+  int shelfHeight;
+  // Lowest used row of the current page
+  int usedHeight;
+} Packer;
+
+typedef enum {
+  SPRITE_PENDING,
+  SPRITE_DECODING,
+  SPRITE_DECODED,
+} SpriteState;
+
+struct AtlasLoader {
+  Atlas *atlas;
+  ThreadPool *pool;
+  pthread_mutex_t lock;
+  _Bool cancelled;
+  // Per entry
+  int *priority;
+  SpriteState *state;
+  Image *images;
+  // Decoded entries in decode order, uploaded from head to tail
+  int *decoded;
+  int decodedHead;
+  int decodedTail;
+  int remaining;
+  double startTime;
+};
+
+int compareEntries(const void *a, const void *b);
+int comparePackItems(const void *a, const void *b);
+Atlas *layoutAtlas(const char *directory, int *heights);
+Atlas *loadArchive(const char *fileName);
+_Bool isValidArchive(const ArchiveHeader *header, size_t size);
+_Bool readPngSize(const char *fileName, int *width, int *height);
+_Bool packSprite(Packer *packer, int *heights, int width, int height,
+                 AtlasSprite *sprite);
+AtlasLoader *startLoader(Atlas *atlas);
+void freeLoader(AtlasLoader *loader);
+void freeLoaderArrays(AtlasLoader *loader);
+void decodeSprite(void *arg);
+
+Atlas *LoadAtlas(const char *directory) {
+  double startTime = GetTime();
+  char archive[256];
+  snprintf(archive, sizeof(archive), "%s%s", directory,
+           ATLAS_ARCHIVE_EXTENSION);
+  Atlas *atlas = loadArchive(archive);
+  if (atlas != NULL) {
+    LOG_INFO("Loaded %i sprites from %s in %.1f ms", atlas->numEntries,
+             archive, (GetTime() - startTime) * 1000);
+    return atlas;
+  }
+  int heights[ATLAS_MAX_PAGES];
+  atlas = layoutAtlas(directory, heights);
+  if (atlas == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < atlas->numPages; i++) {
+    // Pages only need to be as tall as their content, they start out blank
+    Image page = GenImageColor(ATLAS_PAGE_SIZE, heights[i], BLANK);
+    atlas->pages[i] = LoadTextureFromImage(page);
+    UnloadImage(page);
+  }
+  LOG_INFO("Packed %i sprites into %i atlas pages in %.1f ms",
+           atlas->numEntries, atlas->numPages,
+           (GetTime() - startTime) * 1000);
+  atlas->loader = startLoader(atlas);
+  return atlas;
+}
+
+_Bool PackAtlas(const char *directory, const char *fileName) {
+  int heights[ATLAS_MAX_PAGES];
+  Atlas *atlas = layoutAtlas(directory, heights);
+  if (atlas == NULL) {
+    return 0;
+  }
+  // Names, then the pages, each page starting on a memory page boundary
+  ArchiveHeader header = {ATLAS_ARCHIVE_MAGIC, ATLAS_ARCHIVE_VERSION,
+                          atlas->numPages, atlas->numEntries};
+  ArchiveEntry *entries =
+      (ArchiveEntry *)malloc(sizeof(ArchiveEntry) * atlas->numEntries);
+  unsigned char *pages[ATLAS_MAX_PAGES] = {NULL};
+  if (entries == NULL) {
+    LOG_ERROR("Allocation of archive entries failed!", NULL);
+    FreeAtlas(atlas);
+    return 0;
+  }
+  uint64_t offset = sizeof(ArchiveHeader) +
+                    sizeof(ArchiveEntry) * (uint64_t)atlas->numEntries;
+  header.namesOffset = offset;
+  for (int i = 0; i < atlas->numEntries; i++) {
+    AtlasSprite sprite = atlas->entries[i].sprite;
+    entries[i] = (ArchiveEntry){(uint32_t)(offset - header.namesOffset),
+                                sprite.page,
+                                sprite.source.x,
+                                sprite.source.y,
+                                sprite.source.width,
+                                sprite.source.height};
+    offset += strlen(atlas->entries[i].name) + 1;
+  }
+  header.namesSize = offset - header.namesOffset;
+  for (int i = 0; i < atlas->numPages; i++) {
+    offset = (offset + ARCHIVE_ALIGNMENT - 1) & ~(ARCHIVE_ALIGNMENT - 1);
+    header.pageHeight[i] = heights[i];
+    header.pageOffset[i] = offset;
+    offset += (uint64_t)ATLAS_PAGE_SIZE * heights[i] * 4;
+    pages[i] = (unsigned char *)calloc((size_t)ATLAS_PAGE_SIZE * heights[i], 4);
+    if (pages[i] == NULL) {
+      LOG_ERROR("Allocation of archive page failed!", NULL);
+      break;
+    }
+  }
+  header.size = offset;
+
+  // Decode every sprite into its place, rows are copied as they are
+  _Bool ok = 1;
+  for (int i = 0; i < atlas->numPages; i++) {
+    ok = ok && pages[i] != NULL;
+  }
+  for (int i = 0; ok && i < atlas->numEntries; i++) {
+    AtlasSprite sprite = atlas->entries[i].sprite;
+    Image image = LoadImage(atlas->entries[i].name);
+    if (image.data == NULL || image.width != sprite.source.width ||
+        image.height != sprite.source.height) {
+      LOG_ERROR("Failed to load image for file: %s", atlas->entries[i].name);
+      UnloadImage(image);
+      ok = 0;
+      break;
+    }
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    for (int y = 0; y < image.height; y++) {
+      size_t row = (size_t)(sprite.source.y + y) * ATLAS_PAGE_SIZE;
+      memcpy(pages[sprite.page] + (row + (size_t)sprite.source.x) * 4,
+             (unsigned char *)image.data + (size_t)y * image.width * 4,
+             (size_t)image.width * 4);
+    }
+    UnloadImage(image);
+  }
+
+  FILE *file = ok ? fopen(fileName, "wb") : NULL;
+  if (ok && file == NULL) {
+    LOG_ERROR("Failed to open archive: %s", fileName);
+    ok = 0;
+  }
+  if (ok) {
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(entries, sizeof(ArchiveEntry), atlas->numEntries, file);
+    for (int i = 0; i < atlas->numEntries; i++) {
+      fwrite(atlas->entries[i].name, strlen(atlas->entries[i].name) + 1, 1,
+             file);
+    }
+    for (int i = 0; i < atlas->numPages; i++) {
+      // Padding up to the page offset
+      fseek(file, header.pageOffset[i], SEEK_SET);
+      fwrite(pages[i], (size_t)ATLAS_PAGE_SIZE * heights[i] * 4, 1, file);
+    }
+    ok = ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+      LOG_ERROR("Failed to write archive: %s", fileName);
+    } else {
+      LOG_INFO("Packed %i sprites into %s", atlas->numEntries, fileName);
+    }
+  }
+  for (int i = 0; i < atlas->numPages; i++) {
+    free(pages[i]);
+  }
+  free(entries);
+  FreeAtlas(atlas);
+  return ok;
+}
+
+int UpdateAtlas(Atlas *atlas, int maxUploads) {
+  AtlasLoader *loader = atlas->loader;
+  if (loader == NULL) {
+    return 0;
+  }
+  for (int i = 0; i < maxUploads; i++) {
+    pthread_mutex_lock(&loader->lock);
+    if (loader->decodedHead == loader->decodedTail) {
+      pthread_mutex_unlock(&loader->lock);
+      break;
+    }
+    int index = loader->decoded[loader->decodedHead++];
+    pthread_mutex_unlock(&loader->lock);
+    // The image is no longer touched by any worker
+    Image *image = &loader->images[index];
+    AtlasSprite sprite = atlas->entries[index].sprite;
+    if (image->data == NULL) {
+      LOG_ERROR("Failed to load image for file: %s",
+                atlas->entries[index].name);
+    } else if (image->width != sprite.source.width ||
+               image->height != sprite.source.height) {
+      LOG_ERROR("Image size changed while loading file: %s",
+                atlas->entries[index].name);
+    } else {
+      UpdateTextureRec(atlas->pages[sprite.page], sprite.source,
+                       image->data);
+    }
+    UnloadImage(*image);
+    loader->remaining--;
+  }
+  int remaining = loader->remaining;
+  if (remaining == 0) {
+    LOG_INFO("Atlas sprites uploaded after %.1f ms",
+             (GetTime() - loader->startTime) * 1000);
+    freeLoader(loader);
+    atlas->loader = NULL;
+  }
+  return remaining;
+}
+
+void PrioritizeAtlasSprites(Atlas *atlas, const char *prefix, int priority) {
+  AtlasLoader *loader = atlas->loader;
+  if (loader == NULL) {
+    return;
+  }
+  size_t length = strlen(prefix);
+  pthread_mutex_lock(&loader->lock);
+  for (int i = 0; i < atlas->numEntries; i++) {
+    if (strncmp(atlas->entries[i].name, prefix, length) == 0) {
+      loader->priority[i] = priority;
+    }
+  }
+  pthread_mutex_unlock(&loader->lock);
+}
+
+void FreeAtlas(Atlas *atlas) {
+  if (atlas->loader != NULL) {
+    freeLoader(atlas->loader);
+  }
+  for (int i = 0; i < atlas->numPages; i++) {
+    UnloadTexture(atlas->pages[i]);
+  }
+  for (int i = 0; i < atlas->numEntries; i++) {
+    free(atlas->entries[i].name);
+  }
+  free(atlas->entries);
+  free(atlas);
+}
+
+AtlasLoader *startLoader(Atlas *atlas) {
+  AtlasLoader *loader = (AtlasLoader *)malloc(sizeof(AtlasLoader));
+  if (loader == NULL) {
+    LOG_ERROR("Allocation of atlas loader failed!", NULL);
+    return NULL;
+  }
+  int n = atlas->numEntries;
+  loader->atlas = atlas;
+  loader->cancelled = 0;
+  loader->priority = (int *)calloc(n, sizeof(int));
+  loader->state = (SpriteState *)calloc(n, sizeof(SpriteState));
+  loader->images = (Image *)calloc(n, sizeof(Image));
+  loader->decoded = (int *)malloc(sizeof(int) * n);
+  if (loader->priority == NULL || loader->state == NULL ||
+      loader->images == NULL || loader->decoded == NULL) {
+    LOG_ERROR("Allocation of atlas loader failed!", NULL);
+    freeLoaderArrays(loader);
+    return NULL;
+  }
+  loader->decodedHead = 0;
+  loader->decodedTail = 0;
+  loader->remaining = n;
+  loader->startTime = GetTime();
+  loader->pool = CreateThreadPool(GetNumCores());
+  if (loader->pool == NULL) {
+    freeLoaderArrays(loader);
+    return NULL;
+  }
+  pthread_mutex_init(&loader->lock, NULL);
+  // Every task decodes whichever sprite is most important when it runs, so
+  // priorities set later still apply
+  for (int i = 0; i < n; i++) {
+    SubmitTask(loader->pool, decodeSprite, loader);
+  }
+  return loader;
+}
+
+void freeLoader(AtlasLoader *loader) {
+  pthread_mutex_lock(&loader->lock);
+  loader->cancelled = 1;
+  pthread_mutex_unlock(&loader->lock);
+  FreeThreadPool(loader->pool);
+  for (int i = loader->decodedHead; i < loader->decodedTail; i++) {
+    UnloadImage(loader->images[loader->decoded[i]]);
+  }
+  pthread_mutex_destroy(&loader->lock);
+  freeLoaderArrays(loader);
+}
+
+// Frees the loader and its arrays, the pool and lock are the caller's
+void freeLoaderArrays(AtlasLoader *loader) {
+  free(loader->decoded);
+  free(loader->images);
+  free(loader->state);
+  free(loader->priority);
+  free(loader);
+}
+
+// Runs on a loader thread, touches no GL state
+void decodeSprite(void *arg) {
+  AtlasLoader *loader = (AtlasLoader *)arg;
+  pthread_mutex_lock(&loader->lock);
+  int index = -1;
+  for (int i = 0; i < loader->atlas->numEntries && !loader->cancelled; i++) {
+    if (loader->state[i] == SPRITE_PENDING &&
+        (index < 0 || loader->priority[i] > loader->priority[index])) {
+      index = i;
+    }
+  }
+  if (index < 0) {
+    pthread_mutex_unlock(&loader->lock);
+    return;
+  }
+  loader->state[index] = SPRITE_DECODING;
+  pthread_mutex_unlock(&loader->lock);
+
+  Image image = LoadImage(loader->atlas->entries[index].name);
+  if (image.data != NULL) {
+    // Uploads go straight into the page texture and need its format
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  }
+
+  pthread_mutex_lock(&loader->lock);
+  loader->images[index] = image;
+  loader->state[index] = SPRITE_DECODED;
+  loader->decoded[loader->decodedTail++] = index;
+  pthread_mutex_unlock(&loader->lock);
+}
+
+// Entries and page heights of a directory, without any page textures
+Atlas *layoutAtlas(const char *directory, int *heights) {
+  Atlas *atlas = (Atlas *)malloc(sizeof(Atlas));
+  if (atlas == NULL) {
+    LOG_ERROR("Allocation of atlas failed!", NULL);
+    return NULL;
+  }
+  FilePathList files = LoadDirectoryFilesEx(directory, ".png", true);
+  atlas->numPages = 0;
+  atlas->numEntries = 0;
+  atlas->loader = NULL;
+  atlas->entries = (AtlasEntry *)malloc(sizeof(AtlasEntry) * files.count);
+  PackItem *items = (PackItem *)malloc(sizeof(PackItem) * files.count);
+  if (atlas->entries == NULL || items == NULL) {
+    LOG_ERROR("Allocation of atlas entries failed!", NULL);
+    UnloadDirectoryFiles(files);
+    free(items);
+    free(atlas->entries);
+    free(atlas);
+    return NULL;
+  }
+  // Only the headers are read here, the pixels are decoded later
+  int numItems = 0;
+  for (unsigned int i = 0; i < files.count; i++) {
+    PackItem item = {i, 0, 0};
+    if (!readPngSize(files.paths[i], &item.width, &item.height)) {
+      LOG_ERROR("Failed to read image size for file: %s", files.paths[i]);
+      continue;
+    }
+    items[numItems++] = item;
+  }
+  // Tallest first keeps the shelves tight
+  qsort(items, numItems, sizeof(PackItem), comparePackItems);
+
+  Packer packer = {-1, 0, 0, 0, 0};
+  for (int i = 0; i < numItems; i++) {
+    AtlasSprite sprite;
+    if (!packSprite(&packer, heights, items[i].width, items[i].height,
+                    &sprite)) {
+      LOG_ERROR("No atlas space left for file: %s",
+                files.paths[items[i].index]);
+      continue;
+    }
+    char *name = strdup(files.paths[items[i].index]);
+    if (name == NULL) {
+      LOG_ERROR("Allocation of atlas entry name failed!", NULL);
+      continue;
+    }
+    atlas->entries[atlas->numEntries++] = (AtlasEntry){name, sprite};
+  }
+  atlas->numPages = packer.page + 1;
+  qsort(atlas->entries, atlas->numEntries, sizeof(AtlasEntry),
+        compareEntries);
+  free(items);
+  UnloadDirectoryFiles(files);
+  return atlas;
+}
+
+// Maps an archive written by PackAtlas and uploads its pages straight from
+// the mapping. NULL if there is no usable archive.
+Atlas *loadArchive(const char *fileName) {
+  int fd = open(fileName, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ArchiveHeader)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = info.st_size;
+  unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG_WARN("Failed to map archive: %s", fileName);
+    return NULL;
+  }
+  const ArchiveHeader *header = (const ArchiveHeader *)data;
+  if (!isValidArchive(header, size)) {
+    LOG_WARN("Ignoring invalid or outdated archive: %s", fileName);
+    munmap(data, size);
+    return NULL;
+  }
+  Atlas *atlas = (Atlas *)malloc(sizeof(Atlas));
+  if (atlas == NULL) {
+    LOG_ERROR("Allocation of atlas failed!", NULL);
+    munmap(data, size);
+    return NULL;
+  }
+  atlas->numPages = header->numPages;
+  atlas->numEntries = header->numEntries;
+  atlas->loader = NULL;
+  atlas->entries =
+      (AtlasEntry *)malloc(sizeof(AtlasEntry) * header->numEntries);
+  if (atlas->entries == NULL) {
+    LOG_ERROR("Allocation of atlas entries failed!", NULL);
+    free(atlas);
+    munmap(data, size);
+    return NULL;
+  }
+  // Entries are stored sorted by name
+  const ArchiveEntry *entries = (const ArchiveEntry *)(header + 1);
+  const char *names = (const char *)data + header->namesOffset;
+  for (int i = 0; i < atlas->numEntries; i++) {
+    const ArchiveEntry *entry = &entries[i];
+    atlas->entries[i] = (AtlasEntry){
+        strdup(names + entry->name),
+        {entry->page, {entry->x, entry->y, entry->width, entry->height}}};
+  }
+  for (int i = 0; i < atlas->numPages; i++) {
+    // Already RGBA, the driver reads the pixels from the mapped file
+    Image page = {data + header->pageOffset[i], ATLAS_PAGE_SIZE,
+                  header->pageHeight[i], 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+    atlas->pages[i] = LoadTextureFromImage(page);
+  }
+  munmap(data, size);
+  return atlas;
+}
+
+// Sums of untrusted fields could wrap, so every bound is checked as a
+// difference to what is left
+_Bool isValidArchive(const ArchiveHeader *header, size_t size) {
+  if (header->magic != ATLAS_ARCHIVE_MAGIC ||
+      header->version != ATLAS_ARCHIVE_VERSION || header->size != size ||
+      header->numPages > ATLAS_MAX_PAGES ||
+      header->namesOffset != sizeof(ArchiveHeader) +
+                                 sizeof(ArchiveEntry) *
+                                     (uint64_t)header->numEntries ||
+      header->namesSize == 0 || header->namesOffset > size ||
+      header->namesSize > size - header->namesOffset) {
+    return 0;
+  }
+  const unsigned char *data = (const unsigned char *)header;
+  // Every name must end within the name block
+  if (data[header->namesOffset + header->namesSize - 1] != '\0') {
+    return 0;
+  }
+  for (uint32_t i = 0; i < header->numPages; i++) {
+    if (header->pageHeight[i] > ATLAS_PAGE_SIZE ||
+        header->pageOffset[i] > size ||
+        (uint64_t)ATLAS_PAGE_SIZE * header->pageHeight[i] * 4 >
+            size - header->pageOffset[i]) {
+      return 0;
+    }
+  }
+  const ArchiveEntry *entries = (const ArchiveEntry *)(header + 1);
+  for (uint32_t i = 0; i < header->numEntries; i++) {
+    const ArchiveEntry *entry = &entries[i];
+    if (entry->name >= header->namesSize || entry->page >= header->numPages) {
+      return 0;
+    }
+    uint32_t pageHeight = header->pageHeight[entry->page];
+    if (entry->x > ATLAS_PAGE_SIZE ||
+        entry->width > ATLAS_PAGE_SIZE - entry->x ||
+        entry->y > pageHeight || entry->height > pageHeight - entry->y) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Width and height from the IHDR chunk, which every PNG starts with
+_Bool readPngSize(const char *fileName, int *width, int *height) {
+  unsigned char header[24];
+  FILE *file = fopen(fileName, "rb");
+  if (file == NULL) {
+    return 0;
+  }
+  size_t length = fread(header, 1, sizeof(header), file);
+  fclose(file);
+  if (length != sizeof(header) || memcmp(header, "\x89PNG\r\n\x1a\n", 8) != 0 ||
+      memcmp(header + 12, "IHDR", 4) != 0) {
+    return 0;
+  }
+  *width = header[16] << 24 | header[17] << 16 | header[18] << 8 | header[19];
+  *height = header[20] << 24 | header[21] << 16 | header[22] << 8 | header[23];
+  return 1;
+}
+
+AtlasSprite GetAtlasSprite(Atlas *atlas, const char *name) {
+  AtlasEntry key = {(char *)name};
+  AtlasEntry *entry = bsearch(&key, atlas->entries, atlas->numEntries,
+                              sizeof(AtlasEntry), compareEntries);
+  if (entry == NULL) {
+    LOG_ERROR("Sprite not in atlas: %s", name);
+    return (AtlasSprite){0, {0, 0, 0, 0}};
+  }
+  return entry->sprite;
+}
+
+void DrawSpriteV(Atlas *atlas, AtlasSprite sprite, Vector2 position,
+                 Color tint) {
+  DrawTextureRec(atlas->pages[sprite.page], sprite.source, position, tint);
+}
+
+void DrawSpriteRec(Atlas *atlas, AtlasSprite sprite, Rectangle source,
+                   Vector2 position, Color tint) {
+  source.x += sprite.source.x;
+  source.y += sprite.source.y;
+  DrawTextureRec(atlas->pages[sprite.page], source, position, tint);
+}
+
+void DrawSpritePro(Atlas *atlas, AtlasSprite sprite, Rectangle source,
+                   Rectangle dest, Vector2 origin, float rotation, Color tint) {
+  // A negative width or height only flips, the offset stays the same
+  source.x += sprite.source.x;
+  source.y += sprite.source.y;
+  DrawTexturePro(atlas->pages[sprite.page], source, dest, origin, rotation,
+                 tint);
+}
+
+// Shelf packing: sprites fill a row left to right, the tallest sprite of a
+// row sets its height
+_Bool packSprite(Packer *packer, int *heights, int width, int height,
+                 AtlasSprite *sprite) {
+  if (width > ATLAS_PAGE_SIZE || height > ATLAS_PAGE_SIZE) {
+    return 0;
+  }
+  if (packer->page >= 0 && packer->x + width > ATLAS_PAGE_SIZE) {
+    packer->x = 0;
+    packer->y += packer->shelfHeight;
+    packer->shelfHeight = 0;
+  }
+  if (packer->page < 0 || packer->y + height > ATLAS_PAGE_SIZE) {
+    if (packer->page + 1 == ATLAS_MAX_PAGES) {
+      return 0;
+    }
+    packer->page++;
+    packer->x = 0;
+    packer->y = 0;
+    packer->shelfHeight = 0;
+    packer->usedHeight = 0;
+  }
+  *sprite = (AtlasSprite){packer->page,
+                          {packer->x, packer->y, width, height}};
+  packer->x += width + ATLAS_PADDING;
+  if (height + ATLAS_PADDING > packer->shelfHeight) {
+    packer->shelfHeight = height + ATLAS_PADDING;
+  }
+  if (packer->y + height > packer->usedHeight) {
+    packer->usedHeight = packer->y + height;
+  }
+  heights[packer->page] = packer->usedHeight;
+  return 1;
+}
+
+int compareEntries(const void *a, const void *b) {
+  return strcmp(((const AtlasEntry *)a)->name, ((const AtlasEntry *)b)->name);
+}
+
+int comparePackItems(const void *a, const void *b) {
+  return ((const PackItem *)b)->height - ((const PackItem *)a)->height;
+}
@@ -0,0 +1,64 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+#include <raylib.h>
+
+// Runtime texture atlas. Every PNG below a directory is packed into a few
+// large pages so sprites share a texture and raylib can batch their draws.
+// The layout is computed from the PNG headers up front, the images are
+// decoded on worker threads and uploaded into their place a few per frame.
+
+#define ATLAS_PAGE_SIZE 2048
+#define ATLAS_MAX_PAGES 8
+// Transparent gap between sprites
+#define ATLAS_PADDING 1
+#define ATLAS_ARCHIVE_EXTENSION ".pak"
+
+typedef struct {
+  int page;
+  // Pixel rectangle of the sprite on its page
+  Rectangle source;
+} AtlasSprite;
+
+typedef struct {
+  char *name;
+  AtlasSprite sprite;
+} AtlasEntry;
+
+typedef struct AtlasLoader AtlasLoader;
+
+typedef struct {
+  int numPages;
+  Texture2D pages[ATLAS_MAX_PAGES];
+  // Sorted by name
+  int numEntries;
+  AtlasEntry *entries;
+  // Background decoding, NULL once every sprite is uploaded
+  AtlasLoader *loader;
+} Atlas;
+
+// Sprites are named by their file path, e.g. "assets/items/bomb.png". If an
+// archive <directory>.pak exists its pages are mapped and uploaded as they
+// are. Otherwise the atlas is usable right away and sprites stay transparent
+// until uploaded.
+Atlas *LoadAtlas(const char *directory);
+// Writes the decoded pages and the sprite index of a directory into an
+// archive for LoadAtlas, see make assets.pak
+_Bool PackAtlas(const char *directory, const char *fileName);
+// Uploads at most maxUploads decoded sprites, must be called from the thread
+// owning the GL context. Returns the number of sprites not uploaded yet.
+int UpdateAtlas(Atlas *atlas, int maxUploads);
+// Sprites whose name starts with prefix are decoded before sprites with a
+// lower priority, all sprites start at 0
+void PrioritizeAtlasSprites(Atlas *atlas, const char *prefix, int priority);
+void FreeAtlas(Atlas *atlas);
+AtlasSprite GetAtlasSprite(Atlas *atlas, const char *name);
+
+// Like their DrawTexture counterparts, source rectangles are relative to the
+// sprite
+void DrawSpriteV(Atlas *atlas, AtlasSprite sprite, Vector2 position,
+                 Color tint);
+void DrawSpriteRec(Atlas *atlas, AtlasSprite sprite, Rectangle source,
+                   Vector2 position, Color tint);
+void DrawSpritePro(Atlas *atlas, AtlasSprite sprite, Rectangle source,
+                   Rectangle dest, Vector2 origin, float rotation, Color tint);
+#endif // ATLAS_H
@@ -0,0 +1,130 @@
+#include "clock.h"
+#include "log.h"
+#include "pool.h"
+#include "rand.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Batch match runner. Plays independent headless matches on a work-stealing
+// thread pool and reports throughput for growing thread counts.
+//
+//   ./batch [matches] [max threads] [map size] [players]
+
+// Upper bound of a match in simulated seconds
+#define MATCH_TIME_LIMIT 180
+#define DEFAULT_MATCHES 1000
+
+typedef struct {
+  MatchConfig config;
+  unsigned int seed;
+  long ticks;
+  int winner;
+} MatchTask;
+
+void runMatch(void *arg);
+void playRandom(Match *match, unsigned int *state);
+
+int main(int argc, char *argv[]) {
+  int matches = argc > 1 ? atoi(argv[1]) : DEFAULT_MATCHES;
+  int maxThreads = argc > 2 ? atoi(argv[2]) : GetNumCores();
+  MatchConfig config = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, DEFAULT_PLAYERS};
+  if (argc > 3) {
+    config.width = config.height = atoi(argv[3]);
+  }
+  if (argc > 4) {
+    config.players = atoi(argv[4]);
+  }
+  // Rejects map sizes and player counts InitMatchWithConfig cannot handle
+  Match *probe = InitMatchWithConfig(config, 1);
+  if (matches < 1 || maxThreads < 1 || probe == NULL) {
+    fprintf(stderr, "usage: %s [matches] [max threads] [map size] [players]\n",
+            argv[0]);
+    return 1;
+  }
+  FreeMatch(probe);
+  currentLogLevel = LOG_LEVEL_WARN;
+
+  MatchTask *tasks = (MatchTask *)malloc(sizeof(MatchTask) * matches);
+  if (tasks == NULL) {
+    LOG_ERROR("Allocation of match tasks failed!", NULL);
+    return 1;
+  }
+
+  printf("%8s %8s %10s %12s %14s %8s %10s\n", "threads", "matches",
+         "seconds", "matches/s", "ticks/s", "speedup", "per core");
+  double baseline = 0;
+  // Double the thread count up to maxThreads
+  for (int threads = 1;; threads = threads * 2 < maxThreads ? threads * 2
+                                                             : maxThreads) {
+    // Every run plays the same seeds so the work is identical
+    for (int i = 0; i < matches; i++) {
+      tasks[i] = (MatchTask){
+          .config = config, .seed = i + 1, .ticks = 0, .winner = -1};
+    }
+    ThreadPool *pool = CreateThreadPool(threads);
+    double start = GetWallTime();
+    for (int i = 0; i < matches; i++) {
+      SubmitTask(pool, runMatch, &tasks[i]);
+    }
+    WaitThreadPool(pool);
+    double seconds = GetWallTime() - start;
+    FreeThreadPool(pool);
+
+    long ticks = 0;
+    for (int i = 0; i < matches; i++) {
+      ticks += tasks[i].ticks;
+    }
+    double rate = matches / seconds;
+    if (threads == 1) {
+      baseline = rate;
+    }
+    double speedup = rate / baseline;
+    printf("%8d %8d %10.3f %12.1f %14.0f %7.2fx %9.0f%%\n", threads, matches,
+           seconds, rate, ticks / seconds, speedup, speedup / threads * 100);
+    if (threads == maxThreads) {
+      break;
+    }
+  }
+  free(tasks);
+  return 0;
+}
+
+void runMatch(void *arg) {
+  MatchTask *task = (MatchTask *)arg;
+  Match *match = InitMatchWithConfig(task->config, task->seed);
+  if (match == NULL) {
+    return;
+  }
+  unsigned int policyState = task->seed * 2654435761u;
+  long maxTicks = (long)MATCH_TIME_LIMIT * TICK_RATE;
+  while (!IsMatchOver(match) && task->ticks < maxTicks) {
+    playRandom(match, &policyState);
+    StepMatch(match, TICK_TIME);
+    task->ticks++;
+  }
+  for (int i = 0; i < match->config.players; i++) {
+    if (match->players.isAlive[i]) {
+      task->winner = i;
+    }
+  }
+  FreeMatch(match);
+}
+
+// Stand-in policy: idle players occasionally walk or plant a bomb
+void playRandom(Match *match, unsigned int *state) {
+  for (int i = 0; i < match->config.players; i++) {
+    if (!match->players.isAlive[i] || match->players.state[i] != IDLE) {
+      continue;
+    }
+    unsigned int r = NextRandom(state);
+    if (r % 8 != 0) {
+      continue;
+    }
+    if ((r >> 3) % 5 == 0) {
+      PlantBomb(match, i);
+    } else {
+      MovePlayer(match, i, (Direction)((r >> 6) % _DIRECTION_NUM));
+    }
+  }
+}
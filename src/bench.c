@@ -0,0 +1,627 @@
+#include "bot.h"
+#include "clock.h"
+#include "delta.h"
+#include "log.h"
+#include "mcts.h"
+#include "pool.h"
+#include "rand.h"
+#include "sim.h"
+#include "vecenv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Simulation benchmarks. Every scenario is built from fixed seeds so runs
+// do the same work. Results are printed as CSV; given a baseline in the same
+// format, scenarios that got slower than the others or allocate more fail
+// the run, see compareBaseline. Scenarios on several threads also report
+// their speedup over the single thread one.
+//
+//   ./benchmark [baseline.csv]
+//
+// Allocations are counted by wrapping malloc at link time and the rules are
+// compiled in with BENCH_CFLAGS, see make bench.
+
+// Runs per scenario, the fastest one is reported
+#define BENCH_RUNS 5
+// A scenario may take this factor of its baseline time, after the speed of
+// the machine, before it fails, and keep this fraction of its baseline
+// speedup. Runs of the same build on a shared core vary that much.
+// BENCH_TOLERANCE overrides it.
+#define BENCH_TOLERANCE 1.6
+#define BENCH_MAX_SCENARIOS 16
+// Upper bound of a match in simulated seconds
+#define MATCH_TIME_LIMIT 180
+#define CHAIN_BOMBS 20
+// Clients a state delta is encoded for per tick
+#define DELTA_CLIENTS 16
+// Ticks a bot planned, counted for every living bot
+#define BOT_TICKS 300000
+// Positions the MCTS bot decides and rollouts per decision and thread
+#define MCTS_POSITIONS 8
+#define MCTS_ROLLOUTS 500
+// Matches of the vectorized environment and steps of the batch per run
+#define VEC_ENVS 256
+#define VEC_STEPS 400
+
+typedef struct {
+  const char *name;
+  // Measured operation: a tick, a match init or a whole chain reaction
+  const char *unit;
+  double nsPerOp;
+  double allocsPerOp;
+  double opsPerSecond;
+  // Bytes an operation produces, for encoders
+  double bytesPerOp;
+  int threads;
+  // Ops per second over those of the single thread counterpart
+  double speedup;
+} BenchResult;
+
+typedef struct {
+  long ops;
+  double seconds;
+  long allocs;
+  long bytes;
+  int threads;
+} BenchRun;
+
+typedef void (*BenchFunction)(BenchRun *run);
+
+static long allocations;
+// Set by a scenario whose output does not check out
+static _Bool corrupted;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+  allocations++;
+  return __real_realloc(pointer, size);
+}
+
+BenchResult runScenario(const char *name, const char *unit,
+                        BenchFunction function);
+void setScaling(BenchResult *result, const BenchResult *serial);
+void benchInit(BenchRun *run);
+void benchEmpty(BenchRun *run);
+void benchCrates(BenchRun *run);
+void benchChain(BenchRun *run);
+void benchSnapshot(BenchRun *run);
+void benchPlayers4(BenchRun *run);
+void benchPlayers64(BenchRun *run);
+void benchDelta(BenchRun *run);
+void benchDeltaFull(BenchRun *run);
+void benchBots(BenchRun *run);
+void benchMcts(BenchRun *run);
+void benchMctsParallel(BenchRun *run);
+void benchMctsBatch(BenchRun *run);
+void searchPositions(BenchRun *run, int threads, uint64_t players);
+void benchVecEnv(BenchRun *run);
+void benchVecEnvParallel(BenchRun *run);
+void stepVecEnv(BenchRun *run, int threads);
+void encodeDeltas(BenchRun *run, _Bool full);
+void playMatches(BenchRun *run, MatchConfig config, void (*setup)(Match *),
+                 long minTicks);
+void clearCrates(Match *match);
+void fillCrates(Match *match);
+Match *setupChain(unsigned int seed);
+void skipCountdown(Match *match);
+void playRandom(Match *match, unsigned int *state);
+int compareBaseline(const char *fileName, BenchResult *results,
+                    int numResults);
+int compareRatios(const void *a, const void *b);
+
+int main(int argc, char *argv[]) {
+  currentLogLevel = LOG_LEVEL_WARN;
+  BenchResult results[BENCH_MAX_SCENARIOS];
+  int n = 0;
+  results[n++] = runScenario("init_15x15", "match", benchInit);
+  results[n++] = runScenario("tick_empty_15x15", "tick", benchEmpty);
+  results[n++] = runScenario("tick_crates_15x15", "tick", benchCrates);
+  results[n++] = runScenario("chain_20_bombs", "chain", benchChain);
+  results[n++] = runScenario("snapshot_15x15", "restore", benchSnapshot);
+  results[n++] = runScenario("tick_4_players_15x15", "tick", benchPlayers4);
+  results[n++] = runScenario("tick_64_players_63x63", "tick", benchPlayers64);
+  results[n++] = runScenario("delta_15x15", "client", benchDelta);
+  results[n++] = runScenario("delta_full_15x15", "client", benchDeltaFull);
+  results[n++] = runScenario("bots_64_players_63x63", "bot", benchBots);
+  int mcts = n;
+  results[n++] = runScenario("mcts_15x15", "rollout", benchMcts);
+  results[n++] =
+      runScenario("mcts_15x15_all_cores", "rollout", benchMctsParallel);
+  setScaling(&results[n - 1], &results[mcts]);
+  results[n++] =
+      runScenario("mcts_3_bots_15x15_all_cores", "rollout", benchMctsBatch);
+  setScaling(&results[n - 1], &results[mcts]);
+  results[n++] = runScenario("vecenv_256_15x15", "step", benchVecEnv);
+  results[n++] =
+      runScenario("vecenv_256_15x15_all_cores", "step", benchVecEnvParallel);
+  setScaling(&results[n - 1], &results[n - 2]);
+
+  printf("scenario,unit,ns_per_op,allocs_per_op,ops_per_second,"
+         "bytes_per_op,threads,speedup,efficiency\n");
+  for (int i = 0; i < n; i++) {
+    BenchResult *result = &results[i];
+    printf("%s,%s,%.1f,%.3f,%.1f,%.1f,%i,%.2f,%.1f\n", result->name,
+           result->unit, result->nsPerOp, result->allocsPerOp,
+           result->opsPerSecond, result->bytesPerOp, result->threads,
+           result->speedup, result->speedup / result->threads * 100);
+  }
+  if (corrupted) {
+    fprintf(stderr, "bench: decoded states differ from the encoded ones\n");
+    return 1;
+  }
+  if (argc > 1) {
+    return compareBaseline(argv[1], results, n);
+  }
+  return 0;
+}
+
+BenchResult runScenario(const char *name, const char *unit,
+                        BenchFunction function) {
+  BenchResult result = {name, unit, 0, 0, 0, 0, 1, 1};
+  for (int i = 0; i < BENCH_RUNS; i++) {
+    BenchRun run = {0, 0, 0, 0, 1};
+    function(&run);
+    result.threads = run.threads;
+    double ns = run.seconds * 1e9 / run.ops;
+    if (i == 0 || ns < result.nsPerOp) {
+      result.nsPerOp = ns;
+      result.allocsPerOp = (double)run.allocs / run.ops;
+      result.opsPerSecond = run.ops / run.seconds;
+      result.bytesPerOp = (double)run.bytes / run.ops;
+    }
+  }
+  return result;
+}
+
+// Efficiency in the output is the speedup per thread in percent
+void setScaling(BenchResult *result, const BenchResult *serial) {
+  result->speedup = result->opsPerSecond / serial->opsPerSecond;
+}
+
+// Match setup and teardown, dominated by initGrid
+void benchInit(BenchRun *run) {
+  long start = allocations;
+  double time = GetWallTime();
+  for (unsigned int seed = 1; seed <= 2000; seed++) {
+    FreeMatch(InitMatch(seed));
+  }
+  run->seconds = GetWallTime() - time;
+  run->allocs = allocations - start;
+  run->ops = 2000;
+}
+
+void benchEmpty(BenchRun *run) {
+  MatchConfig config = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, DEFAULT_PLAYERS};
+  playMatches(run, config, clearCrates, 50000);
+}
+
+void benchCrates(BenchRun *run) {
+  MatchConfig config = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, DEFAULT_PLAYERS};
+  playMatches(run, config, fillCrates, 50000);
+}
+
+void benchPlayers4(BenchRun *run) {
+  MatchConfig config = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, DEFAULT_PLAYERS};
+  playMatches(run, config, NULL, 50000);
+}
+
+void benchPlayers64(BenchRun *run) {
+  MatchConfig config = {63, 63, MAX_PLAYERS};
+  playMatches(run, config, NULL, 20000);
+}
+
+// A row of bombs where only the first one is lit, every other bomb is set
+// off by its neighbour's flames
+void benchChain(BenchRun *run) {
+  for (unsigned int seed = 1; seed <= 200; seed++) {
+    Match *match = setupChain(seed);
+    long start = allocations;
+    double time = GetWallTime();
+    long maxTicks = (long)MATCH_TIME_LIMIT * TICK_RATE;
+    for (long ticks = 0; ticks < maxTicks && (match->bombs.count > 0 ||
+                                             match->explosions.count > 0);
+         ticks++) {
+      StepMatch(match, TICK_TIME);
+    }
+    run->seconds += GetWallTime() - time;
+    run->allocs += allocations - start;
+    run->ops++;
+    FreeMatch(match);
+  }
+}
+
+// Snapshot and restore of a match in play, as a rollback does per frame
+void benchSnapshot(BenchRun *run) {
+  Match *match = InitMatch(1);
+  skipCountdown(match);
+  unsigned int policyState = 1;
+  for (int i = 0; i < 600 && !IsMatchOver(match); i++) {
+    playRandom(match, &policyState);
+    StepMatch(match, TICK_TIME);
+  }
+  void *snapshot = malloc(match->size);
+  long start = allocations;
+  double time = GetWallTime();
+  for (int i = 0; i < 100000; i++) {
+    SnapshotMatch(match, snapshot);
+    RestoreMatch(match, snapshot);
+  }
+  run->seconds = GetWallTime() - time;
+  run->allocs = allocations - start;
+  run->ops = 100000;
+  free(snapshot);
+  FreeMatch(match);
+}
+
+// State delta of a tick against the previous one, as sent to a client that
+// acknowledged every state
+void benchDelta(BenchRun *run) { encodeDeltas(run, 0); }
+
+// Full state, as sent to a client that just joined
+void benchDeltaFull(BenchRun *run) { encodeDeltas(run, 1); }
+
+// Encodes every tick of seeded matches for DELTA_CLIENTS clients and checks
+// that it decodes to the same view. Only the encoding is timed.
+void encodeDeltas(BenchRun *run, _Bool full) {
+  MatchConfig config = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, DEFAULT_PLAYERS};
+  long maxTicks = (long)MATCH_TIME_LIMIT * TICK_RATE;
+  StateView *views[2] = {CreateStateView(config), CreateStateView(config)};
+  StateView *decoded = CreateStateView(config);
+  uint8_t data[4096];
+  for (unsigned int seed = 1; run->ops < 200000; seed++) {
+    Match *match = InitMatchWithConfig(config, seed);
+    skipCountdown(match);
+    unsigned int policyState = seed * 2654435761u;
+    ClearStateView(views[0]);
+    for (long tick = 0; !IsMatchOver(match) && tick < maxTicks; tick++) {
+      playRandom(match, &policyState);
+      StepMatch(match, TICK_TIME);
+      StateView *base = full ? NULL : views[tick % 2];
+      StateView *view = views[(tick + 1) % 2];
+      CaptureStateView(view, match);
+      int length = 0;
+      long start = allocations;
+      double time = GetWallTime();
+      for (int i = 0; i < DELTA_CLIENTS; i++) {
+        length = EncodeStateDelta(base, view, data, sizeof(data));
+      }
+      run->seconds += GetWallTime() - time;
+      run->allocs += allocations - start;
+      run->ops += DELTA_CLIENTS;
+      run->bytes += (long)length * DELTA_CLIENTS;
+      if (length < 0 || !DecodeStateDelta(base, decoded, data, length) ||
+          !EqualStateViews(decoded, view)) {
+        corrupted = 1;
+      }
+    }
+    FreeMatch(match);
+  }
+  FreeStateView(decoded);
+  FreeStateView(views[0]);
+  FreeStateView(views[1]);
+}
+
+// Bots playing every player of a large map. Only the planner is timed, its
+// update is shared by the living bots of a tick.
+void benchBots(BenchRun *run) {
+  MatchConfig config = {63, 63, MAX_PLAYERS};
+  for (unsigned int seed = 1; run->ops < BOT_TICKS; seed++) {
+    Match *match = InitMatchWithConfig(config, seed);
+    skipCountdown(match);
+    BotPlanner *planner = CreateBotPlanner(match);
+    while (!IsMatchOver(match) && run->ops < BOT_TICKS) {
+      long start = allocations;
+      double time = GetWallTime();
+      UpdateBotPlanner(planner, match);
+      for (int i = 0; i < config.players; i++) {
+        Command command;
+        if (PlanBotCommand(planner, match, i, &command)) {
+          ApplyCommand(match, command);
+        }
+        run->ops += match->players.isAlive[i];
+      }
+      run->seconds += GetWallTime() - time;
+      run->allocs += allocations - start;
+      StepMatch(match, TICK_TIME);
+    }
+    FreeBotPlanner(planner);
+    FreeMatch(match);
+  }
+}
+
+// Rollouts of the MCTS bot on one thread
+void benchMcts(BenchRun *run) { searchPositions(run, 1, 1); }
+
+// Same on every core, the speedup is the scaling of the root parallel search
+void benchMctsParallel(BenchRun *run) {
+  searchPositions(run, GetNumCores(), 1);
+}
+
+// The three bots of a local match searched in one batch, as the game does
+void benchMctsBatch(BenchRun *run) {
+  searchPositions(run, GetNumCores(), 0xe);
+}
+
+// Decisions of players in seeded matches after some random play, with a
+// fixed number of rollouts so every run does the same work
+void searchPositions(BenchRun *run, int threads, uint64_t players) {
+  MctsConfig config = {threads, 0, MCTS_ROLLOUTS};
+  run->threads = threads;
+  for (unsigned int seed = 1; seed <= MCTS_POSITIONS; seed++) {
+    Match *match = InitMatch(seed);
+    skipCountdown(match);
+    unsigned int policyState = seed * 2654435761u;
+    for (int i = 0; i < 120 || match->players.state[0] != IDLE; i++) {
+      playRandom(match, &policyState);
+      StepMatch(match, TICK_TIME);
+    }
+    MctsBot *bot = CreateMctsBot(match, config);
+    Command commands[MAX_PLAYERS];
+    long start = allocations;
+    double time = GetWallTime();
+    PlanMctsCommands(bot, match, players, commands);
+    run->seconds += GetWallTime() - time;
+    run->allocs += allocations - start;
+    run->ops += GetMctsRollouts(bot);
+    FreeMctsBot(bot);
+    FreeMatch(match);
+  }
+}
+
+// One env step of the vectorized environment, a tick of one match with
+// its actions, rewards and observation
+void benchVecEnv(BenchRun *run) { stepVecEnv(run, 1); }
+
+void benchVecEnvParallel(BenchRun *run) { stepVecEnv(run, GetNumCores()); }
+
+// Steps the batch with random actions, as an untrained agent plays
+void stepVecEnv(BenchRun *run, int threads) {
+  VecEnvConfig config = {
+      .match = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, DEFAULT_PLAYERS},
+      .envs = VEC_ENVS,
+      .threads = threads,
+      .ticksPerStep = 1,
+      .maxTicks = (long)MATCH_TIME_LIMIT * TICK_RATE,
+      .seed = 1};
+  VecEnv *env = CreateVecEnv(config);
+  run->threads = threads;
+  int players = config.match.players;
+  uint8_t *actions = (uint8_t *)malloc(VEC_ENVS * players);
+  float *rewards = (float *)malloc(sizeof(float) * VEC_ENVS * players);
+  uint8_t *dones = (uint8_t *)malloc(VEC_ENVS);
+  uint8_t *observations =
+      (uint8_t *)malloc((size_t)VEC_ENVS * GetVecObservationSize(env));
+  ResetVecEnv(env, observations);
+  unsigned int policyState = 1;
+  for (int step = 0; step < VEC_STEPS; step++) {
+    for (int i = 0; i < VEC_ENVS * players; i++) {
+      unsigned int r = NextRandom(&policyState);
+      actions[i] = r % 8 != 0 ? VEC_WAIT : 1 + (r >> 3) % (_VEC_ACTION_NUM - 1);
+    }
+    long start = allocations;
+    double time = GetWallTime();
+    StepVecEnv(env, actions, rewards, dones, observations);
+    run->seconds += GetWallTime() - time;
+    run->allocs += allocations - start;
+    run->ops += VEC_ENVS;
+  }
+  free(observations);
+  free(dones);
+  free(rewards);
+  free(actions);
+  FreeVecEnv(env);
+}
+
+// Plays seeded matches with the random policy until minTicks were stepped.
+// Only the ticks are timed, setup and countdown are not.
+void playMatches(BenchRun *run, MatchConfig config, void (*setup)(Match *),
+                 long minTicks) {
+  long maxTicks = (long)MATCH_TIME_LIMIT * TICK_RATE;
+  for (unsigned int seed = 1; run->ops < minTicks; seed++) {
+    Match *match = InitMatchWithConfig(config, seed);
+    skipCountdown(match);
+    if (setup != NULL) {
+      setup(match);
+    }
+    unsigned int policyState = seed * 2654435761u;
+    long ticks = 0;
+    long start = allocations;
+    double time = GetWallTime();
+    while (!IsMatchOver(match) && ticks < maxTicks) {
+      playRandom(match, &policyState);
+      StepMatch(match, TICK_TIME);
+      ticks++;
+    }
+    run->seconds += GetWallTime() - time;
+    run->allocs += allocations - start;
+    run->ops += ticks;
+    FreeMatch(match);
+  }
+}
+
+void clearCrates(Match *match) {
+  for (int x = 0; x < match->config.width; x++) {
+    for (int y = 0; y < match->config.height; y++) {
+      Position position = {x, y};
+      if (GetCell(match, position).type == CELL_DESTRUCTIBLE) {
+        SetCell(match, position, CELL_EMPTY);
+      }
+    }
+  }
+}
+
+// Every free cell but the ones players stand on
+void fillCrates(Match *match) {
+  for (int x = 0; x < match->config.width; x++) {
+    for (int y = 0; y < match->config.height; y++) {
+      Position position = {x, y};
+      if (GetCell(match, position).type == CELL_EMPTY &&
+          match->playersAt[GetCellIndex(match, position)] == 0) {
+        SetCell(match, position, CELL_DESTRUCTIBLE);
+      }
+    }
+  }
+}
+
+Match *setupChain(unsigned int seed) {
+  // One more column than bombs so the corridor in row 1 fits the chain
+  int size = CHAIN_BOMBS + 3;
+  MatchConfig config = {size, size, DEFAULT_PLAYERS};
+  Match *match = InitMatchWithConfig(config, seed);
+  skipCountdown(match);
+  for (int x = 1; x < size - 1; x++) {
+    SetCell(match, (Position){x, 1}, CELL_EMPTY);
+  }
+  match->players.bombs[0] = CHAIN_BOMBS;
+  for (int i = 0; i < CHAIN_BOMBS; i++) {
+    PlacePlayer(match, 0, (Position){i + 1, 1});
+    PlantBomb(match, 0);
+    match->bombs.endTime[i] = match->time + (i == 0 ? 0 : MATCH_TIME_LIMIT);
+  }
+  return match;
+}
+
+void skipCountdown(Match *match) {
+  while (match->countdown > 0.0f) {
+    StepMatch(match, TICK_TIME);
+  }
+}
+
+// Same stand-in policy as batch: idle players occasionally walk or plant
+void playRandom(Match *match, unsigned int *state) {
+  for (int i = 0; i < match->config.players; i++) {
+    if (!match->players.isAlive[i] || match->players.state[i] != IDLE) {
+      continue;
+    }
+    unsigned int r = NextRandom(state);
+    if (r % 8 != 0) {
+      continue;
+    }
+    if ((r >> 3) % 5 == 0) {
+      PlantBomb(match, i);
+    } else {
+      MovePlayer(match, i, (Direction)((r >> 6) % _DIRECTION_NUM));
+    }
+  }
+}
+
+// Returns 1 if a scenario got slower than the tolerance allows or allocates
+// more than its baseline. Times are compared relative to the machine: the
+// median ratio of all scenarios to their baseline is taken as the speed of
+// this machine, on a slower one a scenario fails if it fell behind the
+// others. A scenario run on another number of threads than its baseline
+// row only compares allocations, and the speedup is only compared against
+// a baseline recorded on several threads.
+int compareBaseline(const char *fileName, BenchResult *results,
+                    int numResults) {
+  FILE *file = fopen(fileName, "r");
+  if (file == NULL) {
+    fprintf(stderr, "bench: no baseline %s\n", fileName);
+    return 1;
+  }
+  double tolerance = getenv("BENCH_TOLERANCE")
+                         ? atof(getenv("BENCH_TOLERANCE"))
+                         : BENCH_TOLERANCE;
+  int failed = 0;
+  // Baseline time and speedup of every result, 0 if it has none
+  double baseline[BENCH_MAX_SCENARIOS] = {0};
+  double baseSpeedup[BENCH_MAX_SCENARIOS] = {0};
+  double ratios[BENCH_MAX_SCENARIOS];
+  int numRatios = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char name[64];
+    char unit[16];
+    double ns, allocs, rate, bytes, speedup;
+    int threads;
+    if (sscanf(line, "%63[^,],%15[^,],%lf,%lf,%lf,%lf,%d,%lf", name, unit,
+               &ns, &allocs, &rate, &bytes, &threads, &speedup) != 8) {
+      continue;
+    }
+    for (int i = 0; i < numResults; i++) {
+      BenchResult *result = &results[i];
+      if (strcmp(result->name, name) != 0 || ns <= 0) {
+        continue;
+      }
+      if (threads != result->threads) {
+        fprintf(stderr, "bench: %s ran on %i threads, baseline on %i, "
+                "only allocations are compared\n", name, result->threads,
+                threads);
+      } else {
+        baseline[i] = ns;
+        baseSpeedup[i] = threads > 1 ? speedup : 0;
+        ratios[numRatios++] = result->nsPerOp / ns;
+      }
+      if (result->allocsPerOp > allocs + 1e-9) {
+        fprintf(stderr,
+                "bench: REGRESSION %s %.3f allocs/%s, baseline %.3f\n", name,
+                result->allocsPerOp, unit, allocs);
+        failed = 1;
+      }
+    }
+  }
+  fclose(file);
+  if (numRatios == 0) {
+    fprintf(stderr, "bench: no scenario of %s was run\n", fileName);
+    return 1;
+  }
+  qsort(ratios, numRatios, sizeof(double), compareRatios);
+  double machine = numRatios % 2 == 1
+                       ? ratios[numRatios / 2]
+                       : (ratios[numRatios / 2 - 1] + ratios[numRatios / 2]) /
+                             2;
+  fprintf(stderr, "bench: this machine takes %.2fx the baseline times\n",
+          machine);
+  // A faster machine does not make the gate stricter, timings are too noisy
+  if (machine < 1) {
+    machine = 1;
+  }
+  for (int i = 0; i < numResults; i++) {
+    BenchResult *result = &results[i];
+    if (baseline[i] == 0) {
+      continue;
+    }
+    double ratio = result->nsPerOp / baseline[i] / machine;
+    if (ratio > tolerance) {
+      fprintf(stderr,
+              "bench: REGRESSION %s %.1f ns/%s, baseline %.1f (%+.0f%% "
+              "after the machine)\n",
+              result->name, result->nsPerOp, result->unit, baseline[i],
+              (ratio - 1) * 100);
+      failed = 1;
+    }
+    // A baseline on one thread says nothing about scaling
+    if (baseSpeedup[i] > 0 && result->speedup * tolerance < baseSpeedup[i]) {
+      fprintf(stderr,
+              "bench: REGRESSION %s speedup %.2fx on %i threads, baseline "
+              "%.2fx\n",
+              result->name, result->speedup, result->threads,
+              baseSpeedup[i]);
+      failed = 1;
+    }
+  }
+  if (!failed) {
+    fprintf(stderr, "bench: no regressions against %s\n", fileName);
+  }
+  return failed;
+}
+
+int compareRatios(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
@@ -0,0 +1,249 @@
+#include "bitboard.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// A row spans BOARD_WORDS words, which is exactly one AVX2 register. Scalar
+// loops only visit the words covering the board width, the rest stay zero.
+_Static_assert(BOARD_WORDS == 4, "Bitboard row is not a 256 bit vector");
+
+int boardWords(const Bitboard *board);
+uint64_t boardLastMask(const Bitboard *board);
+
+void BoardInit(Bitboard *board, int width, int height) {
+  board->width = width;
+  board->height = height;
+  for (int y = 0; y < height; y++) {
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      board->row[y][i] = 0;
+    }
+  }
+}
+
+void BoardClear(Bitboard *board) {
+  BoardInit(board, board->width, board->height);
+}
+
+void BoardFill(Bitboard *board) {
+  int words = boardWords(board);
+  for (int y = 0; y < board->height; y++) {
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      board->row[y][i] = i < words - 1 ? ~(uint64_t)0 : 0;
+    }
+    board->row[y][words - 1] = boardLastMask(board);
+  }
+}
+
+void BoardCopy(Bitboard *out, const Bitboard *in) {
+  out->width = in->width;
+  out->height = in->height;
+  for (int y = 0; y < in->height; y++) {
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      out->row[y][i] = in->row[y][i];
+    }
+  }
+}
+
+_Bool BoardIsEmpty(const Bitboard *board) {
+  int words = boardWords(board);
+  uint64_t any = 0;
+  for (int y = 0; y < board->height; y++) {
+    for (int i = 0; i < words; i++) {
+      any |= board->row[y][i];
+    }
+  }
+  return any == 0;
+}
+
+int BoardCount(const Bitboard *board) {
+  int words = boardWords(board);
+  int count = 0;
+  for (int y = 0; y < board->height; y++) {
+    for (int i = 0; i < words; i++) {
+      count += __builtin_popcountll(board->row[y][i]);
+    }
+  }
+  return count;
+}
+
+void BoardAnd(Bitboard *out, const Bitboard *a, const Bitboard *b) {
+  out->width = a->width;
+  out->height = a->height;
+  for (int y = 0; y < a->height; y++) {
+#ifdef __AVX2__
+    __m256i va = _mm256_loadu_si256((const __m256i *)a->row[y]);
+    __m256i vb = _mm256_loadu_si256((const __m256i *)b->row[y]);
+    _mm256_storeu_si256((__m256i *)out->row[y], _mm256_and_si256(va, vb));
+#else
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      out->row[y][i] = a->row[y][i] & b->row[y][i];
+    }
+#endif
+  }
+}
+
+void BoardOr(Bitboard *out, const Bitboard *a, const Bitboard *b) {
+  out->width = a->width;
+  out->height = a->height;
+  for (int y = 0; y < a->height; y++) {
+#ifdef __AVX2__
+    __m256i va = _mm256_loadu_si256((const __m256i *)a->row[y]);
+    __m256i vb = _mm256_loadu_si256((const __m256i *)b->row[y]);
+    _mm256_storeu_si256((__m256i *)out->row[y], _mm256_or_si256(va, vb));
+#else
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      out->row[y][i] = a->row[y][i] | b->row[y][i];
+    }
+#endif
+  }
+}
+
+void BoardAndNot(Bitboard *out, const Bitboard *a, const Bitboard *b) {
+  out->width = a->width;
+  out->height = a->height;
+  for (int y = 0; y < a->height; y++) {
+#ifdef __AVX2__
+    __m256i va = _mm256_loadu_si256((const __m256i *)a->row[y]);
+    __m256i vb = _mm256_loadu_si256((const __m256i *)b->row[y]);
+    // andnot negates its first operand
+    _mm256_storeu_si256((__m256i *)out->row[y], _mm256_andnot_si256(vb, va));
+#else
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      out->row[y][i] = a->row[y][i] & ~b->row[y][i];
+    }
+#endif
+  }
+}
+
+void BoardShift(Bitboard *out, const Bitboard *in, Direction direction) {
+  int height = in->height;
+  int words = boardWords(in);
+  out->width = in->width;
+  out->height = height;
+  switch (direction) {
+  case NORTH:
+    for (int y = 0; y < height - 1; y++) {
+      for (int i = 0; i < BOARD_WORDS; i++) {
+        out->row[y][i] = in->row[y + 1][i];
+      }
+    }
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      out->row[height - 1][i] = 0;
+    }
+    break;
+  case SOUTH:
+    for (int y = height - 1; y > 0; y--) {
+      for (int i = 0; i < BOARD_WORDS; i++) {
+        out->row[y][i] = in->row[y - 1][i];
+      }
+    }
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      out->row[0][i] = 0;
+    }
+    break;
+  case EAST:
+    // Carry the top bit into the next word, highest word first so out may
+    // alias in
+    for (int y = 0; y < height; y++) {
+      for (int i = words - 1; i >= 0; i--) {
+        uint64_t carry = i > 0 ? in->row[y][i - 1] >> 63 : 0;
+        out->row[y][i] = (in->row[y][i] << 1) | carry;
+      }
+      out->row[y][words - 1] &= boardLastMask(in);
+      for (int i = words; i < BOARD_WORDS; i++) {
+        out->row[y][i] = 0;
+      }
+    }
+    break;
+  case WEST:
+    for (int y = 0; y < height; y++) {
+      for (int i = 0; i < words; i++) {
+        uint64_t carry = i + 1 < words ? in->row[y][i + 1] << 63 : 0;
+        out->row[y][i] = (in->row[y][i] >> 1) | carry;
+      }
+      for (int i = words; i < BOARD_WORDS; i++) {
+        out->row[y][i] = 0;
+      }
+    }
+    break;
+  default:
+    BoardCopy(out, in);
+    break;
+  }
+}
+
+void BoardBlast(Bitboard *out, const Bitboard *sources, const Bitboard *open,
+                const Bitboard *walls, int radius) {
+  BoardCopy(out, sources);
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    BoardRow frontRows[MAX_GRID_SIZE];
+    Bitboard front = {.row = frontRows};
+    BoardCopy(&front, sources);
+    for (int k = 1; k <= radius; k++) {
+      BoardShift(&front, &front, (Direction)d);
+      BoardAndNot(&front, &front, walls);
+      BoardOr(out, out, &front);
+      BoardAnd(&front, &front, open);
+      if (BoardIsEmpty(&front)) {
+        break;
+      }
+    }
+  }
+}
+
+void GetWalkableBoard(Match *match, Bitboard *out) {
+  BoardLayers *layers = &match->layers;
+  BoardInit(out, match->config.width, match->config.height);
+  BoardFill(out);
+  BoardAndNot(out, out, &layers->walls);
+  BoardAndNot(out, out, &layers->crates);
+  BoardAndNot(out, out, &layers->bombs);
+}
+
+void GetBlastBoard(Match *match, Bitboard *out) {
+  BoardLayers *layers = &match->layers;
+  BombTable *bombs = &match->bombs;
+  int width = match->config.width;
+  int height = match->config.height;
+  BoardRow openRows[MAX_GRID_SIZE];
+  Bitboard open = {.row = openRows};
+  BoardInit(&open, width, height);
+  BoardFill(&open);
+  BoardAndNot(&open, &open, &layers->walls);
+  BoardAndNot(&open, &open, &layers->crates);
+  BoardInit(out, width, height);
+  // Bombs blast with the radius of their owner at detonation, so one pass
+  // per owner covers all of them
+  uint64_t owners = 0;
+  for (int i = 0; i < bombs->count; i++) {
+    if (bombs->endTime[i] != 0) {
+      owners |= (uint64_t)1 << bombs->owner[i];
+    }
+  }
+  for (int p = 0; owners; p++, owners >>= 1) {
+    if (!(owners & 1)) {
+      continue;
+    }
+    BoardRow sourcesRows[MAX_GRID_SIZE];
+    Bitboard sources = {.row = sourcesRows};
+    BoardInit(&sources, width, height);
+    for (int i = 0; i < bombs->count; i++) {
+      if (bombs->owner[i] == p && bombs->endTime[i] != 0) {
+        BoardSet(&sources, bombs->position[i]);
+      }
+    }
+    BoardRow blastRows[MAX_GRID_SIZE];
+    Bitboard blast = {.row = blastRows};
+    BoardBlast(&blast, &sources, &open, &layers->walls,
+               match->players.blastRadius[p]);
+    BoardOr(out, out, &blast);
+  }
+}
+
+int boardWords(const Bitboard *board) { return (board->width + 63) >> 6; }
+
+// Valid bits of the last word of a row
+uint64_t boardLastMask(const Bitboard *board) {
+  int bits = board->width & 63;
+  return bits ? ((uint64_t)1 << bits) - 1 : ~(uint64_t)0;
+}
@@ -0,0 +1,51 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include "sim.h"
+
+// Bitboard kernels for bulk board queries (walkability, blast reach).
+// Element-wise operations use AVX2 when the compiler targets it, build with
+// make SIMD=-mavx2 to enable it.
+
+static inline _Bool BoardTest(const Bitboard *board, Position pos) {
+  return (board->row[pos.y][pos.x >> 6] >> (pos.x & 63)) & 1;
+}
+
+static inline void BoardSet(Bitboard *board, Position pos) {
+  board->row[pos.y][pos.x >> 6] |= (uint64_t)1 << (pos.x & 63);
+}
+
+static inline void BoardReset(Bitboard *board, Position pos) {
+  board->row[pos.y][pos.x >> 6] &= ~((uint64_t)1 << (pos.x & 63));
+}
+
+// Empty board of the given size
+void BoardInit(Bitboard *board, int width, int height);
+void BoardClear(Bitboard *board);
+// Every cell of the board
+void BoardFill(Bitboard *board);
+void BoardCopy(Bitboard *out, const Bitboard *in);
+_Bool BoardIsEmpty(const Bitboard *board);
+int BoardCount(const Bitboard *board);
+
+// out takes the size of a and may alias the operands
+void BoardAnd(Bitboard *out, const Bitboard *a, const Bitboard *b);
+void BoardOr(Bitboard *out, const Bitboard *a, const Bitboard *b);
+// a & ~b
+void BoardAndNot(Bitboard *out, const Bitboard *a, const Bitboard *b);
+
+// Move every cell one step in direction, cells leaving the board are dropped
+void BoardShift(Bitboard *out, const Bitboard *in, Direction direction);
+
+// Cells reached by blasts of the given radius from every source at once.
+// Flames pass through open cells, a blocker cell is reached but stops the
+// ray, walls are never reached.
+void BoardBlast(Bitboard *out, const Bitboard *sources, const Bitboard *open,
+                const Bitboard *walls, int radius);
+
+// Cells a player may walk on
+void GetWalkableBoard(Match *match, Bitboard *out);
+
+// Cells the flames of all live bombs will reach
+void GetBlastBoard(Match *match, Bitboard *out);
+#endif // BITBOARD_H
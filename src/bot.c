@@ -0,0 +1,1162 @@
+#include "bot.h"
+#include "bitboard.h"
+#include "log.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Seconds a bot keeps clear of a fire window on either side, a step or a
+// flame may land a tick late
+#define BOT_MARGIN (3 * TICK_TIME)
+// Direction of a live bomb, rays of detonated bombs keep their own
+#define THREAT_BOMB _DIRECTION_NUM
+// Most cells a search reaches within BOT_SEARCH_DEPTH steps
+#define BOT_SEARCH_CELLS (2 * BOT_SEARCH_DEPTH * (BOT_SEARCH_DEPTH + 1) + 1)
+
+// A fire source of the danger map: a live bomb burning all four rays or one
+// ray of a detonated bomb. A source keeps its slot from the match event that
+// brought it to the one that ended it.
+typedef struct {
+  Position position;
+  // THREAT_BOMB, the direction of the ray or -1 for a free slot
+  int direction;
+  int radius;
+  // Time the fire starts at the source and the seconds it takes per cell
+  double start;
+  double step;
+  // Burning cells per direction besides the source, -1 for the directions
+  // it does not cover
+  int reach[_DIRECTION_NUM];
+  // Bombs only: planting time and fuse. A bomb starts at its fuse unless
+  // the fire of another source reaches it first.
+  double planted;
+  double fuse;
+  // Next source on the same cell or next free slot, -1 at the end
+  int next;
+  // Chain resolution the bomb was last taken into and whether it waits in
+  // the chain queue
+  unsigned int chainRound;
+  _Bool queued;
+} Threat;
+
+// A ray going out, min-heap on time like the blast queue of a match
+typedef struct {
+  double time;
+  int threat;
+} ThreatExpiry;
+
+// Last search of a bot. It holds while the bot stands on the same cell, no
+// tile of the cells it looked at changed and none of them turned safe or
+// unsafe since.
+typedef struct {
+  Position start;
+  double stepTime;
+  long version;
+  double validUntil;
+  // Tiles of the cells looked at
+  Position minTile;
+  Position maxTile;
+  // Cells in order of distance with depth and first step, by queue entry
+  int count;
+  int *cells;
+  uint8_t *depth;
+  uint8_t *firstStep;
+} BotSearch;
+
+// A single allocation, this header followed by the arrays sized by the map
+struct BotPlanner {
+  MatchConfig config;
+  // Tick and journal position the planner has caught up with
+  long tick;
+  long cellChanges;
+  // Counts updates, every tile of 8x8 cells carries the last update that
+  // changed its collision or danger
+  long version;
+  int tilesX;
+  long *tileVersion;
+  // Cells a player collides with, as isCollision in sim.c, and the cells
+  // that stop a flame
+  Bitboard collision;
+  Bitboard blockers;
+  // Blast radius of every player as last seen. No fire reaches further than
+  // the largest one.
+  int blastRadius[MAX_PLAYERS];
+  int maxRadius;
+  // Players alive as last seen, one bit each
+  uint64_t alive;
+  // Danger map by cell index y * width + x: first and last time fire burns
+  // a cell, DBL_MAX and -DBL_MAX if no fire reaches it
+  double *arrive;
+  double *leave;
+  // Source slots, the sources of a cell are listed from threatAt and free
+  // slots from freeThreat
+  int capacity;
+  Threat *threats;
+  int *threatAt;
+  int freeThreat;
+  int numExpiries;
+  ThreatExpiry *expiries;
+  // Bombs whose start may have changed, marked with chainRound, and the
+  // queue settling them
+  int numSeeds;
+  int *seeds;
+  int *chain;
+  unsigned int chainRound;
+  // Cells of the danger map to recompute, marked with the current round
+  int numDirty;
+  int *dirty;
+  unsigned int *dirtyRound;
+  unsigned int round;
+  // Cells of the journal seen in the current round and the crates among
+  // them that broke
+  unsigned int *eventRound;
+  int numOpened;
+  Position opened[CELL_JOURNAL_SIZE];
+  // Cells a search visited carry searchRound
+  unsigned int *visited;
+  unsigned int searchRound;
+  BotSearch searches[MAX_PLAYERS];
+  unsigned int rngState;
+};
+
+// Danger map functions
+void rebuild(BotPlanner *planner, Match *match);
+int followJournal(BotPlanner *planner, Match *match);
+void followBomb(BotPlanner *planner, Match *match, Position position);
+void followRays(BotPlanner *planner, Match *match);
+void followBlastRadius(BotPlanner *planner, Match *match);
+void followDeaths(BotPlanner *planner, Match *match);
+void stopRays(BotPlanner *planner, Match *match, Position source,
+              int direction, int k);
+_Bool isRayBurning(Match *match, const Threat *threat);
+void openCell(BotPlanner *planner, Match *match, Position position);
+void expireRays(BotPlanner *planner, double time);
+#ifdef BOT_CHECK
+void checkDangerMap(BotPlanner *planner, Match *match);
+#endif
+void addBombThreat(BotPlanner *planner, Match *match, int bomb);
+void addRayThreat(BotPlanner *planner, Match *match, int explosion);
+int addThreat(BotPlanner *planner, Position position, int direction);
+void removeThreat(BotPlanner *planner, int slot);
+int findBombThreat(BotPlanner *planner, Position position);
+void traceBomb(BotPlanner *planner, Threat *threat, int radius);
+int traceRay(BotPlanner *planner, Position position, int direction,
+             int radius);
+void touchThreat(BotPlanner *planner, int slot);
+void touchCell(BotPlanner *planner, Position position);
+void seedBomb(BotPlanner *planner, int slot);
+void resolveChains(BotPlanner *planner, Match *match);
+_Bool getCellWindow(BotPlanner *planner, Position position, int skip,
+                    double *arrive, double *leave);
+void widenCellWindow(BotPlanner *planner, Position source, Position position,
+                     int skip, double *arrive, double *leave);
+_Bool getFireWindow(const Threat *threat, Position position, double *from,
+                    double *to);
+double getThreatEnd(const Threat *threat);
+void pushExpiry(BotPlanner *planner, double time, int threat);
+ThreatExpiry popExpiry(BotPlanner *planner);
+void markCell(BotPlanner *planner, Position position);
+void touchTile(BotPlanner *planner, Position position);
+void refreshDirtyCells(BotPlanner *planner);
+
+// Search functions
+BotSearch *getSearch(BotPlanner *planner, Match *match, int player,
+                     double stepTime);
+_Bool isSearchValid(BotPlanner *planner, BotSearch *found, Position start,
+                    double stepTime, double time);
+void search(BotPlanner *planner, Match *match, BotSearch *found,
+            Position start, double stepTime);
+_Bool isSafeAt(BotPlanner *planner, int cell, double from, double to,
+               double *lasts);
+_Bool isSafeToStay(BotPlanner *planner, int cell, double time);
+_Bool isBombSpot(Match *match, int player, Position position);
+_Bool canEscape(BotPlanner *planner, Match *match, int player,
+                BotSearch *found, double stepTime);
+int getNearestEnemy(Match *match, int player);
+int getDistance(Position a, Position b);
+unsigned int botRand(BotPlanner *planner);
+
+BotPlanner *CreateBotPlanner(Match *match) {
+  int width = match->config.width;
+  int height = match->config.height;
+  int cells = width * height;
+  int tilesX = (width + GRID_TILE - 1) >> GRID_TILE_SHIFT;
+  int tiles = tilesX * ((height + GRID_TILE - 1) >> GRID_TILE_SHIFT);
+  int capacity = match->bombs.capacity + match->explosions.capacity;
+  int players = match->config.players;
+  int searchCells = cells < BOT_SEARCH_CELLS ? cells : BOT_SEARCH_CELLS;
+  size_t size = sizeof(BotPlanner) + 2 * cells * sizeof(double) +
+                2 * height * sizeof(BoardRow) +
+                capacity * (sizeof(Threat) + sizeof(ThreatExpiry)) +
+                tiles * sizeof(long) +
+                (2 * cells + 2 * capacity) * sizeof(int) +
+                3 * cells * sizeof(unsigned int) +
+                players * searchCells * (sizeof(int) + 2);
+  BotPlanner *planner = (BotPlanner *)malloc(size);
+  if (planner == NULL) {
+    LOG_ERROR("Allocation of bot planner failed!", NULL);
+    return NULL;
+  }
+  // Largest alignment first
+  char *next = (char *)(planner + 1);
+  planner->arrive = (double *)next;
+  next += cells * sizeof(double);
+  planner->leave = (double *)next;
+  next += cells * sizeof(double);
+  planner->collision.row = (BoardRow *)next;
+  next += height * sizeof(BoardRow);
+  planner->blockers.row = (BoardRow *)next;
+  next += height * sizeof(BoardRow);
+  planner->threats = (Threat *)next;
+  next += capacity * sizeof(Threat);
+  planner->expiries = (ThreatExpiry *)next;
+  next += capacity * sizeof(ThreatExpiry);
+  planner->tileVersion = (long *)next;
+  next += tiles * sizeof(long);
+  planner->threatAt = (int *)next;
+  next += cells * sizeof(int);
+  planner->dirty = (int *)next;
+  next += cells * sizeof(int);
+  planner->seeds = (int *)next;
+  next += capacity * sizeof(int);
+  planner->chain = (int *)next;
+  next += capacity * sizeof(int);
+  for (int i = 0; i < players; i++) {
+    planner->searches[i].cells = (int *)next;
+    next += searchCells * sizeof(int);
+  }
+  planner->dirtyRound = (unsigned int *)next;
+  next += cells * sizeof(unsigned int);
+  planner->eventRound = (unsigned int *)next;
+  next += cells * sizeof(unsigned int);
+  planner->visited = (unsigned int *)next;
+  next += cells * sizeof(unsigned int);
+  for (int i = 0; i < players; i++) {
+    BotSearch *found = &planner->searches[i];
+    found->depth = (uint8_t *)next;
+    next += searchCells;
+    found->firstStep = (uint8_t *)next;
+    next += searchCells;
+    found->version = -1;
+  }
+  memset(planner->dirtyRound, 0, cells * sizeof(unsigned int));
+  memset(planner->eventRound, 0, cells * sizeof(unsigned int));
+  memset(planner->visited, 0, cells * sizeof(unsigned int));
+  planner->config = match->config;
+  planner->tilesX = tilesX;
+  planner->capacity = capacity;
+  planner->version = 0;
+  planner->round = 0;
+  planner->chainRound = 0;
+  planner->searchRound = 0;
+  // xorshift must not start from zero
+  planner->rngState = match->seed ? match->seed : 1;
+  rebuild(planner, match);
+  return planner;
+}
+
+void FreeBotPlanner(BotPlanner *planner) { free(planner); }
+
+void UpdateBotPlanner(BotPlanner *planner, Match *match) {
+  long behind = match->cellChanges - planner->cellChanges;
+  if (match->tick < planner->tick || behind < 0 ||
+      behind > CELL_JOURNAL_SIZE) {
+    rebuild(planner, match);
+    return;
+  }
+  planner->version++;
+  planner->round++;
+  planner->numDirty = 0;
+  planner->chainRound++;
+  planner->numSeeds = 0;
+  // Every source that appeared, changed or went out marks the cells it
+  // covers and the bombs among them
+  if (followJournal(planner, match) > 0) {
+    followRays(planner, match);
+  }
+  for (int i = 0; i < planner->numOpened; i++) {
+    openCell(planner, match, planner->opened[i]);
+  }
+  followBlastRadius(planner, match);
+  followDeaths(planner, match);
+  expireRays(planner, match->time);
+  resolveChains(planner, match);
+  refreshDirtyCells(planner);
+  planner->tick = match->tick;
+#ifdef BOT_CHECK
+  checkDangerMap(planner, match);
+#endif
+}
+
+_Bool PlanBotCommand(BotPlanner *planner, Match *match, int player,
+                     Command *command) {
+  PlayerTable *players = &match->players;
+  if (!players->isAlive[player] || players->state[player] != IDLE) {
+    return 0;
+  }
+  Position position = players->position[player];
+  double stepTime = 1.0 / players->speed[player];
+  BotSearch *found = getSearch(planner, match, player, stepTime);
+  int width = planner->config.width;
+  *command = (Command){match->tick, player, COMMAND_MOVE, NORTH};
+  // In danger: walk to the nearest cell no fire reaches
+  if (!isSafeToStay(planner, found->cells[0], match->time)) {
+    for (int i = 1; i < found->count; i++) {
+      double arrival = match->time + found->depth[i] * stepTime;
+      if (isSafeToStay(planner, found->cells[i], arrival)) {
+        command->direction = (Direction)found->firstStep[i];
+        return 1;
+      }
+    }
+    return 0;
+  }
+  _Bool hasBomb = players->activeBombs[player] < players->bombs[player];
+  if (hasBomb && isBombSpot(match, player, position) &&
+      canEscape(planner, match, player, found, stepTime)) {
+    command->type = COMMAND_PLANT;
+    return 1;
+  }
+  for (int i = 1; i < found->count; i++) {
+    int cell = found->cells[i];
+    Position target = {cell % width, cell / width};
+    double arrival = match->time + found->depth[i] * stepTime;
+    if (!isSafeToStay(planner, cell, arrival)) {
+      continue;
+    }
+    if (BoardTest(&match->layers.powerUps, target) ||
+        (hasBomb && isBombSpot(match, player, target))) {
+      command->direction = (Direction)found->firstStep[i];
+      return 1;
+    }
+  }
+  // Otherwise close in on the nearest enemy
+  int enemy = getNearestEnemy(match, player);
+  if (enemy < 0) {
+    return 0;
+  }
+  Position goal = players->position[enemy];
+  int best = 0;
+  int bestDistance = getDistance(position, goal);
+  for (int i = 1; i < found->count; i++) {
+    int cell = found->cells[i];
+    Position target = {cell % width, cell / width};
+    double arrival = match->time + found->depth[i] * stepTime;
+    int distance = getDistance(target, goal);
+    if (distance < bestDistance && isSafeToStay(planner, cell, arrival)) {
+      best = i;
+      bestDistance = distance;
+    }
+  }
+  if (best == 0) {
+    return 0;
+  }
+  command->direction = (Direction)found->firstStep[best];
+  return 1;
+}
+
+void rebuild(BotPlanner *planner, Match *match) {
+  BoardLayers *layers = &match->layers;
+  BoardOr(&planner->blockers, &layers->walls, &layers->crates);
+  BoardOr(&planner->collision, &planner->blockers, &layers->bombs);
+  planner->cellChanges = match->cellChanges;
+  planner->version++;
+  int cells = planner->config.width * planner->config.height;
+  for (int i = 0; i < cells; i++) {
+    planner->arrive[i] = DBL_MAX;
+    planner->leave[i] = -DBL_MAX;
+    planner->threatAt[i] = -1;
+  }
+  int tiles = planner->tilesX *
+              ((planner->config.height + GRID_TILE - 1) >> GRID_TILE_SHIFT);
+  for (int i = 0; i < tiles; i++) {
+    planner->tileVersion[i] = planner->version;
+  }
+  planner->freeThreat = -1;
+  for (int i = planner->capacity - 1; i >= 0; i--) {
+    planner->threats[i].direction = -1;
+    planner->threats[i].chainRound = 0;
+    planner->threats[i].next = planner->freeThreat;
+    planner->freeThreat = i;
+  }
+  planner->numExpiries = 0;
+  planner->maxRadius = 0;
+  planner->alive = 0;
+  for (int i = 0; i < planner->config.players; i++) {
+    planner->alive |= (uint64_t)match->players.isAlive[i] << i;
+    int radius = match->players.blastRadius[i];
+    planner->blastRadius[i] = radius;
+    planner->maxRadius = radius > planner->maxRadius ? radius
+                                                     : planner->maxRadius;
+  }
+  planner->round++;
+  planner->numDirty = 0;
+  planner->chainRound++;
+  planner->numSeeds = 0;
+  for (int i = 0; i < match->bombs.count; i++) {
+    if (match->bombs.endTime[i] != 0) {
+      addBombThreat(planner, match, i);
+    }
+  }
+  for (int i = 0; i < match->explosions.count; i++) {
+    addRayThreat(planner, match, i);
+  }
+  resolveChains(planner, match);
+  refreshDirtyCells(planner);
+  planner->tick = match->tick;
+}
+
+// Patches the boards with the cells changed since the last update and
+// follows the bombs planted on them or gone off. Returns the number of
+// cells.
+int followJournal(BotPlanner *planner, Match *match) {
+  int width = planner->config.width;
+  int count = 0;
+  planner->numOpened = 0;
+  for (long i = planner->cellChanges; i < match->cellChanges; i++) {
+    Position position = match->changedCells[i % CELL_JOURNAL_SIZE];
+    int cell = position.y * width + position.x;
+    if (planner->eventRound[cell] == planner->round) {
+      continue;
+    }
+    planner->eventRound[cell] = planner->round;
+    count++;
+    CellType type = GetCell(match, position).type;
+    _Bool blocker = type == CELL_SOLID_WALL || type == CELL_DESTRUCTIBLE;
+    _Bool collision = blocker || type == CELL_BOMB;
+    if (collision != BoardTest(&planner->collision, position)) {
+      if (collision) {
+        BoardSet(&planner->collision, position);
+      } else {
+        BoardReset(&planner->collision, position);
+      }
+      touchTile(planner, position);
+    }
+    if (blocker) {
+      BoardSet(&planner->blockers, position);
+    } else if (BoardTest(&planner->blockers, position)) {
+      BoardReset(&planner->blockers, position);
+      planner->opened[planner->numOpened++] = position;
+    }
+    followBomb(planner, match, position);
+  }
+  planner->cellChanges = match->cellChanges;
+  return count;
+}
+
+// A bomb was planted on the cell, went off or both
+void followBomb(BotPlanner *planner, Match *match, Position position) {
+  int bomb = match->bombAt[GetCellIndex(match, position)];
+  int slot = findBombThreat(planner, position);
+  if (slot >= 0 &&
+      (bomb < 0 ||
+       planner->threats[slot].planted != match->bombs.startTime[bomb])) {
+    removeThreat(planner, slot);
+    slot = -1;
+  }
+  if (bomb >= 0 && slot < 0) {
+    addBombThreat(planner, match, bomb);
+  }
+}
+
+// Rays of the bombs that went off on the cells of the journal
+void followRays(BotPlanner *planner, Match *match) {
+  ExplosionTable *explosions = &match->explosions;
+  int width = planner->config.width;
+  for (int i = 0; i < explosions->count; i++) {
+    Position position = explosions->position[i];
+    int cell = position.y * width + position.x;
+    if (planner->eventRound[cell] != planner->round) {
+      continue;
+    }
+    _Bool known = 0;
+    for (int t = planner->threatAt[cell]; t >= 0 && !known;
+         t = planner->threats[t].next) {
+      known = planner->threats[t].direction == (int)explosions->direction[i] &&
+              planner->threats[t].start == explosions->startTime[i];
+    }
+    if (!known) {
+      addRayThreat(planner, match, i);
+    }
+  }
+}
+
+// The owner's blast radius at detonation applies to a bomb
+void followBlastRadius(BotPlanner *planner, Match *match) {
+  BombTable *bombs = &match->bombs;
+  for (int i = 0; i < planner->config.players; i++) {
+    int radius = match->players.blastRadius[i];
+    if (radius == planner->blastRadius[i]) {
+      continue;
+    }
+    planner->blastRadius[i] = radius;
+    planner->maxRadius = radius > planner->maxRadius ? radius
+                                                     : planner->maxRadius;
+    for (int j = 0; j < bombs->count; j++) {
+      if (bombs->endTime[j] == 0 || bombs->owner[j] != i) {
+        continue;
+      }
+      int slot = findBombThreat(planner, bombs->position[j]);
+      if (slot >= 0) {
+        touchThreat(planner, slot);
+        traceBomb(planner, &planner->threats[slot], radius);
+        touchThreat(planner, slot);
+      }
+    }
+  }
+}
+
+// A ray stops on the player it kills
+void followDeaths(BotPlanner *planner, Match *match) {
+  uint64_t alive = 0;
+  for (int i = 0; i < planner->config.players; i++) {
+    alive |= (uint64_t)match->players.isAlive[i] << i;
+  }
+  uint64_t died = planner->alive & ~alive;
+  planner->alive = alive;
+  for (int i = 0; died; i++, died >>= 1) {
+    if (!(died & 1)) {
+      continue;
+    }
+    Position position = match->players.position[i];
+    stopRays(planner, match, position, -1, 0);
+    for (int d = 0; d < _DIRECTION_NUM; d++) {
+      for (int k = 1; k <= planner->maxRadius; k++) {
+        Position source = StepPosition(position, (Direction)d, k);
+        if (BoardTest(&planner->blockers, source)) {
+          break;
+        }
+        stopRays(planner, match, source, (d + 2) % _DIRECTION_NUM, k);
+      }
+    }
+  }
+}
+
+// Takes the rays from source in direction, any for -1, out of the danger
+// map if they reached k cells and left the explosion table. They leave
+// their slot at their expiry.
+void stopRays(BotPlanner *planner, Match *match, Position source,
+              int direction, int k) {
+  int cell = source.y * planner->config.width + source.x;
+  for (int t = planner->threatAt[cell]; t >= 0;
+       t = planner->threats[t].next) {
+    Threat *threat = &planner->threats[t];
+    if (threat->direction == THREAT_BOMB ||
+        (direction >= 0 && threat->direction != direction) ||
+        threat->reach[threat->direction] < k ||
+        isRayBurning(match, threat)) {
+      continue;
+    }
+    touchThreat(planner, t);
+    threat->reach[threat->direction] = -1;
+  }
+}
+
+// Whether the ray is still in the explosion table
+_Bool isRayBurning(Match *match, const Threat *threat) {
+  ExplosionTable *explosions = &match->explosions;
+  for (int i = 0; i < explosions->count; i++) {
+    if (explosions->position[i].x == threat->position.x &&
+        explosions->position[i].y == threat->position.y &&
+        (int)explosions->direction[i] == threat->direction &&
+        explosions->startTime[i] == threat->start) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// A crate broke: the sources it stopped burn on when their front gets
+// there, except the ray that broke it, which went out
+void openCell(BotPlanner *planner, Match *match, Position position) {
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    int toward = (d + 2) % _DIRECTION_NUM;
+    for (int k = 1; k <= planner->maxRadius; k++) {
+      Position source = StepPosition(position, (Direction)d, k);
+      if (BoardTest(&planner->blockers, source)) {
+        break;
+      }
+      int cell = source.y * planner->config.width + source.x;
+      for (int t = planner->threatAt[cell]; t >= 0;
+           t = planner->threats[t].next) {
+        Threat *threat = &planner->threats[t];
+        if (threat->reach[toward] != k - 1 || k > threat->radius) {
+          continue;
+        }
+        // Rays that arrive at the same time tie, only the match knows
+        // which one broke the crate and went out
+        if (threat->direction != THREAT_BOMB && !isRayBurning(match, threat)) {
+          continue;
+        }
+        touchThreat(planner, t);
+        threat->reach[toward] =
+            traceRay(planner, source, toward, threat->radius);
+        touchThreat(planner, t);
+      }
+    }
+  }
+}
+
+// A ray goes out once its front is past the last cell
+void expireRays(BotPlanner *planner, double time) {
+  while (planner->numExpiries > 0 && planner->expiries[0].time <= time) {
+    ThreatExpiry expiry = popExpiry(planner);
+    // A crate that broke since may have lengthened it
+    double end = getThreatEnd(&planner->threats[expiry.threat]);
+    if (end > time) {
+      pushExpiry(planner, end, expiry.threat);
+    } else {
+      removeThreat(planner, expiry.threat);
+    }
+  }
+}
+
+#ifdef BOT_CHECK
+// The map kept across ticks must equal one built from scratch
+void checkDangerMap(BotPlanner *planner, Match *match) {
+  BotPlanner *fresh = CreateBotPlanner(match);
+  if (fresh == NULL) {
+    return;
+  }
+  int width = planner->config.width;
+  for (int i = 0; i < width * planner->config.height; i++) {
+    if (planner->arrive[i] != fresh->arrive[i] ||
+        planner->leave[i] != fresh->leave[i]) {
+      LOG_ERROR("Danger map differs at %i,%i on tick %li: %f..%f, rebuilt "
+                "%f..%f!",
+                i % width, i / width, match->tick, planner->arrive[i],
+                planner->leave[i], fresh->arrive[i], fresh->leave[i]);
+    }
+  }
+  FreeBotPlanner(fresh);
+}
+#endif
+
+void addBombThreat(BotPlanner *planner, Match *match, int bomb) {
+  BombTable *bombs = &match->bombs;
+  int slot = addThreat(planner, bombs->position[bomb], THREAT_BOMB);
+  if (slot < 0) {
+    return;
+  }
+  Threat *threat = &planner->threats[slot];
+  threat->planted = bombs->startTime[bomb];
+  threat->fuse = bombs->endTime[bomb];
+  threat->start = threat->fuse;
+  traceBomb(planner, threat, match->players.blastRadius[bombs->owner[bomb]]);
+  touchThreat(planner, slot);
+}
+
+void addRayThreat(BotPlanner *planner, Match *match, int explosion) {
+  ExplosionTable *explosions = &match->explosions;
+  Position position = explosions->position[explosion];
+  int direction = explosions->direction[explosion];
+  int slot = addThreat(planner, position, direction);
+  if (slot < 0) {
+    return;
+  }
+  Threat *threat = &planner->threats[slot];
+  int radius = explosions->radius[explosion];
+  threat->radius = radius;
+  threat->start = explosions->startTime[explosion];
+  threat->step = 1.0 / (explosions->speed[explosion] * (radius + 1));
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    threat->reach[d] = -1;
+  }
+  // The front passes a crate that broke since the ray was traced
+  threat->reach[direction] = traceRay(planner, position, direction, radius);
+  pushExpiry(planner, getThreatEnd(threat), slot);
+  touchThreat(planner, slot);
+}
+
+// Takes a free slot for a source on position, -1 if there is none
+int addThreat(BotPlanner *planner, Position position, int direction) {
+  int slot = planner->freeThreat;
+  if (slot < 0) {
+    LOG_WARN("Bot planner out of fire sources!", NULL);
+    return -1;
+  }
+  int cell = position.y * planner->config.width + position.x;
+  Threat *threat = &planner->threats[slot];
+  planner->freeThreat = threat->next;
+  threat->position = position;
+  threat->direction = direction;
+  threat->next = planner->threatAt[cell];
+  threat->queued = 0;
+  planner->threatAt[cell] = slot;
+  return slot;
+}
+
+void removeThreat(BotPlanner *planner, int slot) {
+  touchThreat(planner, slot);
+  Threat *threat = &planner->threats[slot];
+  Position position = threat->position;
+  int *link = &planner->threatAt[position.y * planner->config.width +
+                                 position.x];
+  while (*link != slot) {
+    link = &planner->threats[*link].next;
+  }
+  *link = threat->next;
+  threat->direction = -1;
+  threat->next = planner->freeThreat;
+  planner->freeThreat = slot;
+}
+
+int findBombThreat(BotPlanner *planner, Position position) {
+  int cell = position.y * planner->config.width + position.x;
+  for (int t = planner->threatAt[cell]; t >= 0;
+       t = planner->threats[t].next) {
+    if (planner->threats[t].direction == THREAT_BOMB) {
+      return t;
+    }
+  }
+  return -1;
+}
+
+// Rays of a bomb about to go off, as createExplosion traces them
+void traceBomb(BotPlanner *planner, Threat *threat, int radius) {
+  threat->radius = radius;
+  threat->step = 1.0 / (EXPLOSION_SPEED * (radius + 1));
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    threat->reach[d] = traceRay(planner, threat->position, d, radius);
+  }
+}
+
+// Cells of a ray before the first wall or crate
+int traceRay(BotPlanner *planner, Position position, int direction,
+             int radius) {
+  for (int k = 1; k <= radius; k++) {
+    if (BoardTest(&planner->blockers,
+                  StepPosition(position, (Direction)direction, k))) {
+      return k - 1;
+    }
+  }
+  return radius;
+}
+
+// Marks the cells a source covers and takes the bombs on them into the
+// next chain resolution
+void touchThreat(BotPlanner *planner, int slot) {
+  Threat *threat = &planner->threats[slot];
+  touchCell(planner, threat->position);
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    for (int k = 1; k <= threat->reach[d]; k++) {
+      touchCell(planner, StepPosition(threat->position, (Direction)d, k));
+    }
+  }
+}
+
+void touchCell(BotPlanner *planner, Position position) {
+  markCell(planner, position);
+  int bomb = findBombThreat(planner, position);
+  if (bomb >= 0) {
+    seedBomb(planner, bomb);
+  }
+}
+
+void seedBomb(BotPlanner *planner, int slot) {
+  Threat *threat = &planner->threats[slot];
+  if (threat->chainRound != planner->chainRound) {
+    threat->chainRound = planner->chainRound;
+    planner->seeds[planner->numSeeds++] = slot;
+  }
+}
+
+// A bomb goes off as soon as the fire of another source reaches it. Only
+// the seeded bombs and the bombs their fire reaches can start at another
+// time. Those start over from their fuse and settle in a queue.
+void resolveChains(BotPlanner *planner, Match *match) {
+  for (int i = 0; i < planner->numSeeds; i++) {
+    int slot = planner->seeds[i];
+    if (planner->threats[slot].direction == THREAT_BOMB) {
+      touchThreat(planner, slot);
+    }
+  }
+  int head = 0;
+  int count = 0;
+  for (int i = 0; i < planner->numSeeds; i++) {
+    Threat *bomb = &planner->threats[planner->seeds[i]];
+    if (bomb->direction == THREAT_BOMB) {
+      // A fire that reached the bomb and went out since set its fuse
+      int row = match->bombAt[GetCellIndex(match, bomb->position)];
+      bomb->fuse = row >= 0 ? match->bombs.endTime[row] : bomb->fuse;
+      bomb->start = bomb->fuse;
+      bomb->queued = 1;
+      planner->chain[count++] = planner->seeds[i];
+    }
+  }
+  while (count > 0) {
+    int slot = planner->chain[head];
+    head = (head + 1) % planner->capacity;
+    count--;
+    Threat *bomb = &planner->threats[slot];
+    bomb->queued = 0;
+    double arrive;
+    double leave;
+    if (!getCellWindow(planner, bomb->position, slot, &arrive, &leave) ||
+        arrive >= bomb->start) {
+      continue;
+    }
+    bomb->start = arrive;
+    for (int d = 0; d < _DIRECTION_NUM; d++) {
+      for (int k = 1; k <= bomb->reach[d]; k++) {
+        Position position = StepPosition(bomb->position, (Direction)d, k);
+        int other = findBombThreat(planner, position);
+        if (other >= 0 && !planner->threats[other].queued) {
+          planner->threats[other].queued = 1;
+          planner->chain[(head + count++) % planner->capacity] = other;
+        }
+      }
+    }
+  }
+}
+
+// First and last time fire burns position, from the sources in its row and
+// column up to the next wall or crate except skip. Returns 0 if none
+// reaches it.
+_Bool getCellWindow(BotPlanner *planner, Position position, int skip,
+                    double *arrive, double *leave) {
+  *arrive = DBL_MAX;
+  *leave = -DBL_MAX;
+  widenCellWindow(planner, position, position, skip, arrive, leave);
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    for (int k = 1; k <= planner->maxRadius; k++) {
+      Position source = StepPosition(position, (Direction)d, k);
+      if (BoardTest(&planner->blockers, source)) {
+        break;
+      }
+      widenCellWindow(planner, source, position, skip, arrive, leave);
+    }
+  }
+  return *leave != -DBL_MAX;
+}
+
+// Widens the window by the fire the sources on source bring to position
+void widenCellWindow(BotPlanner *planner, Position source, Position position,
+                     int skip, double *arrive, double *leave) {
+  int cell = source.y * planner->config.width + source.x;
+  for (int t = planner->threatAt[cell]; t >= 0;
+       t = planner->threats[t].next) {
+    double from;
+    double to;
+    if (t != skip &&
+        getFireWindow(&planner->threats[t], position, &from, &to)) {
+      *arrive = from < *arrive ? from : *arrive;
+      *leave = to > *leave ? to : *leave;
+    }
+  }
+}
+
+// Window in which threat burns position, returns 0 if it does not reach it
+_Bool getFireWindow(const Threat *threat, Position position, double *from,
+                    double *to) {
+  int dx = position.x - threat->position.x;
+  int dy = position.y - threat->position.y;
+  int k;
+  int last;
+  if (dx == 0 && dy == 0) {
+    // The source burns until the longest ray goes out
+    k = 0;
+    last = -1;
+    for (int d = 0; d < _DIRECTION_NUM; d++) {
+      if (threat->reach[d] > last) {
+        last = threat->reach[d];
+      }
+    }
+  } else if (dx == 0) {
+    k = abs(dy);
+    last = threat->reach[dy < 0 ? NORTH : SOUTH];
+  } else if (dy == 0) {
+    k = abs(dx);
+    last = threat->reach[dx > 0 ? EAST : WEST];
+  } else {
+    return 0;
+  }
+  if (k > last) {
+    return 0;
+  }
+  *from = threat->start + k * threat->step;
+  *to = threat->start + (last + 1) * threat->step;
+  return 1;
+}
+
+// Time the longest ray of a source goes out
+double getThreatEnd(const Threat *threat) {
+  double from;
+  double to;
+  if (!getFireWindow(threat, threat->position, &from, &to)) {
+    return threat->start;
+  }
+  return to;
+}
+
+void pushExpiry(BotPlanner *planner, double time, int threat) {
+  int i = planner->numExpiries++;
+  // Sift up
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (planner->expiries[parent].time <= time) {
+      break;
+    }
+    planner->expiries[i] = planner->expiries[parent];
+    i = parent;
+  }
+  planner->expiries[i] = (ThreatExpiry){time, threat};
+}
+
+ThreatExpiry popExpiry(BotPlanner *planner) {
+  ThreatExpiry *expiries = planner->expiries;
+  ThreatExpiry top = expiries[0];
+  ThreatExpiry last = expiries[--planner->numExpiries];
+  // Sift down
+  int i = 0;
+  while (1) {
+    int child = 2 * i + 1;
+    if (child >= planner->numExpiries) {
+      break;
+    }
+    if (child + 1 < planner->numExpiries &&
+        expiries[child + 1].time < expiries[child].time) {
+      child++;
+    }
+    if (last.time <= expiries[child].time) {
+      break;
+    }
+    expiries[i] = expiries[child];
+    i = child;
+  }
+  expiries[i] = last;
+  return top;
+}
+
+void markCell(BotPlanner *planner, Position position) {
+  int cell = position.y * planner->config.width + position.x;
+  if (planner->dirtyRound[cell] != planner->round) {
+    planner->dirtyRound[cell] = planner->round;
+    planner->dirty[planner->numDirty++] = cell;
+  }
+}
+
+void touchTile(BotPlanner *planner, Position position) {
+  int tile = (position.y >> GRID_TILE_SHIFT) * planner->tilesX +
+             (position.x >> GRID_TILE_SHIFT);
+  planner->tileVersion[tile] = planner->version;
+}
+
+void refreshDirtyCells(BotPlanner *planner) {
+  int width = planner->config.width;
+  for (int i = 0; i < planner->numDirty; i++) {
+    int cell = planner->dirty[i];
+    Position position = {cell % width, cell / width};
+    double arrive;
+    double leave;
+    getCellWindow(planner, position, -1, &arrive, &leave);
+    if (arrive != planner->arrive[cell] || leave != planner->leave[cell]) {
+      planner->arrive[cell] = arrive;
+      planner->leave[cell] = leave;
+      touchTile(planner, position);
+    }
+  }
+}
+
+// The last search of the bot if it still holds, a new one otherwise
+BotSearch *getSearch(BotPlanner *planner, Match *match, int player,
+                     double stepTime) {
+  BotSearch *found = &planner->searches[player];
+  Position start = match->players.position[player];
+  if (!isSearchValid(planner, found, start, stepTime, match->time)) {
+    search(planner, match, found, start, stepTime);
+  }
+  return found;
+}
+
+_Bool isSearchValid(BotPlanner *planner, BotSearch *found, Position start,
+                    double stepTime, double time) {
+  if (found->version < 0 || found->start.x != start.x ||
+      found->start.y != start.y || found->stepTime != stepTime ||
+      time >= found->validUntil) {
+    return 0;
+  }
+  for (int y = found->minTile.y; y <= found->maxTile.y; y++) {
+    for (int x = found->minTile.x; x <= found->maxTile.x; x++) {
+      if (planner->tileVersion[y * planner->tilesX + x] > found->version) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+// Breadth-first search from start over the cells without collision that do
+// not burn while the bot passes them. Fills the queue in order of distance
+// with depth and first step of every cell.
+void search(BotPlanner *planner, Match *match, BotSearch *found,
+            Position start, double stepTime) {
+  int width = planner->config.width;
+  int height = planner->config.height;
+  unsigned int round = ++planner->searchRound;
+  int cell = start.y * width + start.x;
+  planner->visited[cell] = round;
+  found->cells[0] = cell;
+  found->depth[0] = 0;
+  found->firstStep[0] = _DIRECTION_NUM;
+  int count = 1;
+  Position min = start;
+  Position max = start;
+  // Time until a cell looked at turns safe or unsafe
+  double lasts = DBL_MAX;
+  // Ties are broken in a different order every time
+  int rotation = botRand(planner) % _DIRECTION_NUM;
+  for (int head = 0; head < count; head++) {
+    int depth = found->depth[head] + 1;
+    if (depth > BOT_SEARCH_DEPTH) {
+      break;
+    }
+    cell = found->cells[head];
+    Position position = {cell % width, cell / width};
+    // On the cell from arriving until the next step is done
+    double from = match->time + depth * stepTime;
+    double to = from + stepTime;
+    for (int r = 0; r < _DIRECTION_NUM; r++) {
+      Direction direction = (Direction)((r + rotation) % _DIRECTION_NUM);
+      Position next = StepPosition(position, direction, 1);
+      if (next.x < 0 || next.y < 0 || next.x >= width || next.y >= height) {
+        continue;
+      }
+      int nextCell = next.y * width + next.x;
+      if (planner->visited[nextCell] == round) {
+        continue;
+      }
+      min.x = next.x < min.x ? next.x : min.x;
+      min.y = next.y < min.y ? next.y : min.y;
+      max.x = next.x > max.x ? next.x : max.x;
+      max.y = next.y > max.y ? next.y : max.y;
+      if (BoardTest(&planner->collision, next) ||
+          !isSafeAt(planner, nextCell, from, to, &lasts)) {
+        continue;
+      }
+      planner->visited[nextCell] = round;
+      found->cells[count] = nextCell;
+      found->depth[count] = depth;
+      found->firstStep[count] =
+          head == 0 ? direction : found->firstStep[head];
+      count++;
+    }
+  }
+  found->count = count;
+  found->start = start;
+  found->stepTime = stepTime;
+  found->version = planner->version;
+  found->validUntil = lasts == DBL_MAX ? DBL_MAX : match->time + lasts;
+  found->minTile = (Position){min.x >> GRID_TILE_SHIFT,
+                              min.y >> GRID_TILE_SHIFT};
+  found->maxTile = (Position){max.x >> GRID_TILE_SHIFT,
+                              max.y >> GRID_TILE_SHIFT};
+}
+
+// Whether the cell does not burn from from to to. Shortens lasts to the time
+// until that changes as both move on with the clock.
+_Bool isSafeAt(BotPlanner *planner, int cell, double from, double to,
+               double *lasts) {
+  double leave = planner->leave[cell] + BOT_MARGIN;
+  double arrive = planner->arrive[cell] - BOT_MARGIN;
+  if (leave < from) {
+    return 1;
+  }
+  if (arrive > to) {
+    *lasts = arrive - to < *lasts ? arrive - to : *lasts;
+    return 1;
+  }
+  *lasts = leave - from < *lasts ? leave - from : *lasts;
+  return 0;
+}
+
+// No fire reaches the cell after time
+_Bool isSafeToStay(BotPlanner *planner, int cell, double time) {
+  return planner->leave[cell] + BOT_MARGIN < time;
+}
+
+// A crate next to position or an enemy in reach of a bomb planted there
+_Bool isBombSpot(Match *match, int player, Position position) {
+  BoardLayers *layers = &match->layers;
+  int radius = match->players.blastRadius[player];
+  uint64_t self = (uint64_t)1 << player;
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    for (int k = 1; k <= radius; k++) {
+      Position cell = StepPosition(position, (Direction)d, k);
+      if (BoardTest(&layers->walls, cell)) {
+        break;
+      }
+      if (BoardTest(&layers->crates, cell)) {
+        if (k == 1) {
+          return 1;
+        }
+        break;
+      }
+      uint64_t others = match->playersAt[GetCellIndex(match, cell)] & ~self;
+      for (int i = 0; others; i++, others >>= 1) {
+        if ((others & 1) && match->players.isAlive[i]) {
+          return 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+// Whether a cell of the last search is out of reach of a bomb planted on
+// the bot's cell and reached before it goes off
+_Bool canEscape(BotPlanner *planner, Match *match, int player,
+                BotSearch *found, double stepTime) {
+  int width = planner->config.width;
+  Threat bomb;
+  bomb.position = match->players.position[player];
+  bomb.start = match->time + BOMB_FUSE_TIME;
+  traceBomb(planner, &bomb, match->players.blastRadius[player]);
+  for (int i = 1; i < found->count; i++) {
+    int cell = found->cells[i];
+    double arrival = match->time + found->depth[i] * stepTime;
+    if (arrival + BOT_MARGIN >= bomb.start) {
+      break;
+    }
+    Position position = {cell % width, cell / width};
+    double from;
+    double to;
+    if (!getFireWindow(&bomb, position, &from, &to) &&
+        isSafeToStay(planner, cell, arrival)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Living player closest to player or -1
+int getNearestEnemy(Match *match, int player) {
+  PlayerTable *players = &match->players;
+  int enemy = -1;
+  int enemyDistance = 0;
+  for (int i = 0; i < match->config.players; i++) {
+    if (i == player || !players->isAlive[i]) {
+      continue;
+    }
+    int distance = getDistance(players->position[player],
+                               players->position[i]);
+    if (enemy < 0 || distance < enemyDistance) {
+      enemy = i;
+      enemyDistance = distance;
+    }
+  }
+  return enemy;
+}
+
+int getDistance(Position a, Position b) {
+  return abs(a.x - b.x) + abs(a.y - b.y);
+}
+
+unsigned int botRand(BotPlanner *planner) {
+  // xorshift32
+  unsigned int x = planner->rngState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  planner->rngState = x;
+  return x;
+}
@@ -0,0 +1,46 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "record.h"
+#include "sim.h"
+
+// Computer players. One planner serves every bot of a match and keeps two
+// structures in step with it between ticks:
+//
+// - a danger map with the window in which each cell burns, from the live
+//   bombs (endTime, the owner's blastRadius and chain reactions) and the
+//   explosions under way. Fire sources are kept across ticks and follow the
+//   match: bombs planted and gone off and crates broken from the journal,
+//   power-ups and kills from the player table, rays burning out from their
+//   own clock. Only the cells of sources that changed and the bombs their
+//   fire reaches are recomputed.
+// - the board the bots search, the cells a player collides with, patched
+//   from the journal of cells the match changed.
+//
+// A bot plans only while it stands, which is when MovePlayer takes a move.
+// It runs a breadth-first search from its cell that skips cells burning
+// while it would pass them, and keeps it while it waits and nothing it
+// looked at changed. In danger it walks to the nearest cell no fire
+// reaches, otherwise it plants next to crates and enemies if it can still
+// get away from its own bomb, or walks to the nearest power-up or place
+// worth a bomb.
+
+// Cells a bot looks ahead
+#define BOT_SEARCH_DEPTH 24
+
+typedef struct BotPlanner BotPlanner;
+
+// The planner is bound to the config of match
+BotPlanner *CreateBotPlanner(Match *match);
+void FreeBotPlanner(BotPlanner *planner);
+
+// Catches up with the match, call it every tick before planning. After a
+// restore or if the journal ran over the planner rebuilds from scratch.
+// Built with make BOT_CHECK=1 it compares the danger map with a rebuild
+// and logs every cell that differs.
+void UpdateBotPlanner(BotPlanner *planner, Match *match);
+
+// Returns 1 and the command if the bot playing player acts this tick
+_Bool PlanBotCommand(BotPlanner *planner, Match *match, int player,
+                     Command *command);
+#endif // BOT_H
@@ -0,0 +1,18 @@
+#define _POSIX_C_SOURCE 200809L
+#include "clock.h"
+#include <time.h>
+
+double GetWallTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void SleepUntil(double time) {
+  double delay = time - GetWallTime();
+  if (delay <= 0) {
+    return;
+  }
+  struct timespec ts = {(time_t)delay, (long)((delay - (long)delay) * 1e9)};
+  nanosleep(&ts, NULL);
+}
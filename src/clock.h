@@ -0,0 +1,10 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+// Wall clock of the headless tools, which cannot use raylib's GetTime
+
+// Monotonic seconds
+double GetWallTime();
+// Returns at once if time has passed
+void SleepUntil(double time);
+#endif // CLOCK_H
@@ -0,0 +1,708 @@
+#include "delta.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Bit stream, least significant bit first:
+//   tick       1 bit relative, then the gamma delta to the base or 32 bits
+//   players    per player 1 bit changed, then 1 bit for a progress only
+//              change and the progress, or else every field
+//   cells      1 bit changed, then per cell the gamma gap to the previous
+//              one and the type, closed by the gap to the end of the grid
+//   bombs      per record 1 bit, the gamma gap in cells, 1 bit spawn and
+//              the owner of a spawn, closed by a 0 bit
+//   explosions per record 1 bit, the gamma gap in keys, 1 bit set, and for
+//              a set 1 bit new, the radius if new and the front
+// Gamma is the Elias gamma code of value + 1, so small numbers are short.
+
+#define CELL_TYPE_BITS 3
+#define STATE_BITS 2
+#define FACING_BITS 2
+// Target relative to the position: the same cell, one of the four
+// neighbours or an escape followed by coordinates
+#define TARGET_BITS 3
+#define TARGET_SAME 0
+#define TARGET_ESCAPE 7
+
+_Static_assert(_PLAYER_STATE_NUM <= 1 << STATE_BITS, "STATE_BITS too small");
+_Static_assert(_DIRECTION_NUM <= 1 << FACING_BITS, "FACING_BITS too small");
+_Static_assert(CELL_POWERUP < 1 << CELL_TYPE_BITS, "CELL_TYPE_BITS too small");
+
+typedef struct {
+  uint8_t *data;
+  int size;
+  int length;
+  uint64_t bits;
+  int count;
+  _Bool overflow;
+} BitWriter;
+
+typedef struct {
+  const uint8_t *data;
+  int length;
+  int offset;
+  uint64_t bits;
+  int count;
+  _Bool overflow;
+} BitReader;
+
+static const int stepX[_DIRECTION_NUM] = {0, 1, 0, -1};
+static const int stepY[_DIRECTION_NUM] = {-1, 0, 1, 0};
+
+void sortBombs(StateView *view);
+void sortExplosions(StateView *view);
+uint8_t clampByte(int value);
+int bitsFor(int values);
+int targetCode(const PlayerView *player);
+uint8_t emptyCell(const MatchConfig *config, int index);
+int nextChangedCell(const StateView *base, const StateView *view, int index);
+
+void putBits(BitWriter *writer, uint32_t value, int n);
+void putGamma(BitWriter *writer, uint32_t value);
+int finishBits(BitWriter *writer);
+uint32_t getBits(BitReader *reader, int n);
+uint32_t getGamma(BitReader *reader);
+
+void encodePlayers(BitWriter *writer, const StateView *base,
+                   const StateView *view);
+void encodeCells(BitWriter *writer, const StateView *base,
+                 const StateView *view);
+void encodeBombs(BitWriter *writer, const StateView *base,
+                 const StateView *view);
+void encodeExplosions(BitWriter *writer, const StateView *base,
+                      const StateView *view);
+_Bool decodePlayers(BitReader *reader, const StateView *base,
+                    StateView *view);
+_Bool decodeCells(BitReader *reader, const StateView *base, StateView *view);
+_Bool decodeBombs(BitReader *reader, const StateView *base, StateView *view);
+_Bool decodeExplosions(BitReader *reader, const StateView *base,
+                       StateView *view);
+
+StateView *CreateStateView(MatchConfig config) {
+  int bombs = config.players * MAX_PLAYER_BOMBS;
+  int explosions = bombs * _DIRECTION_NUM;
+  int cells = config.width * config.height;
+  // Columns with the strictest alignment first
+  size_t size = sizeof(StateView) + sizeof(BombView) * bombs +
+                sizeof(ExplosionView) * explosions +
+                sizeof(PlayerView) * config.players + cells;
+  char *base = (char *)malloc(size);
+  if (base == NULL) {
+    LOG_ERROR("Allocation of state view failed!", NULL);
+    return NULL;
+  }
+  StateView *view = (StateView *)base;
+  *view = (StateView){.config = config,
+                      .bombCapacity = bombs,
+                      .explosionCapacity = explosions};
+  view->bombs = (BombView *)(base + sizeof(StateView));
+  view->explosions = (ExplosionView *)(view->bombs + bombs);
+  view->players = (PlayerView *)(view->explosions + explosions);
+  view->cells = (uint8_t *)(view->players + config.players);
+  ClearStateView(view);
+  return view;
+}
+
+void FreeStateView(StateView *view) { free(view); }
+
+void ClearStateView(StateView *view) {
+  view->tick = 0;
+  view->numBombs = 0;
+  view->numExplosions = 0;
+  memset(view->players, 0, sizeof(PlayerView) * view->config.players);
+  for (int i = 0; i < view->config.width * view->config.height; i++) {
+    view->cells[i] = emptyCell(&view->config, i);
+  }
+}
+
+// The view must have the config of the match
+void CaptureStateView(StateView *view, Match *match) {
+  MatchConfig *config = &view->config;
+  PlayerTable *players = &match->players;
+  int maxProgress = (1 << VIEW_PROGRESS_BITS) - 1;
+  view->tick = match->tick;
+  for (int i = 0; i < config->players; i++) {
+    float progress = players->progress[i];
+    progress = progress < 0 ? 0 : progress > 1 ? 1 : progress;
+    view->players[i] = (PlayerView){
+        .x = players->position[i].x,
+        .y = players->position[i].y,
+        .targetX = players->targetPosition[i].x,
+        .targetY = players->targetPosition[i].y,
+        .progress = (uint8_t)(progress * maxProgress + 0.5f),
+        .facing = players->facing[i],
+        .state = players->state[i],
+        .isAlive = players->isAlive[i],
+        .bombs = clampByte(players->bombs[i]),
+        .blastRadius = clampByte(players->blastRadius[i]),
+    };
+  }
+  uint8_t *cell = view->cells;
+  for (int y = 0; y < config->height; y++) {
+    for (int x = 0; x < config->width; x++) {
+      *cell++ = match->grid[GetCellIndex(match, (Position){x, y})].type;
+    }
+  }
+
+  BombTable *bombs = &match->bombs;
+  view->numBombs = 0;
+  for (int i = 0; i < bombs->count; i++) {
+    if (bombs->endTime[i] != 0) {
+      Position position = bombs->position[i];
+      view->bombs[view->numBombs++] =
+          (BombView){position.y * config->width + position.x, bombs->owner[i]};
+    }
+  }
+  sortBombs(view);
+
+  ExplosionTable *explosions = &match->explosions;
+  for (int i = 0; i < explosions->count; i++) {
+    Position position = explosions->position[i];
+    int cell = position.y * config->width + position.x;
+    view->explosions[i] = (ExplosionView){
+        cell * _DIRECTION_NUM + explosions->direction[i],
+        clampByte(explosions->radius[i]), clampByte(explosions->front[i])};
+  }
+  view->numExplosions = explosions->count;
+  sortExplosions(view);
+}
+
+_Bool EqualStateViews(const StateView *a, const StateView *b) {
+  if (memcmp(&a->config, &b->config, sizeof(MatchConfig)) != 0 ||
+      a->tick != b->tick || a->numBombs != b->numBombs ||
+      a->numExplosions != b->numExplosions) {
+    return 0;
+  }
+  if (memcmp(a->players, b->players,
+             sizeof(PlayerView) * a->config.players) != 0 ||
+      memcmp(a->cells, b->cells, a->config.width * a->config.height) != 0) {
+    return 0;
+  }
+  for (int i = 0; i < a->numBombs; i++) {
+    if (a->bombs[i].cell != b->bombs[i].cell ||
+        a->bombs[i].owner != b->bombs[i].owner) {
+      return 0;
+    }
+  }
+  for (int i = 0; i < a->numExplosions; i++) {
+    ExplosionView *x = &a->explosions[i];
+    ExplosionView *y = &b->explosions[i];
+    if (x->key != y->key || x->radius != y->radius || x->front != y->front) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int EncodeStateDelta(const StateView *base, const StateView *view,
+                     uint8_t *data, int size) {
+  BitWriter writer = {data, size};
+  if (base != NULL && view->tick >= base->tick &&
+      view->tick - base->tick < UINT32_MAX) {
+    putBits(&writer, 1, 1);
+    putGamma(&writer, view->tick - base->tick);
+  } else {
+    putBits(&writer, 0, 1);
+    putBits(&writer, view->tick, 32);
+  }
+  encodePlayers(&writer, base, view);
+  encodeCells(&writer, base, view);
+  encodeBombs(&writer, base, view);
+  encodeExplosions(&writer, base, view);
+  return finishBits(&writer);
+}
+
+_Bool DecodeStateDelta(const StateView *base, StateView *view,
+                       const uint8_t *data, int length) {
+  if (base != NULL &&
+      memcmp(&base->config, &view->config, sizeof(MatchConfig)) != 0) {
+    return 0;
+  }
+  BitReader reader = {data, length};
+  if (getBits(&reader, 1)) {
+    if (base == NULL) {
+      return 0;
+    }
+    view->tick = base->tick + getGamma(&reader);
+  } else {
+    view->tick = getBits(&reader, 32);
+  }
+  return decodePlayers(&reader, base, view) &&
+         decodeCells(&reader, base, view) &&
+         decodeBombs(&reader, base, view) &&
+         decodeExplosions(&reader, base, view) && !reader.overflow;
+}
+
+// Insertion sort, the tables are short and mostly in order already
+void sortBombs(StateView *view) {
+  for (int i = 1; i < view->numBombs; i++) {
+    BombView bomb = view->bombs[i];
+    int j = i;
+    for (; j > 0 && view->bombs[j - 1].cell > bomb.cell; j--) {
+      view->bombs[j] = view->bombs[j - 1];
+    }
+    view->bombs[j] = bomb;
+  }
+}
+
+// A bomb planted where the rays of the last one still burn may repeat a
+// key, only the first ray of a key is kept
+void sortExplosions(StateView *view) {
+  ExplosionView *explosions = view->explosions;
+  for (int i = 1; i < view->numExplosions; i++) {
+    ExplosionView explosion = explosions[i];
+    int j = i;
+    for (; j > 0 && explosions[j - 1].key > explosion.key; j--) {
+      explosions[j] = explosions[j - 1];
+    }
+    explosions[j] = explosion;
+  }
+  int n = 0;
+  for (int i = 0; i < view->numExplosions; i++) {
+    if (n == 0 || explosions[n - 1].key != explosions[i].key) {
+      explosions[n++] = explosions[i];
+    }
+  }
+  view->numExplosions = n;
+}
+
+uint8_t clampByte(int value) {
+  return value < 0 ? 0 : value > UINT8_MAX ? UINT8_MAX : value;
+}
+
+// Bits to store 0 to values - 1
+int bitsFor(int values) {
+  return values <= 1 ? 0 : 32 - __builtin_clz((unsigned int)values - 1);
+}
+
+int targetCode(const PlayerView *player) {
+  int dx = player->targetX - player->x;
+  int dy = player->targetY - player->y;
+  if (dx == 0 && dy == 0) {
+    return TARGET_SAME;
+  }
+  for (int i = 0; i < _DIRECTION_NUM; i++) {
+    if (dx == stepX[i] && dy == stepY[i]) {
+      return i + 1;
+    }
+  }
+  return TARGET_ESCAPE;
+}
+
+// The walls of every map: the border and the cells with even coordinates
+uint8_t emptyCell(const MatchConfig *config, int index) {
+  int x = index % config->width;
+  int y = index / config->width;
+  _Bool border = x == 0 || y == 0 || x == config->width - 1 ||
+                 y == config->height - 1;
+  return border || (x % 2 == 0 && y % 2 == 0) ? CELL_SOLID_WALL : CELL_EMPTY;
+}
+
+// First cell from index on that changed, the cell count if there is none.
+// Runs of equal cells are skipped a word at a time.
+int nextChangedCell(const StateView *base, const StateView *view, int index) {
+  int numCells = view->config.width * view->config.height;
+  const uint8_t *to = view->cells;
+  if (base == NULL) {
+    while (index < numCells && emptyCell(&view->config, index) == to[index]) {
+      index++;
+    }
+    return index;
+  }
+  const uint8_t *from = base->cells;
+  for (; index + 8 <= numCells; index += 8) {
+    uint64_t a;
+    uint64_t b;
+    memcpy(&a, from + index, 8);
+    memcpy(&b, to + index, 8);
+    if (a != b) {
+      break;
+    }
+  }
+  while (index < numCells && from[index] == to[index]) {
+    index++;
+  }
+  return index;
+}
+
+void putBits(BitWriter *writer, uint32_t value, int n) {
+  if (n == 0) {
+    return;
+  }
+  writer->bits |= ((uint64_t)value & ((1ull << n) - 1)) << writer->count;
+  writer->count += n;
+  while (writer->count >= 8) {
+    if (writer->length < writer->size) {
+      writer->data[writer->length++] = (uint8_t)writer->bits;
+    } else {
+      writer->overflow = 1;
+    }
+    writer->bits >>= 8;
+    writer->count -= 8;
+  }
+}
+
+void putGamma(BitWriter *writer, uint32_t value) {
+  uint32_t x = value + 1;
+  int n = 32 - __builtin_clz(x);
+  // n - 1 zeros and a one, then the bits below the leading one
+  putBits(writer, 1u << (n - 1), n);
+  putBits(writer, x, n - 1);
+}
+
+int finishBits(BitWriter *writer) {
+  if (writer->count > 0) {
+    putBits(writer, 0, 8 - writer->count);
+  }
+  return writer->overflow ? -1 : writer->length;
+}
+
+uint32_t getBits(BitReader *reader, int n) {
+  while (reader->count < n) {
+    if (reader->offset == reader->length) {
+      reader->overflow = 1;
+      return 0;
+    }
+    reader->bits |= (uint64_t)reader->data[reader->offset++] << reader->count;
+    reader->count += 8;
+  }
+  uint32_t value = reader->bits & ((1ull << n) - 1);
+  reader->bits >>= n;
+  reader->count -= n;
+  return value;
+}
+
+uint32_t getGamma(BitReader *reader) {
+  int zeros = 0;
+  while (getBits(reader, 1) == 0) {
+    if (reader->overflow || ++zeros > 31) {
+      reader->overflow = 1;
+      return 0;
+    }
+  }
+  return ((1u << zeros) | getBits(reader, zeros)) - 1;
+}
+
+void encodePlayers(BitWriter *writer, const StateView *base,
+                   const StateView *view) {
+  static const PlayerView empty;
+  int xBits = bitsFor(view->config.width);
+  int yBits = bitsFor(view->config.height);
+  for (int i = 0; i < view->config.players; i++) {
+    const PlayerView *from = base != NULL ? &base->players[i] : &empty;
+    const PlayerView *to = &view->players[i];
+    if (memcmp(from, to, sizeof(PlayerView)) == 0) {
+      putBits(writer, 0, 1);
+      continue;
+    }
+    putBits(writer, 1, 1);
+    // Walking players change nothing but their progress most ticks
+    PlayerView walked = *from;
+    walked.progress = to->progress;
+    if (memcmp(&walked, to, sizeof(PlayerView)) == 0) {
+      putBits(writer, 1, 1);
+      putBits(writer, to->progress, VIEW_PROGRESS_BITS);
+      continue;
+    }
+    putBits(writer, 0, 1);
+    putBits(writer, to->isAlive, 1);
+    putBits(writer, to->state, STATE_BITS);
+    putBits(writer, to->facing, FACING_BITS);
+    putBits(writer, to->x, xBits);
+    putBits(writer, to->y, yBits);
+    int target = targetCode(to);
+    putBits(writer, target, TARGET_BITS);
+    if (target == TARGET_ESCAPE) {
+      putBits(writer, to->targetX, xBits);
+      putBits(writer, to->targetY, yBits);
+    }
+    putBits(writer, to->progress, VIEW_PROGRESS_BITS);
+    putGamma(writer, to->bombs);
+    putGamma(writer, to->blastRadius);
+  }
+}
+
+void encodeCells(BitWriter *writer, const StateView *base,
+                 const StateView *view) {
+  int numCells = view->config.width * view->config.height;
+  int index = nextChangedCell(base, view, 0);
+  if (index == numCells) {
+    putBits(writer, 0, 1);
+    return;
+  }
+  putBits(writer, 1, 1);
+  int last = -1;
+  while (index < numCells) {
+    putGamma(writer, index - last - 1);
+    putBits(writer, view->cells[index], CELL_TYPE_BITS);
+    last = index;
+    index = nextChangedCell(base, view, index + 1);
+  }
+  putGamma(writer, numCells - last - 1);
+}
+
+// Merges the sorted bombs of both views into records
+void encodeBombs(BitWriter *writer, const StateView *base,
+                 const StateView *view) {
+  int ownerBits = bitsFor(view->config.players);
+  int numBase = base != NULL ? base->numBombs : 0;
+  int i = 0;
+  int j = 0;
+  int last = -1;
+  while (i < numBase || j < view->numBombs) {
+    const BombView *from = i < numBase ? &base->bombs[i] : NULL;
+    const BombView *to = j < view->numBombs ? &view->bombs[j] : NULL;
+    int cell;
+    _Bool spawn;
+    if (to == NULL || (from != NULL && from->cell < to->cell)) {
+      cell = from->cell;
+      spawn = 0;
+      i++;
+    } else if (from == NULL || to->cell < from->cell) {
+      cell = to->cell;
+      spawn = 1;
+      j++;
+    } else {
+      i++;
+      j++;
+      if (from->owner == to->owner) {
+        continue;
+      }
+      // A spawn on a cell replaces the bomb there
+      cell = to->cell;
+      spawn = 1;
+    }
+    putBits(writer, 1, 1);
+    putGamma(writer, cell - last - 1);
+    putBits(writer, spawn, 1);
+    if (spawn) {
+      putBits(writer, to->owner, ownerBits);
+    }
+    last = cell;
+  }
+  putBits(writer, 0, 1);
+}
+
+void encodeExplosions(BitWriter *writer, const StateView *base,
+                      const StateView *view) {
+  int numBase = base != NULL ? base->numExplosions : 0;
+  int i = 0;
+  int j = 0;
+  int last = -1;
+  while (i < numBase || j < view->numExplosions) {
+    const ExplosionView *from = i < numBase ? &base->explosions[i] : NULL;
+    const ExplosionView *to =
+        j < view->numExplosions ? &view->explosions[j] : NULL;
+    int key;
+    if (to == NULL || (from != NULL && from->key < to->key)) {
+      key = from->key;
+      to = NULL;
+      i++;
+    } else if (from == NULL || to->key < from->key) {
+      key = to->key;
+      from = NULL;
+      j++;
+    } else {
+      i++;
+      j++;
+      if (from->radius == to->radius && from->front == to->front) {
+        continue;
+      }
+      key = to->key;
+    }
+    putBits(writer, 1, 1);
+    putGamma(writer, key - last - 1);
+    last = key;
+    putBits(writer, to != NULL, 1);
+    if (to == NULL) {
+      continue;
+    }
+    _Bool isNew = from == NULL || from->radius != to->radius;
+    putBits(writer, isNew, 1);
+    if (isNew) {
+      putGamma(writer, to->radius);
+    }
+    putGamma(writer, to->front);
+  }
+  putBits(writer, 0, 1);
+}
+
+_Bool decodePlayers(BitReader *reader, const StateView *base,
+                    StateView *view) {
+  MatchConfig *config = &view->config;
+  int xBits = bitsFor(config->width);
+  int yBits = bitsFor(config->height);
+  for (int i = 0; i < config->players; i++) {
+    PlayerView *to = &view->players[i];
+    *to = base != NULL ? base->players[i] : (PlayerView){0};
+    if (!getBits(reader, 1)) {
+      continue;
+    }
+    if (getBits(reader, 1)) {
+      to->progress = getBits(reader, VIEW_PROGRESS_BITS);
+      continue;
+    }
+    to->isAlive = getBits(reader, 1);
+    to->state = getBits(reader, STATE_BITS);
+    to->facing = getBits(reader, FACING_BITS);
+    to->x = getBits(reader, xBits);
+    to->y = getBits(reader, yBits);
+    int target = getBits(reader, TARGET_BITS);
+    if (target == TARGET_ESCAPE) {
+      to->targetX = getBits(reader, xBits);
+      to->targetY = getBits(reader, yBits);
+    } else if (target == TARGET_SAME) {
+      to->targetX = to->x;
+      to->targetY = to->y;
+    } else if (target <= _DIRECTION_NUM) {
+      to->targetX = to->x + stepX[target - 1];
+      to->targetY = to->y + stepY[target - 1];
+    } else {
+      return 0;
+    }
+    to->progress = getBits(reader, VIEW_PROGRESS_BITS);
+    uint32_t bombs = getGamma(reader);
+    uint32_t blastRadius = getGamma(reader);
+    if (bombs > UINT8_MAX || blastRadius > UINT8_MAX ||
+        to->state >= _PLAYER_STATE_NUM || to->x >= config->width ||
+        to->y >= config->height || to->targetX >= config->width ||
+        to->targetY >= config->height) {
+      return 0;
+    }
+    to->bombs = bombs;
+    to->blastRadius = blastRadius;
+  }
+  return !reader->overflow;
+}
+
+_Bool decodeCells(BitReader *reader, const StateView *base, StateView *view) {
+  int numCells = view->config.width * view->config.height;
+  if (base != NULL) {
+    memcpy(view->cells, base->cells, numCells);
+  } else {
+    for (int i = 0; i < numCells; i++) {
+      view->cells[i] = emptyCell(&view->config, i);
+    }
+  }
+  if (!getBits(reader, 1)) {
+    return !reader->overflow;
+  }
+  int last = -1;
+  while (!reader->overflow) {
+    uint32_t gap = getGamma(reader);
+    if (gap > (uint32_t)(numCells - last - 1)) {
+      return 0;
+    }
+    int index = last + 1 + gap;
+    if (index == numCells) {
+      return 1;
+    }
+    uint8_t type = getBits(reader, CELL_TYPE_BITS);
+    if (type > CELL_POWERUP) {
+      return 0;
+    }
+    view->cells[index] = type;
+    last = index;
+  }
+  return 0;
+}
+
+// Merges the records into the sorted bombs of the base
+_Bool decodeBombs(BitReader *reader, const StateView *base, StateView *view) {
+  int ownerBits = bitsFor(view->config.players);
+  int numCells = view->config.width * view->config.height;
+  int numBase = base != NULL ? base->numBombs : 0;
+  int i = 0;
+  int n = 0;
+  int last = -1;
+  while (getBits(reader, 1)) {
+    uint32_t gap = getGamma(reader);
+    if (reader->overflow || gap >= (uint32_t)(numCells - last - 1)) {
+      return 0;
+    }
+    int cell = last + 1 + gap;
+    last = cell;
+    _Bool spawn = getBits(reader, 1);
+    for (; i < numBase && base->bombs[i].cell < cell; i++) {
+      if (n == view->bombCapacity) {
+        return 0;
+      }
+      view->bombs[n++] = base->bombs[i];
+    }
+    if (i < numBase && base->bombs[i].cell == cell) {
+      i++;
+    } else if (!spawn) {
+      return 0;
+    }
+    if (spawn) {
+      uint8_t owner = getBits(reader, ownerBits);
+      if (owner >= view->config.players || n == view->bombCapacity) {
+        return 0;
+      }
+      view->bombs[n++] = (BombView){cell, owner};
+    }
+  }
+  for (; i < numBase; i++) {
+    if (n == view->bombCapacity) {
+      return 0;
+    }
+    view->bombs[n++] = base->bombs[i];
+  }
+  view->numBombs = n;
+  return !reader->overflow;
+}
+
+_Bool decodeExplosions(BitReader *reader, const StateView *base,
+                       StateView *view) {
+  int numKeys = view->config.width * view->config.height * _DIRECTION_NUM;
+  int numBase = base != NULL ? base->numExplosions : 0;
+  int i = 0;
+  int n = 0;
+  int last = -1;
+  while (getBits(reader, 1)) {
+    uint32_t gap = getGamma(reader);
+    if (reader->overflow || gap >= (uint32_t)(numKeys - last - 1)) {
+      return 0;
+    }
+    int key = last + 1 + gap;
+    last = key;
+    for (; i < numBase && base->explosions[i].key < key; i++) {
+      if (n == view->explosionCapacity) {
+        return 0;
+      }
+      view->explosions[n++] = base->explosions[i];
+    }
+    const ExplosionView *from = NULL;
+    if (i < numBase && base->explosions[i].key == key) {
+      from = &base->explosions[i++];
+    }
+    if (!getBits(reader, 1)) {
+      if (from == NULL) {
+        return 0;
+      }
+      continue;
+    }
+    uint32_t radius;
+    if (getBits(reader, 1)) {
+      radius = getGamma(reader);
+    } else if (from != NULL) {
+      radius = from->radius;
+    } else {
+      return 0;
+    }
+    uint32_t front = getGamma(reader);
+    if (radius > UINT8_MAX || front > UINT8_MAX ||
+        n == view->explosionCapacity) {
+      return 0;
+    }
+    view->explosions[n++] = (ExplosionView){key, radius, front};
+  }
+  for (; i < numBase; i++) {
+    if (n == view->explosionCapacity) {
+      return 0;
+    }
+    view->explosions[n++] = base->explosions[i];
+  }
+  view->numExplosions = n;
+  return !reader->overflow;
+}
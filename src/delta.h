@@ -0,0 +1,78 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "sim.h"
+
+// Delta compressed match state for clients and spectators. A StateView is
+// what a client sees of a match: cell types, players with their walk
+// progress quantized, the bombs on the board and the explosion rays. The
+// server keeps the views it sent and encodes the next one against the view
+// a client acknowledged last, the client decodes against its copy of it.
+//
+// The encoding is a bit stream. Changed cells are sent as the gaps between
+// their indices, bombs and explosions as spawn and despawn records sorted by
+// their cell, players only with the fields that changed.
+
+#define VIEW_PROGRESS_BITS 5
+
+typedef struct {
+  uint8_t x;
+  uint8_t y;
+  uint8_t targetX;
+  uint8_t targetY;
+  // Walk progress in steps of 1 / ((1 << VIEW_PROGRESS_BITS) - 1)
+  uint8_t progress;
+  uint8_t facing;
+  uint8_t state;
+  uint8_t isAlive;
+  uint8_t bombs;
+  uint8_t blastRadius;
+} PlayerView;
+
+// Only bombs that have not detonated yet
+typedef struct {
+  // Cell index y * width + x
+  int cell;
+  uint8_t owner;
+} BombView;
+
+// One ray of a detonated bomb
+typedef struct {
+  // Cell index of the bomb times four plus the direction
+  int key;
+  uint8_t radius;
+  uint8_t front;
+} ExplosionView;
+
+// A view is a single allocation like a match. Bombs and explosions are
+// sorted by cell and key.
+typedef struct {
+  MatchConfig config;
+  long tick;
+  int numBombs;
+  int numExplosions;
+  int bombCapacity;
+  int explosionCapacity;
+  PlayerView *players;
+  BombView *bombs;
+  ExplosionView *explosions;
+  // CellType per cell, row by row
+  uint8_t *cells;
+} StateView;
+
+StateView *CreateStateView(MatchConfig config);
+void FreeStateView(StateView *view);
+// The empty view every client starts from, a map with nothing but walls
+void ClearStateView(StateView *view);
+void CaptureStateView(StateView *view, Match *match);
+_Bool EqualStateViews(const StateView *a, const StateView *b);
+
+// Encodes view against base, NULL is the empty view. Returns the length or
+// -1 if it does not fit into size bytes.
+int EncodeStateDelta(const StateView *base, const StateView *view,
+                     uint8_t *data, int size);
+// Decodes into view, which must differ from base and have its config.
+// Returns 0 for malformed data.
+_Bool DecodeStateDelta(const StateView *base, StateView *view,
+                       const uint8_t *data, int length);
+#endif // DELTA_H
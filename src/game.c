@@ -1,11 +1,26 @@
 #include "game.h"
 #include "input.h"
 #include "log.h"
+#include "pool.h"
+#include "profiler.h"
 #include "renderer.h"
+#include <math.h>
 #include <raylib.h>
 #include <stdio.h>
 #include <stdlib.h>
-Game *game;
+#include <string.h>
+#include <time.h>
+
+// Upper bound of simulation ticks run per rendered frame. A frame that took
+// longer drops the remaining backlog so the game slows down instead of
+// spiralling into ever longer catch-up frames.
+#define MAX_CATCHUP_TICKS 5
+// Ticks the decided match keeps running so the last death animation plays.
+// Longer than a rollback, so peers agree on the tick the match ends.
+#define MATCH_END_TICKS (3 * TICK_RATE)
+_Static_assert(MATCH_END_TICKS > NET_MAX_ROLLBACK,
+               "match may end before its result is confirmed");
+
 // Game state functions
 void mainMenuState(Game *game);
 void charSelectMenuState(Game *game);
@@ -14,34 +29,23 @@ void runningState(Game *game);
 void pauseState(Game *game);
 void exitState(Game *game);
 
-// Grid functions
-void initGrid(Cell grid[GRID_WIDTH][GRID_HEIGHT]);
-_Bool isSolidWall(Position position);
-_Bool isSpawnProtected(Position position);
-Position getSpawn(int id);
-void updateCell(Position position, CellType cellType);
-_Bool isCollision(Position next);
-
-// Position functions
-_Bool isEqPos(Position p1, Position p2);
-
-// Player functions
-Player *initPlayer(int id);
-
-// Bomb
-void createExplosion(Bomb *bomb, int blastRadius);
-Bomb *getBomb(Position pos);
-
-// Destructible
-void breakDestructibel(Position pos);
-
-// Items
-void checkPlayerOnPowerUp(Player *player);
-void collectPowerUp(Position pos, Player *player);
+// Profiler zone of each state function, indexed by GameStateType
+static const char *stateZones[] = {
+    "mainMenuState", "charSelectMenuState", "runningCountdownState",
+    "runningState",  "pauseState",          "exitState",
+};
+void stepMatch(Game *game);
+void playBots(Game *game);
+void applyInputs(Game *game);
+void createBots(Game *game);
+void freeBots(Game *game);
+_Bool connectMatch(Game *game);
+void endMatch(Game *game);
+void saveRecording(Game *game);
 
 Game *InitGame() {
   // Initialize core game
-  game = (Game *)malloc(sizeof(Game));
+  Game *game = (Game *)malloc(sizeof(Game));
   if (game == NULL) {
     LOG_ERROR("Allocation of game failed!", NULL);
   }
@@ -56,6 +60,8 @@ Game *InitGame() {
   game->mainMenu = mainMenu;
   game->mainMenu->options[0] = "Neues Spiel";
   game->mainMenu->options[1] = "Beenden";
+  game->mainMenu->selectedOption = 0;
+  game->mainMenu->next = 0;
   // Initialize pause menu
   PauseMenu *pauseMenu = (PauseMenu *)malloc(sizeof(PauseMenu));
   if (pauseMenu == NULL) {
@@ -63,6 +69,7 @@ Game *InitGame() {
   }
   game->pauseMenu = pauseMenu;
   game->pauseMenu->title = "Pause";
+  game->pauseMenu->isActive = 0;
   // Initialize character select menu
   CharSelectMenu *charSelectMenu =
       (CharSelectMenu *)malloc(sizeof(CharSelectMenu));
@@ -71,396 +78,73 @@ Game *InitGame() {
   }
   game->charSelectMenu = charSelectMenu;
   game->charSelectMenu->title = "Wähle deinen Character";
-  // Countdown
-  game->countdown = 3;
-  // Initialize grid
-  initGrid(game->grid);
-  // Initialize players
-  for (int i = 0; i < MAX_PLAYERS; i++) {
-    game->player[i] = initPlayer(i);
-  }
-  return game;
-}
-
-void initGrid(Cell grid[GRID_WIDTH][GRID_HEIGHT]) {
-  for (int x = 0; x < GRID_WIDTH; x++) {
-    for (int y = 0; y < GRID_HEIGHT; y++) {
-      Position position = {x, y};
-      if (isSolidWall(position)) {
-        updateCell(position, CELL_SOLID_WALL);
-      } else if (isSpawnProtected(position)) {
-        updateCell(position, CELL_EMPTY);
-      } else {
-        // 80% Chance to create a destructible
-        if (rand() % 10 <= 7) {
-          updateCell(position, CELL_DESTRUCTIBLE);
-        }
-      }
-    };
-  };
-}
-
-_Bool isSolidWall(Position position) {
-  if (position.x == 0) {
-    return 1;
-  } else if (position.x == GRID_WIDTH - 1) {
-    return 1;
-  }
-  if (position.y == 0) {
-    return 1;
-  } else if (position.y == GRID_HEIGHT - 1) {
-    return 1;
-  }
-  if (position.x % 2 == 0 && position.y % 2 == 0) {
-    return 1;
-  }
-  return 0;
-}
-
-_Bool isSpawnProtected(Position position) {
-  if ((position.x == 1 || position.x == GRID_WIDTH - 2) &&
-      (position.y <= 3 || position.y >= GRID_HEIGHT - 4)) {
-    return 1;
-  }
-  if ((position.y == 1 || position.y == GRID_HEIGHT - 2) &&
-      (position.x <= 3 || position.x >= GRID_WIDTH - 4)) {
-    return 1;
-  }
-  return 0;
-}
-
-Position getSpawn(int id) {
-  // 4 possible spawn locations
-  // this will support MAX_PLAYERS = 4
-  switch (id) {
-  case 0:
-    return (Position){1, 1};
-  case 1:
-    return (Position){13, 13};
-  case 2:
-    return (Position){13, 1};
-  case 3:
-    return (Position){1, 13};
-  }
-  return (Position){0, 0};
-}
-
-void updateCell(Position position, CellType cellType) {
-  game->grid[position.x][position.y].type = cellType;
-}
-
-_Bool isCollision(Position next) {
-  if (game->grid[next.x][next.y].type == CELL_EMPTY) {
-    return 0;
-  }
-  if (game->grid[next.x][next.y].type == CELL_POWERUP) {
-    return 0;
-  }
-  return 1;
-}
-
-_Bool isEqPos(Position p1, Position p2) {
-  if (p1.x == p2.x && p1.y == p2.y) {
-    return 1;
-  }
-  return 0;
-}
-
-Player *initPlayer(int id) {
-  Player *player = (Player *)malloc(sizeof(Player));
-  if (player == NULL) {
-    LOG_ERROR("Allocation of player failed!", NULL);
-  }
-  player->entity.id = id;
-  player->entity.position = getSpawn(id);
-  player->entity.targetPosition = player->entity.position;
-  switch (id) {
-  case (0):
-  case (3):
-    player->entity.facing = EAST;
-    break;
-  case (1):
-  case (2):
-    player->entity.facing = WEST;
-    break;
-  }
-  player->isAlive = 1;
-  player->speed = 5;
-  player->blastRadius = 3;
-  player->bombs = 1;
-  for (int i = 0; i < player->bombs; i++) {
-    player->bombList[i] = NULL;
-  }
-  return player;
-}
-
-void MovePlayer(Player *player, Direction direction) {
-  // Keinen Animationsabbruch
-  if (player->state == IDLE) {
-    Position targetPosition = player->entity.targetPosition;
-    switch (direction) {
-    case NORTH:
-      targetPosition.y -= 1;
-      if (!isCollision(targetPosition)) {
-        player->entity.targetPosition = targetPosition;
-      }
-      break;
-    case EAST:
-      targetPosition.x += 1;
-      if (!isCollision(targetPosition)) {
-        player->entity.targetPosition = targetPosition;
-        player->entity.facing = EAST;
-      }
-      break;
-    case SOUTH:
-      targetPosition.y += 1;
-      if (!isCollision(targetPosition)) {
-        player->entity.targetPosition = targetPosition;
-      }
-      break;
-    case WEST:
-      targetPosition.x -= 1;
-      if (!isCollision(targetPosition)) {
-        player->entity.targetPosition = targetPosition;
-        player->entity.facing = WEST;
-      }
-      break;
-    default:
-      break;
-    }
-    player->state = WALKING;
-  }
-};
-
-void UpdatePlayerPositionProgress(Player *player) {
-  if (player->state == WALKING) {
-    player->entity.progress += game->deltaTime * player->speed;
-    if (player->entity.progress >= 1.0f) {
-      player->entity.progress = 0;
-      player->entity.position = player->entity.targetPosition;
-      UpdatePlayerState(player, IDLE);
-    }
-  }
-}
-
-void UpdatePlayerState(Player *player, PlayerState state) {
-  player->state = state;
-}
-
-void PlantBomb(Player *player) {
-  for (int i = 0; i < player->bombs; i++) {
-    if (player->bombList[i] == NULL) {
-      if (game->grid[player->entity.position.x][player->entity.position.y]
-              .type != CELL_BOMB) {
-        LOG_INFO("Bomb planted", NULL);
-        player->bombList[i] = (Bomb *)malloc(sizeof(Bomb));
-        player->bombList[i]->entity.position = player->entity.position;
-        updateCell(player->entity.position, CELL_BOMB);
-        player->bombList[i]->startTime = GetTime();
-        player->bombList[i]->endTime = player->bombList[i]->startTime + 3;
-        player->bombList[i]->animation =
-            CreateAnimation(bombSparkFrames, BOMB_SPARK_FRAMES_NUM, 0.1f);
-        for (int j = 0; j < _DIRECTION_NUM; j++) {
-          player->bombList[i]->explosion[j] = NULL;
-        }
-        break;
-      }
+  game->charSelectMenu->selectedOption = 0;
+  game->charSelectMenu->next = 0;
+  // Initialize match, MAP_SIZE and PLAYERS pick a larger lobby
+  MatchConfig config = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, DEFAULT_PLAYERS};
+  if (getenv("MAP_SIZE")) {
+    config.width = config.height = atoi(getenv("MAP_SIZE"));
+  }
+  if (getenv("PLAYERS")) {
+    config.players = atoi(getenv("PLAYERS"));
+  }
+  game->match = InitMatchWithConfig(config, (unsigned int)time(NULL));
+  if (game->match == NULL) {
+    LOG_WARN("Falling back to the default match", NULL);
+    game->match = InitMatch((unsigned int)time(NULL));
+  }
+  game->recording = CreateRecording(game->match->config, game->match->seed);
+  game->saveState = (GameSnapshot){NULL, 0, 0};
+  memset(game->inputs, 0, sizeof(game->inputs));
+  // Netplay, see net.h
+  game->localPlayer = 0;
+  game->net = NULL;
+  NetConfig netConfig;
+  if (LoadNetConfig(&netConfig)) {
+    game->net = CreateNetSession(&netConfig);
+    if (game->net != NULL) {
+      game->localPlayer = netConfig.player;
+    } else {
+      LOG_WARN("Falling back to a local match", NULL);
     }
   }
-};
-
-void UpdateBombTimer(Player *player) {
-  for (int i = 0; i < player->bombs; i++) {
-    if (player->bombList[i] != NULL) {
-      Bomb *bomb = player->bombList[i];
-      if (bomb->endTime <= GetTime() && bomb->endTime != 0) {
-        createExplosion(player->bombList[i], player->blastRadius);
-        bomb->startTime = 0;
-        bomb->endTime = 0;
-        updateCell(bomb->entity.position, CELL_EMPTY);
-      }
-    }
+  game->bots = NULL;
+  game->strongBots = NULL;
+  if (game->net == NULL) {
+    createBots(game);
   }
+  return game;
 }
 
-void RemoveExplodedBombs(Player *player) {
-  for (int i = 0; i < player->bombs; i++) {
-    if (player->bombList[i] != NULL) {
-      if (player->bombList[i]->isExploded) {
-        free(player->bombList[i]);
-        player->bombList[i] = NULL;
-      }
-    }
-  }
-}
-
-void createExplosion(Bomb *bomb, int blastRadius) {
-  double startTime = GetTime();
-  Position pos = bomb->entity.position;
-  for (int i = 0; i < _DIRECTION_NUM; i++) {
-    Explosion *explosion = (Explosion *)malloc(sizeof(Explosion));
-    bomb->explosion[i] = explosion;
-    explosion->speed = 6;
-    explosion->entity.position = pos;
-    explosion->startTime = startTime;
-    explosion->animation =
-        CreateAnimation(explosionBlastFrames, EXPLOSION_BLAST_FRAMES_NUM, 0.1f);
-    switch (i) {
-    case NORTH:
-      explosion->entity.targetPosition = (Position){pos.x, pos.y - blastRadius};
-      break;
-    case EAST:
-      explosion->entity.targetPosition = (Position){pos.x + blastRadius, pos.y};
-      break;
-    case SOUTH:
-      explosion->entity.targetPosition = (Position){pos.x, pos.y + blastRadius};
-      break;
-    case WEST:
-      explosion->entity.targetPosition = (Position){pos.x - blastRadius, pos.y};
-      break;
-    }
-  }
-}
-
-void updateExplosionProgress(Player *player) {
-  for (int i = 0; i < player->bombs; i++) {
-    if (player->bombList[i] != NULL) {
-      Bomb *bomb = player->bombList[i];
-      if (bomb->endTime == 0) {
-        int nullExplosions = 0;
-        for (int j = 0; j < _DIRECTION_NUM; j++) {
-          if (bomb->explosion[j] != NULL) {
-            Explosion *explosion = bomb->explosion[j];
-            float progress = game->deltaTime * explosion->speed;
-            float relPos =
-                explosion->entity.progress * (player->blastRadius + 1);
-            for (int k = 0; k <= player->blastRadius; k++) {
-              if (relPos >= k) {
-                Position cellPos;
-                switch (j) {
-                case NORTH:
-                  cellPos = (Position){explosion->entity.position.x,
-                                       explosion->entity.position.y - k};
-                  break;
-                case EAST:
-                  cellPos = (Position){explosion->entity.position.x + k,
-                                       explosion->entity.position.y};
-                  break;
-                case SOUTH:
-                  cellPos = (Position){explosion->entity.position.x,
-                                       explosion->entity.position.y + k};
-                  break;
-                case WEST:
-                  cellPos = (Position){explosion->entity.position.x - k,
-                                       explosion->entity.position.y};
-                  break;
-                }
-                Cell cell = game->grid[cellPos.x][cellPos.y];
-                if (cell.type == CELL_DESTRUCTIBLE) {
-                  breakDestructibel(cellPos);
-                  bomb->explosion[j] = NULL;
-                  break;
-                }
-                if (cell.type == CELL_SOLID_WALL) {
-                  bomb->explosion[j] = NULL;
-                  break;
-                }
-                if (cell.type == CELL_BOMB) {
-                  Bomb *otherBomb = getBomb(cellPos);
-                  if (otherBomb != NULL) {
-                    LOG_INFO("trigger Bomb: %d.%d", cellPos.x, cellPos.y);
-                    otherBomb->endTime = GetTime();
-                  }
-                };
-                for (int l = 0; l < MAX_PLAYERS; l++) {
-                  Player *player = game->player[l];
-                  if (player->entity.position.x == cellPos.x &&
-                      player->entity.position.y == cellPos.y) {
-                    bomb->explosion[j] = NULL;
-                    player->isAlive = 0;
-                    break;
-                  }
-                }
-              }
-            }
-            explosion->entity.progress += progress;
-            if (explosion->entity.progress >= 1) {
-              bomb->explosion[j] = NULL;
-            }
-          } else {
-            nullExplosions++;
-            if (nullExplosions == _DIRECTION_NUM) {
-              bomb->isExploded = 1;
-            }
-          }
-        }
-      }
-    }
-  }
-}
-
-void checkPlayerAlive(Player *player) {
-  if (player->isAlive == 0) {
-    player->state = DEATH;
-  }
-}
-
-void breakDestructibel(Position pos) {
-  if ((rand() % 10) < 2) {
-    updateCell(pos, CELL_POWERUP);
-  } else {
-    updateCell(pos, CELL_EMPTY);
-  }
-}
-
-Bomb *getBomb(Position pos) {
-  for (int i = 0; i < MAX_PLAYERS; i++) {
-    Player *player = game->player[i];
-    for (int j = 0; j < player->bombs; j++) {
-      Bomb *bomb = player->bombList[j];
-      if (bomb != NULL) {
-        if (isEqPos(pos, bomb->entity.position)) {
-          return bomb;
-        }
-      }
-    }
-  }
-  return NULL;
-}
-
-void checkPlayerOnPowerUp(Player *player) {
-  Position pos = player->entity.position;
-  Cell cell = game->grid[pos.x][pos.y];
-  if (cell.type == CELL_POWERUP) {
-    collectPowerUp(pos, player);
-  }
-}
-
-void collectPowerUp(Position pos, Player *player) {
-  int r = rand() % _POWERUP_NUM;
-  switch (r) {
-  case POWERUP_SPEED:
-    printf("speed collected\n");
-    player->speed++;
-    break;
-  case POWERUP_BOMB:
-    printf("bomb collected\n");
-    player->bombs++;
-    break;
-  case POWERUP_BLAST_RADIUS:
-    printf("blast radius collected\n");
-    player->blastRadius++;
-    break;
-  }
-  updateCell(pos, CELL_EMPTY);
-}
-
-void GameLoop() {
+void GameLoop(Game *game) {
+  double previousTime = GetTime();
+  double accumulator = 0;
   while (game->state != EXIT) {
+    double currentTime = GetTime();
+    game->deltaTime = currentTime - previousTime;
+    accumulator += game->deltaTime;
+    previousTime = currentTime;
+    PROFILE_FRAME();
+    PROFILE_BEGIN("HandleInput");
     HandleInput(game);
-    game->stateFunction(game);
-    Render(game);
+    PROFILE_END();
+    int ticks = 0;
+    while (accumulator >= TICK_TIME && ticks < MAX_CATCHUP_TICKS) {
+      PROFILE_BEGIN(stateZones[game->state]);
+      game->stateFunction(game);
+      PROFILE_END();
+      accumulator -= TICK_TIME;
+      ticks++;
+    }
+    if (accumulator >= TICK_TIME) {
+      LOG_DEBUG("GameLoop: dropped %i ticks", (int)(accumulator / TICK_TIME));
+      accumulator = 0;
+    }
+    PROFILE_BEGIN("Render");
+    Render(game, accumulator / TICK_TIME);
+    PROFILE_END();
   }
+  saveRecording(game);
 };
 
 void UpdateGameState(Game *game, GameStateType stateType) {
@@ -509,13 +193,15 @@ void mainMenuState(Game *game) {
 
 void charSelectMenuState(Game *game) {
   if (game->charSelectMenu->next) {
-    for (int i = 0; i < MAX_PLAYERS; i++) {
-      if (i == 0) {
-        SetCharAnimationSet(game->charSelectMenu->selectedOption,
-                            game->player[i]);
+    if (game->net != NULL && !connectMatch(game)) {
+      return;
+    }
+    for (int i = 0; i < game->match->config.players; i++) {
+      if (i == game->localPlayer) {
+        SetCharAnimationSet(game->charSelectMenu->selectedOption, i);
       } else {
         int char_id = rand() % CHARACTERS;
-        SetCharAnimationSet(char_id, game->player[i]);
+        SetCharAnimationSet(char_id, i);
       }
     }
     UpdateGameState(game, RUNNING_COUNTDOWN);
@@ -524,40 +210,31 @@ void charSelectMenuState(Game *game) {
 
 void runningCountdownState(Game *game) {
   LOG_DEBUG("runningCountdownState", NULL);
-  game->deltaTime = GetFrameTime();
-  for (int i = 0; i < MAX_PLAYERS; i++) {
-    Player *player = game->player[i];
-    if (player->animation[SPAWN]->currentFrame ==
-        player->animation[SPAWN]->numFrames - 1) {
-      UpdatePlayerState(player, IDLE);
-    }
-  }
-  game->countdown -= game->deltaTime;
-  if (game->countdown <= 0.0f) {
+  stepMatch(game);
+  if (game->match->countdown <= 0.0f) {
     UpdateGameState(game, RUNNING);
   }
 }
 
 void runningState(Game *game) {
   LOG_DEBUG("runnigState", NULL);
-  game->deltaTime = GetFrameTime();
   if (game->pauseMenu->isActive) {
     UpdateGameState(game, PAUSE_MENU);
   }
-  for (int i = 0; i < MAX_PLAYERS; i++) {
-    Player *player = game->player[i];
-    LOG_DEBUG("%i runningState: UpdatePlayerPositionProgress", i);
-    UpdatePlayerPositionProgress(player);
-    LOG_DEBUG("%i runningState: UpdateBombTimer", i);
-    UpdateBombTimer(player);
-    LOG_DEBUG("%i runningState: updateExplosionProgress", i);
-    updateExplosionProgress(player);
-    LOG_DEBUG("%i runningState: RemoveExplodedBombs", i);
-    RemoveExplodedBombs(player);
-    LOG_DEBUG("%i runningState: checkPlayerOnPowerUp", i);
-    checkPlayerOnPowerUp(player);
-    LOG_DEBUG("%i runningState: checkPlayerAlive", i);
-    checkPlayerAlive(player);
+  Match *match = game->match;
+  if (match->overTick < 0 || match->tick < match->overTick + MATCH_END_TICKS) {
+    stepMatch(game);
+    return;
+  }
+  if (game->net == NULL) {
+    endMatch(game);
+    return;
+  }
+  // Peers stop at the same tick and leave once everyone has every input
+  // before it, so all of them end on the same state
+  NetPoll(game->net, match);
+  if (NetSettled(game->net, match->tick)) {
+    endMatch(game);
   }
 }
 
@@ -569,6 +246,210 @@ void pauseState(Game *game) {
 
 void exitState(Game *game) {}
 
+void stepMatch(Game *game) {
+  if (game->net != NULL) {
+    NetStep(game->net, game->match);
+  } else {
+    playBots(game);
+    applyInputs(game);
+    StepMatch(game->match, TICK_TIME);
+  }
+}
+
+// Bots plan before every tick, their commands are recorded like inputs. The
+// strong bots of a tick are searched in one batch.
+void playBots(Game *game) {
+  if (game->bots == NULL) {
+    return;
+  }
+  Match *match = game->match;
+  UpdateBotPlanner(game->bots, match);
+  Command commands[MAX_PLAYERS];
+  int count = 0;
+  if (game->strongBots != NULL) {
+    uint64_t players = ~(uint64_t)0 >> (MAX_PLAYERS - match->config.players) &
+                       ~((uint64_t)1 << game->localPlayer);
+    count = PlanMctsCommands(game->strongBots, match, players, commands);
+  } else {
+    for (int i = 0; i < match->config.players; i++) {
+      if (i != game->localPlayer &&
+          PlanBotCommand(game->bots, match, i, &commands[count])) {
+        count++;
+      }
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    IssueCommand(game, commands[i]);
+  }
+}
+
+// BOT_LEVEL=strong takes the MCTS bots, MCTS_BUDGET is their thinking time
+// per tick in milliseconds, a bad or non-positive one keeps the default
+void createBots(Game *game) {
+  game->bots = CreateBotPlanner(game->match);
+  const char *level = getenv("BOT_LEVEL");
+  if (level == NULL || strcmp(level, "strong") != 0) {
+    return;
+  }
+  MctsConfig config = {GetNumCores(), MCTS_DEFAULT_BUDGET / 1000.0, 0};
+  const char *budget = getenv("MCTS_BUDGET");
+  if (budget != NULL) {
+    char *end;
+    double milliseconds = strtod(budget, &end);
+    if (end != budget && *end == '\0' && milliseconds > 0 &&
+        isfinite(milliseconds)) {
+      config.budget = milliseconds / 1000.0;
+    } else {
+      LOG_WARN("Invalid MCTS_BUDGET %s, using %i ms", budget,
+               MCTS_DEFAULT_BUDGET);
+    }
+  }
+  game->strongBots = CreateMctsBot(game->match, config);
+}
+
+void freeBots(Game *game) {
+  if (game->bots != NULL) {
+    FreeBotPlanner(game->bots);
+    game->bots = NULL;
+  }
+  if (game->strongBots != NULL) {
+    FreeMctsBot(game->strongBots);
+    game->strongBots = NULL;
+  }
+}
+
+// Waits until every peer is ready and takes map and seed from player 0
+_Bool connectMatch(Game *game) {
+  MatchConfig config = game->match->config;
+  unsigned int seed = game->match->seed;
+  if (!NetConnect(game->net, &config, &seed)) {
+    return 0;
+  }
+  if (seed != game->match->seed ||
+      memcmp(&config, &game->match->config, sizeof(MatchConfig)) != 0) {
+    Match *match = InitMatchWithConfig(config, seed);
+    if (match == NULL) {
+      LOG_ERROR("Cannot create the match of player 0!", NULL);
+      return 0;
+    }
+    FreeMatch(game->match);
+    game->match = match;
+    FreeRecording(game->recording);
+    game->recording = CreateRecording(config, seed);
+  }
+  return NetStartMatch(game->net, game->match, game->recording);
+}
+
+// Frees the match and the characters and starts a rematch with the same
+// config through the character selection
+void endMatch(Game *game) {
+  MatchConfig config = game->match->config;
+  ReleaseCharAnimationSets();
+  saveRecording(game);
+  FreeMatch(game->match);
+  game->match = InitMatchWithConfig(config, (unsigned int)time(NULL));
+  FreeRecording(game->recording);
+  game->recording = CreateRecording(game->match->config, game->match->seed);
+  memset(game->inputs, 0, sizeof(game->inputs));
+  if (game->bots != NULL) {
+    freeBots(game);
+    createBots(game);
+  }
+  FreeGameSnapshot(&game->saveState);
+  game->charSelectMenu->next = 0;
+  UpdateGameState(game, CHAR_SELECT_MENU);
+}
+
+void IssueCommand(Game *game, Command command) {
+  if (game->net != NULL) {
+    // Applied and recorded by the session on its tick
+    NetQueueCommand(game->net, command);
+    return;
+  }
+  game->inputs[command.player] =
+      AddInputCommand(game->inputs[command.player], command);
+}
+
+// Applies the queued inputs before a tick. A move of a walking player and a
+// plant without a bomb left change nothing, so the recording skips them.
+void applyInputs(Game *game) {
+  Match *match = game->match;
+  PlayerTable *players = &match->players;
+  for (int i = 0; i < match->config.players; i++) {
+    uint8_t input = game->inputs[i];
+    game->inputs[i] = 0;
+    Command commands[2];
+    int numCommands = 0;
+    if ((input & INPUT_MOVE) && players->state[i] == IDLE) {
+      Direction direction = (Direction)(input & INPUT_DIRECTION);
+      commands[numCommands++] = (Command){match->tick, i, COMMAND_MOVE,
+                                          direction};
+      MovePlayer(match, i, direction);
+    }
+    if (input & INPUT_PLANT) {
+      int activeBombs = players->activeBombs[i];
+      PlantBomb(match, i);
+      if (players->activeBombs[i] > activeBombs) {
+        commands[numCommands++] = (Command){
+            .tick = match->tick, .player = i, .type = COMMAND_PLANT};
+      }
+    }
+    for (int c = 0; c < numCommands && game->recording != NULL; c++) {
+      RecordCommand(game->recording, commands[c]);
+    }
+  }
+}
+
+_Bool SnapshotGame(Game *game, GameSnapshot *snapshot) {
+  if (snapshot->size != game->match->size) {
+    void *match = realloc(snapshot->match, game->match->size);
+    if (match == NULL) {
+      LOG_ERROR("Allocation of snapshot failed!", NULL);
+      return 0;
+    }
+    snapshot->match = match;
+    snapshot->size = game->match->size;
+  }
+  SnapshotMatch(game->match, snapshot->match);
+  snapshot->numCommands =
+      game->recording != NULL ? game->recording->numCommands : 0;
+  return 1;
+}
+
+_Bool RestoreGame(Game *game, GameSnapshot *snapshot) {
+  if (snapshot->match == NULL || !RestoreMatch(game->match, snapshot->match)) {
+    return 0;
+  }
+  if (game->recording != NULL &&
+      game->recording->numCommands > snapshot->numCommands) {
+    game->recording->numCommands = snapshot->numCommands;
+  }
+  memset(game->inputs, 0, sizeof(game->inputs));
+  return 1;
+}
+
+void FreeGameSnapshot(GameSnapshot *snapshot) {
+  free(snapshot->match);
+  snapshot->match = NULL;
+  snapshot->size = 0;
+}
+
+// Writes the recording of a played match to RECORD_DIR, ./replay plays it
+// back
+void saveRecording(Game *game) {
+  const char *directory = getenv("RECORD_DIR");
+  if (directory == NULL || game->recording == NULL || game->match->tick == 0) {
+    return;
+  }
+  char fileName[512];
+  snprintf(fileName, sizeof(fileName), "%s/match-%u.rec", directory,
+           game->match->seed);
+  FinishRecording(game->recording, game->match);
+  if (SaveRecording(game->recording, fileName)) {
+    LOG_INFO("Saved recording %s", fileName);
+  }
+}
+
 void MenuMoveUp(Game *game) {
   game->mainMenu->selectedOption =
       (game->mainMenu->selectedOption - 1 + MENU_OPTIONS) % MENU_OPTIONS;
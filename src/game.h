@@ -1,5 +1,10 @@
 #ifndef STATE_H
 #define STATE_H
+#include "bot.h"
+#include "mcts.h"
+#include "net.h"
+#include "record.h"
+#include "sim.h"
 #include "util.h"
 #include <raylib.h>
 
@@ -34,93 +39,17 @@ typedef struct {
 typedef struct {
   const char *title;
   int selectedOption;
-  Texture2D charTexture[CHARACTERS];
+  AtlasSprite charSprite[CHARACTERS];
   _Bool next;
 } CharSelectMenu;
 
-#define GRID_WIDTH 15
-#define GRID_HEIGHT 15
-
-typedef enum {
-  CELL_EMPTY,
-  CELL_SOLID_WALL,
-  CELL_DESTRUCTIBLE,
-  CELL_BOMB,
-  CELL_POWERUP,
-} CellType;
-
-typedef struct {
-  CellType type;
-} Cell;
-
-typedef enum {
-  POWERUP_SPEED,
-  POWERUP_BOMB,
-  POWERUP_BLAST_RADIUS,
-  _POWERUP_NUM,
-} PowerUpType;
-
-typedef struct {
-  Animation *animation;
-} PowerUp;
-
-typedef struct {
-  int x;
-  int y;
-} Position;
-
-typedef enum {
-  NORTH,
-  EAST,
-  SOUTH,
-  WEST,
-  _DIRECTION_NUM,
-} Direction;
-
+// Save state of a running match, taken by SnapshotGame
 typedef struct {
-  int id;
-  Position position;
-  Position targetPosition;
-  float progress;
-  Direction facing;
-} Entity;
-
-typedef struct {
-  Entity entity;
-  double startTime;
-  float speed;
-  Animation *animation;
-} Explosion;
-
-typedef struct {
-  Entity entity;
-  double endTime;
-  double startTime;
-  _Bool isExploded;
-  Explosion *explosion[_DIRECTION_NUM];
-  Animation *animation;
-} Bomb;
-
-#define MAX_PLAYERS 4
-
-typedef enum {
-  SPAWN,
-  IDLE,
-  WALKING,
-  DEATH,
-  _PLAYER_STATE_NUM,
-} PlayerState;
-
-typedef struct {
-  Entity entity;
-  float speed;
-  _Bool isAlive;
-  PlayerState state;
-  Bomb *bombList[20];
-  int bombs;
-  int blastRadius;
-  Animation *animation[_PLAYER_STATE_NUM];
-} Player;
+  void *match;
+  size_t size;
+  // Recorded commands at the time of the snapshot
+  int numCommands;
+} GameSnapshot;
 
 struct Game {
   const char *title;
@@ -129,18 +58,43 @@ struct Game {
   MainMenu *mainMenu;
   PauseMenu *pauseMenu;
   CharSelectMenu *charSelectMenu;
-  float countdown;
+  // Duration of the last rendered frame, drives visual-only animations
   float deltaTime;
-  Cell grid[GRID_WIDTH][GRID_HEIGHT];
-  Player *player[MAX_PLAYERS];
+  Match *match;
+  // Player driven by the local input, set by NET_PLAYER in a net match
+  int localPlayer;
+  // Rollback session with the other peers, NULL for a local match
+  NetSession *net;
+  // Plays every player but the local one in a local match, NULL otherwise
+  BotPlanner *bots;
+  // Takes over from bots with BOT_LEVEL=strong, see mcts.h
+  MctsBot *strongBots;
+  // Commands issued to the current match, saved to RECORD_DIR if set
+  Recording *recording;
+  // Commands of each player for the next tick of a local match, see
+  // AddInputCommand
+  uint8_t inputs[MAX_PLAYERS];
+  // Quick save slot, F5 saves and F9 loads while running
+  GameSnapshot saveState;
 };
 
 Game *InitGame();
 
-void GameLoop();
+void GameLoop(Game *game);
 
 void UpdateGameState(Game *game, GameStateType stateType);
 
+// Queues a player command for the next tick, a tick keeps a move and a plant
+// per player. Only those that take effect are recorded. In a net match the
+// input is sent with the next tick.
+void IssueCommand(Game *game, Command command);
+
+// Save states, only for local matches. Restoring drops the commands recorded
+// after the snapshot so the recording still replays to the restored match.
+_Bool SnapshotGame(Game *game, GameSnapshot *snapshot);
+_Bool RestoreGame(Game *game, GameSnapshot *snapshot);
+void FreeGameSnapshot(GameSnapshot *snapshot);
+
 // MainMenu
 void MenuMoveUp(Game *game);
 void MenuMoveDown(Game *game);
@@ -153,12 +107,4 @@ void SelectChar(Game *game);
 
 // PauseMenu
 void PauseSwitchState(Game *game);
-
-// Player
-void MovePlayer(Player *player, Direction direction);
-void UpdatePlayerPositionProgress(Player *player);
-void UpdatePlayerState(Player *player, PlayerState state);
-
-// Bomb
-void PlantBomb(Player *player);
 #endif // STATE_H
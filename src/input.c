@@ -1,14 +1,30 @@
 #include "input.h"
 #include "game.h"
 #include "log.h"
+#include "profiler.h"
+#include <stdlib.h>
 #include <raylib.h>
 #include <string.h>
 
+// Frames written by a profile capture
+#define PROFILE_CAPTURE_FRAMES 600
+
 void HandleInput(Game *game) {
   if (WindowShouldClose()) {
     LOG_INFO("Close window", NULL);
     UpdateGameState(game, EXIT);
   }
+#ifdef PROFILE
+  // F3 shows the profiler, F4 writes a trace of the next frames
+  if (IsKeyPressed(KEY_F3)) {
+    ToggleProfileOverlay();
+  }
+  if (IsKeyPressed(KEY_F4)) {
+    const char *fileName = getenv("PROFILE_TRACE");
+    StartProfileCapture(fileName ? fileName : "profile.json",
+                        PROFILE_CAPTURE_FRAMES);
+  }
+#endif
   switch (game->state) {
   case MAIN_MENU:
     if (IsKeyPressed(KEY_W) || IsKeyPressed(KEY_UP)) {
@@ -38,28 +54,42 @@ void HandleInput(Game *game) {
   case RUNNING_COUNTDOWN:
     break;
   case RUNNING:
-    Player *player = game->player[0];
-    if (player->isAlive) {
+    int player = game->localPlayer;
+    if (game->match->players.isAlive[player]) {
       if (IsKeyPressed(KEY_W) || IsKeyDown(KEY_W)) {
-        MovePlayer(player, NORTH);
+        IssueCommand(game, (Command){.player = player, .type = COMMAND_MOVE,
+                                     .direction = NORTH});
       };
       if (IsKeyPressed(KEY_S) || IsKeyDown(KEY_S)) {
-        MovePlayer(player, SOUTH);
+        IssueCommand(game, (Command){.player = player, .type = COMMAND_MOVE,
+                                     .direction = SOUTH});
       };
       if (IsKeyPressed(KEY_A) || IsKeyDown(KEY_A)) {
-        MovePlayer(player, WEST);
+        IssueCommand(game, (Command){.player = player, .type = COMMAND_MOVE,
+                                     .direction = WEST});
       };
       if (IsKeyPressed(KEY_D) || IsKeyDown(KEY_D)) {
-        MovePlayer(player, EAST);
+        IssueCommand(game, (Command){.player = player, .type = COMMAND_MOVE,
+                                     .direction = EAST});
       };
       if (IsKeyPressed(KEY_SPACE)) {
-        PlantBomb(player);
+        IssueCommand(game, (Command){.player = player, .type = COMMAND_PLANT});
       };
       if (IsKeyPressed(KEY_P)) {
         LOG_INFO("Switch pause state", NULL);
         PauseSwitchState(game);
       };
     }
+    // Save states would fork a net match from the peers
+    if (game->net != NULL) {
+      break;
+    }
+    if (IsKeyPressed(KEY_F5) && SnapshotGame(game, &game->saveState)) {
+      LOG_INFO("Saved state at tick %ld", game->match->tick);
+    }
+    if (IsKeyPressed(KEY_F9) && RestoreGame(game, &game->saveState)) {
+      LOG_INFO("Loaded state of tick %ld", game->match->tick);
+    }
     break;
   case PAUSE_MENU:
     if (IsKeyPressed(KEY_ESCAPE) || IsKeyPressed(KEY_P)) {
@@ -0,0 +1,371 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include "clock.h"
+#include "delta.h"
+#include "log.h"
+#include "pool.h"
+#include "rand.h"
+#include "record.h"
+#include "sim.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// Load generator for the match server. Fills lobbies with simulated clients
+// that join and send random inputs every tick, decodes the states that come
+// back and reports them. Run it next to ./server and read the capacity from
+// the server's report.
+//
+//   ./loadgen [lobbies] [players] [seconds]
+//
+// SERVER_HOST and SERVER_PORT address the server, SERVER_SHARDS has to
+// match its shard count.
+
+#define DEFAULT_LOBBIES 100
+#define DEFAULT_SECONDS 30
+// Clients share sockets, the server tells them apart by their nonce
+#define LOADGEN_SOCKETS 64
+#define LOADGEN_BATCH 64
+// Ticks between two JOINs of a client that got no answer
+#define JOIN_INTERVAL 30
+
+typedef struct {
+  uint32_t lobby;
+  uint32_t nonce;
+  // -1 until welcomed
+  int player;
+  unsigned int policyState;
+} Client;
+
+// Clients of a lobby share a socket and cannot tell their states apart, so
+// states are decoded once per lobby and every client acks the last one
+typedef struct {
+  StateView *history[SERVER_STATE_HISTORY];
+  uint32_t ids[SERVER_STATE_HISTORY];
+  uint32_t lastState;
+} LobbyViews;
+
+typedef struct {
+  int socket;
+  int numSends;
+  struct mmsghdr messages[LOADGEN_BATCH];
+  struct iovec vectors[LOADGEN_BATCH];
+  uint8_t buffers[LOADGEN_BATCH][SERVER_MAX_PACKET];
+  struct sockaddr_in addresses[LOADGEN_BATCH];
+} LoadSocket;
+
+typedef struct {
+  long packetsIn;
+  long bytesIn;
+  long states;
+  long fullStates;
+  long stateBytes;
+  // States skipped by the state counter of a lobby
+  long missedStates;
+  long decodeErrors;
+  long packetsOut;
+  long full;
+} LoadStats;
+
+static int numLobbies;
+static int numPlayers;
+static int numShards;
+static Client *clients;
+static LobbyViews *lobbyViews;
+static LoadSocket sockets[LOADGEN_SOCKETS];
+static int numSockets;
+static struct sockaddr_in server;
+static uint32_t nonceBase;
+static LoadStats stats;
+
+void sendTick(long tick);
+void queuePacket(LoadSocket *socket, uint32_t lobby, const uint8_t *data,
+                 int length);
+void flushPackets(LoadSocket *socket);
+void receivePackets(LoadSocket *socket);
+void receiveWelcome(uint32_t lobby, const uint8_t *data);
+void receiveState(uint32_t lobby, const uint8_t *data, int length);
+void reportLoad(LoadStats *last, double seconds);
+
+int main(int argc, char *argv[]) {
+  numLobbies = argc > 1 ? atoi(argv[1]) : DEFAULT_LOBBIES;
+  numPlayers = argc > 2 ? atoi(argv[2]) : DEFAULT_PLAYERS;
+  int seconds = argc > 3 ? atoi(argv[3]) : DEFAULT_SECONDS;
+  numShards =
+      getenv("SERVER_SHARDS") ? atoi(getenv("SERVER_SHARDS")) : GetNumCores();
+  const char *host =
+      getenv("SERVER_HOST") ? getenv("SERVER_HOST") : "127.0.0.1";
+  int port = getenv("SERVER_PORT") ? atoi(getenv("SERVER_PORT"))
+                                   : SERVER_DEFAULT_PORT;
+  server = (struct sockaddr_in){.sin_family = AF_INET};
+  if (numLobbies < 1 || numPlayers < 1 ||
+      numPlayers > SERVER_MAX_LOBBY_PLAYERS || seconds < 1 || numShards < 1 ||
+      inet_pton(AF_INET, host, &server.sin_addr) != 1) {
+    fprintf(stderr, "usage: %s [lobbies] [players] [seconds]\n", argv[0]);
+    return 1;
+  }
+  server.sin_port = htons(port);
+  currentLogLevel = LOG_LEVEL_WARN;
+
+  clients = (Client *)malloc(sizeof(Client) * numLobbies * numPlayers);
+  lobbyViews = (LobbyViews *)calloc(numLobbies, sizeof(LobbyViews));
+  if (clients == NULL || lobbyViews == NULL) {
+    LOG_ERROR("Allocation of clients failed!", NULL);
+    return 1;
+  }
+  nonceBase = (uint32_t)time(NULL) * 2654435761u;
+  for (int i = 0; i < numLobbies * numPlayers; i++) {
+    clients[i] = (Client){i / numPlayers, nonceBase ^ i, -1, i + 1};
+  }
+
+  int epoll = epoll_create1(0);
+  numSockets = numLobbies < LOADGEN_SOCKETS ? numLobbies : LOADGEN_SOCKETS;
+  for (int i = 0; i < numSockets; i++) {
+    sockets[i].socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    int buffer = 4 << 20;
+    setsockopt(sockets[i].socket, SOL_SOCKET, SO_RCVBUF, &buffer,
+               sizeof(buffer));
+    struct epoll_event event = {.events = EPOLLIN, .data.u32 = i};
+    if (sockets[i].socket < 0 ||
+        epoll_ctl(epoll, EPOLL_CTL_ADD, sockets[i].socket, &event) < 0) {
+      LOG_ERROR("Cannot create socket: %s", strerror(errno));
+      return 1;
+    }
+  }
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  long interval = 1000000000L / TICK_RATE;
+  struct itimerspec spec = {{0, interval}, {0, interval}};
+  timerfd_settime(timer, 0, &spec, NULL);
+  struct epoll_event timerEvent = {.events = EPOLLIN, .data.u32 = numSockets};
+  epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &timerEvent);
+
+  printf("%d lobbies with %d players on %s:%d-%d\n", numLobbies, numPlayers,
+         host, port, port + numShards - 1);
+  double start = GetWallTime();
+  double lastReport = start;
+  LoadStats last = stats;
+  long tick = 0;
+  struct epoll_event events[LOADGEN_SOCKETS + 1];
+  while (GetWallTime() - start < seconds) {
+    int count = epoll_wait(epoll, events, numSockets + 1, 100);
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.u32 < (uint32_t)numSockets) {
+        receivePackets(&sockets[events[i].data.u32]);
+        continue;
+      }
+      uint64_t expirations;
+      if (read(timer, &expirations, sizeof(expirations)) > 0) {
+        sendTick(tick++);
+      }
+    }
+    double now = GetWallTime();
+    if (now - lastReport >= 1) {
+      reportLoad(&last, now - lastReport);
+      last = stats;
+      lastReport = now;
+    }
+  }
+  int joined = 0;
+  for (int i = 0; i < numLobbies * numPlayers; i++) {
+    joined += clients[i].player >= 0;
+  }
+  double elapsed = GetWallTime() - start;
+  printf("total: %d of %d clients joined, %.0f states/s, %.2f MB/s in, "
+         "%.1f bytes/state, %ld full states, %.1f%% states missed, %ld "
+         "decode errors, %ld lobbies full\n",
+         joined, numLobbies * numPlayers, stats.states / elapsed,
+         stats.bytesIn / elapsed / 1e6,
+         stats.states > 0 ? (double)stats.stateBytes / stats.states : 0,
+         stats.fullStates,
+         stats.states > 0
+             ? 100.0 * stats.missedStates / (stats.states + stats.missedStates)
+             : 0,
+         stats.decodeErrors, stats.full);
+  return 0;
+}
+
+// Every client sends a JOIN until welcomed, then one random input per tick
+void sendTick(long tick) {
+  for (int s = 0; s < numSockets; s++) {
+    for (int lobby = s; lobby < numLobbies; lobby += numSockets) {
+      for (int i = 0; i < numPlayers; i++) {
+        Client *client = &clients[lobby * numPlayers + i];
+        uint8_t data[32];
+        ServerPutUint(data, SERVER_MAGIC, 4);
+        ServerPutUint(data + 5, client->lobby, 4);
+        if (client->player < 0) {
+          if ((tick + i) % JOIN_INTERVAL != 0) {
+            continue;
+          }
+          data[4] = SERVER_JOIN;
+          data[9] = numPlayers;
+          ServerPutUint(data + 10, client->nonce, 4);
+          queuePacket(&sockets[s], client->lobby, data, 14);
+          continue;
+        }
+        unsigned int r = NextRandom(&client->policyState);
+        Command command = {.type = COMMAND_MOVE,
+                           .direction = (Direction)(r % _DIRECTION_NUM)};
+        uint8_t input = r % 8 == 0 ? AddInputCommand(0, command) : 0;
+        if ((r >> 3) % 64 == 0) {
+          input |= INPUT_PLANT;
+        }
+        data[4] = SERVER_INPUT;
+        data[9] = client->player;
+        ServerPutUint(data + 10, client->nonce, 4);
+        data[14] = input;
+        ServerPutUint(data + 15, lobbyViews[lobby].lastState, 4);
+        queuePacket(&sockets[s], client->lobby, data, 19);
+      }
+    }
+    flushPackets(&sockets[s]);
+  }
+}
+
+void queuePacket(LoadSocket *socket, uint32_t lobby, const uint8_t *data,
+                 int length) {
+  int i = socket->numSends++;
+  memcpy(socket->buffers[i], data, length);
+  socket->addresses[i] = server;
+  socket->addresses[i].sin_port =
+      htons(ntohs(server.sin_port) + lobby % numShards);
+  socket->vectors[i] = (struct iovec){socket->buffers[i], length};
+  socket->messages[i].msg_hdr = (struct msghdr){
+      .msg_name = &socket->addresses[i],
+      .msg_namelen = sizeof(struct sockaddr_in),
+      .msg_iov = &socket->vectors[i],
+      .msg_iovlen = 1,
+  };
+  if (socket->numSends == LOADGEN_BATCH) {
+    flushPackets(socket);
+  }
+}
+
+void flushPackets(LoadSocket *socket) {
+  int sent = 0;
+  while (sent < socket->numSends) {
+    int count = sendmmsg(socket->socket, socket->messages + sent,
+                         socket->numSends - sent, 0);
+    if (count <= 0) {
+      break;
+    }
+    sent += count;
+  }
+  stats.packetsOut += sent;
+  socket->numSends = 0;
+}
+
+void receivePackets(LoadSocket *socket) {
+  struct mmsghdr messages[LOADGEN_BATCH];
+  struct iovec vectors[LOADGEN_BATCH];
+  static uint8_t buffers[LOADGEN_BATCH][SERVER_MAX_PACKET];
+  for (int i = 0; i < LOADGEN_BATCH; i++) {
+    vectors[i] = (struct iovec){buffers[i], SERVER_MAX_PACKET};
+    messages[i].msg_hdr = (struct msghdr){.msg_iov = &vectors[i],
+                                          .msg_iovlen = 1};
+  }
+  for (;;) {
+    int count = recvmmsg(socket->socket, messages, LOADGEN_BATCH,
+                         MSG_DONTWAIT, NULL);
+    if (count <= 0) {
+      return;
+    }
+    for (int i = 0; i < count; i++) {
+      uint8_t *data = buffers[i];
+      int length = messages[i].msg_len;
+      stats.packetsIn++;
+      stats.bytesIn += length;
+      if (length < 9 || ServerGetUint(data, 4) != SERVER_MAGIC) {
+        continue;
+      }
+      uint32_t lobby = ServerGetUint(data + 5, 4);
+      if (lobby >= (uint32_t)numLobbies) {
+        continue;
+      }
+      if (data[4] == SERVER_WELCOME && length >= 21) {
+        receiveWelcome(lobby, data);
+      } else if (data[4] == SERVER_STATE && length > SERVER_STATE_HEADER) {
+        receiveState(lobby, data + 9, length - 9);
+      } else if (data[4] == SERVER_FULL) {
+        stats.full++;
+      }
+    }
+    if (count < LOADGEN_BATCH) {
+      return;
+    }
+  }
+}
+
+void receiveWelcome(uint32_t lobby, const uint8_t *data) {
+  uint32_t index = ServerGetUint(data + 17, 4) ^ nonceBase;
+  if (index >= (uint32_t)(numLobbies * numPlayers) ||
+      clients[index].lobby != lobby) {
+    return;
+  }
+  clients[index].player = data[9];
+  LobbyViews *views = &lobbyViews[lobby];
+  MatchConfig config = {data[14], data[15], data[16]};
+  for (int i = 0; i < SERVER_STATE_HISTORY; i++) {
+    if (views->history[i] == NULL) {
+      views->history[i] = CreateStateView(config);
+    }
+  }
+}
+
+// Data starts at the state id
+void receiveState(uint32_t lobby, const uint8_t *data, int length) {
+  LobbyViews *views = &lobbyViews[lobby];
+  uint32_t id = ServerGetUint(data, 4);
+  uint32_t base = ServerGetUint(data + 4, 4);
+  // Copies for the other clients of the lobby and late states
+  if (views->history[0] == NULL || id <= views->lastState) {
+    return;
+  }
+  StateView *from = NULL;
+  if (base != 0) {
+    from = views->history[base % SERVER_STATE_HISTORY];
+    if (views->ids[base % SERVER_STATE_HISTORY] != base ||
+        id - base >= SERVER_STATE_HISTORY) {
+      stats.decodeErrors++;
+      return;
+    }
+  }
+  int slot = id % SERVER_STATE_HISTORY;
+  views->ids[slot] = 0;
+  if (!DecodeStateDelta(from, views->history[slot], data + 8, length - 8)) {
+    stats.decodeErrors++;
+    return;
+  }
+  views->ids[slot] = id;
+  if (views->lastState > 0 && id - views->lastState > 1) {
+    stats.missedStates += id - views->lastState - 1;
+  }
+  views->lastState = id;
+  stats.states++;
+  stats.fullStates += base == 0;
+  stats.stateBytes += length + 9;
+}
+
+void reportLoad(LoadStats *last, double seconds) {
+  int joined = 0;
+  for (int i = 0; i < numLobbies * numPlayers; i++) {
+    joined += clients[i].player >= 0;
+  }
+  long states = stats.states - last->states;
+  printf("%d clients, %.0f in/s, %.0f out/s, %.0f states/s, %.2f MB/s in, "
+         "%.1f bytes/state\n",
+         joined, (stats.packetsIn - last->packetsIn) / seconds,
+         (stats.packetsOut - last->packetsOut) / seconds, states / seconds,
+         (stats.bytesIn - last->bytesIn) / seconds / 1e6,
+         states > 0 ? (double)(stats.stateBytes - last->stateBytes) / states
+                    : 0);
+  fflush(stdout);
+}
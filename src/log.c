@@ -1,9 +1,58 @@
 #include "log.h"
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
+// Bounded multi-producer queue (Vyukov): a producer claims a slot with a
+// compare-and-swap on tail, the sequence of a slot tells whose turn it is.
+// Only the log thread consumes. It sleeps on a condition variable while the
+// queue is empty and a producer wakes it only if it announced that.
+#define LOG_RING_SIZE 1024
+#define LOG_MESSAGE_SIZE 256
+
+typedef struct {
+  atomic_size_t sequence;
+  LogLevel level;
+  time_t time;
+  char message[LOG_MESSAGE_SIZE];
+} LogSlot;
+
+typedef struct {
+  LogSlot slots[LOG_RING_SIZE];
+  atomic_size_t tail;
+  size_t head;
+  atomic_int dropped;
+  atomic_bool running;
+  // Producers between their check of running and publishing their slot
+  atomic_int writers;
+  // Set by the log thread before it waits on wakeup
+  atomic_bool sleeping;
+  pthread_mutex_t wakeLock;
+  pthread_cond_t wakeup;
+  pthread_t thread;
+} LogRing;
+
 LogLevel currentLogLevel = LOG_LEVEL_INFO;
+_Thread_local LogLevel threadLogLevel = LOG_LEVEL_DEBUG;
+
+static LogRing ring;
+static pthread_once_t ringOnce = PTHREAD_ONCE_INIT;
+// Serializes log_flush callers, the log thread itself never takes it
+static pthread_mutex_t drainLock = PTHREAD_MUTEX_INITIALIZER;
+
+void start_log_thread();
+void stop_log_thread();
+void *log_thread_main(void *arg);
+void wake_log_thread();
+_Bool is_log_ring_empty();
+int drain_log_ring();
+void write_log_line(LogLevel level, time_t time, const char *message);
+const char *format_time(time_t time);
 
 const char *log_level_to_string(LogLevel level) {
   switch (level) {
@@ -16,27 +65,185 @@ const char *log_level_to_string(LogLevel level) {
   case LOG_LEVEL_ERROR:
     return "ERROR";
   }
+  return "UNKNOWN";
 }
 
 void log_message(LogLevel level, const char *format, ...) {
-  if (level >= currentLogLevel) {
-    va_list args;
-    va_start(args, format);
+  if (level < currentLogLevel) {
+    return;
+  }
+  pthread_once(&ringOnce, start_log_thread);
+  va_list args;
+  va_start(args, format);
+  // Counted before running is read, so stop_log_thread either sees this
+  // producer or the producer sees the log thread stopped
+  atomic_fetch_add(&ring.writers, 1);
+  if (!atomic_load(&ring.running)) {
+    atomic_fetch_sub(&ring.writers, 1);
+    // No log thread (yet or anymore), write directly
+    char message[LOG_MESSAGE_SIZE];
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    write_log_line(level, time(NULL), message);
+    return;
+  }
+  size_t position = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+  LogSlot *slot;
+  for (;;) {
+    slot = &ring.slots[position & (LOG_RING_SIZE - 1)];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ring.tail, &position,
+                                                position + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Full, logging must never block the frame
+      atomic_fetch_add_explicit(&ring.dropped, 1, memory_order_relaxed);
+      atomic_fetch_sub(&ring.writers, 1);
+      va_end(args);
+      return;
+    } else {
+      position = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    }
+  }
+  slot->level = level;
+  slot->time = time(NULL);
+  vsnprintf(slot->message, sizeof(slot->message), format, args);
+  va_end(args);
+  atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+  atomic_fetch_sub(&ring.writers, 1);
+  // Pairs with the fence in log_thread_main: either this sees the log thread
+  // asleep or the log thread sees the slot
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&ring.sleeping, memory_order_relaxed)) {
+    wake_log_thread();
+  }
+}
 
-    const char *time_str = get_current_time_str();
+void log_flush() {
+  pthread_mutex_lock(&drainLock);
+  drain_log_ring();
+  pthread_mutex_unlock(&drainLock);
+}
 
-    printf("[%s] [%s] ", time_str, log_level_to_string(level));
-    vprintf(format, args);
-    printf("\n");
+const char *get_current_time_str() { return format_time(time(NULL)); }
 
-    va_end(args);
+void start_log_thread() {
+  for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+    atomic_init(&ring.slots[i].sequence, i);
+  }
+  atomic_init(&ring.tail, 0);
+  ring.head = 0;
+  atomic_init(&ring.dropped, 0);
+  atomic_init(&ring.running, 1);
+  atomic_init(&ring.writers, 0);
+  atomic_init(&ring.sleeping, 0);
+  pthread_mutex_init(&ring.wakeLock, NULL);
+  pthread_cond_init(&ring.wakeup, NULL);
+  if (pthread_create(&ring.thread, NULL, log_thread_main, NULL) != 0) {
+    atomic_store(&ring.running, 0);
+    return;
+  }
+  atexit(stop_log_thread);
+}
+
+void stop_log_thread() {
+  atomic_store(&ring.running, 0);
+  wake_log_thread();
+  pthread_join(ring.thread, NULL);
+  // Producers that saw the thread running may still publish their slot
+  while (atomic_load(&ring.writers) > 0) {
+    sched_yield();
+  }
+  log_flush();
+}
+
+void *log_thread_main(void *arg) {
+  while (atomic_load(&ring.running)) {
+    pthread_mutex_lock(&drainLock);
+    int written = drain_log_ring();
+    pthread_mutex_unlock(&drainLock);
+    if (written > 0) {
+      continue;
+    }
+    pthread_mutex_lock(&ring.wakeLock);
+    atomic_store_explicit(&ring.sleeping, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (is_log_ring_empty() && atomic_load(&ring.running)) {
+      pthread_cond_wait(&ring.wakeup, &ring.wakeLock);
+    }
+    atomic_store_explicit(&ring.sleeping, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&ring.wakeLock);
+  }
+  return NULL;
+}
+
+// Taking the lock waits until the log thread either waits or has not yet
+// checked the queue, so the signal is not lost
+void wake_log_thread() {
+  pthread_mutex_lock(&ring.wakeLock);
+  pthread_cond_signal(&ring.wakeup);
+  pthread_mutex_unlock(&ring.wakeLock);
+}
+
+// Whether the next slot to write is not yet published, under drainLock as
+// log_flush may move the head
+_Bool is_log_ring_empty() {
+  pthread_mutex_lock(&drainLock);
+  LogSlot *slot = &ring.slots[ring.head & (LOG_RING_SIZE - 1)];
+  _Bool empty = atomic_load_explicit(&slot->sequence, memory_order_acquire) !=
+                ring.head + 1;
+  pthread_mutex_unlock(&drainLock);
+  return empty;
+}
+
+// Writes the queued messages in order, the caller holds drainLock
+int drain_log_ring() {
+  int written = 0;
+  for (;;) {
+    LogSlot *slot = &ring.slots[ring.head & (LOG_RING_SIZE - 1)];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != ring.head + 1) {
+      break;
+    }
+    write_log_line(slot->level, slot->time, slot->message);
+    atomic_store_explicit(&slot->sequence, ring.head + LOG_RING_SIZE,
+                          memory_order_release);
+    ring.head++;
+    written++;
+  }
+  int dropped = atomic_exchange(&ring.dropped, 0);
+  if (dropped > 0) {
+    char message[64];
+    snprintf(message, sizeof(message), "%i log messages dropped", dropped);
+    write_log_line(LOG_LEVEL_WARN, time(NULL), message);
   }
+  if (written > 0 || dropped > 0) {
+    fflush(stdout);
+  }
+  return written;
+}
+
+void write_log_line(LogLevel level, time_t time, const char *message) {
+  printf("[%s] [%s] %s\n", format_time(time), log_level_to_string(level),
+         message);
 }
 
-const char *get_current_time_str() {
-  static char time_str[20];
-  time_t now = time(NULL);
-  struct tm *tm_info = localtime(&now);
-  strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+// localtime and strftime only run when the second changes
+const char *format_time(time_t time) {
+  static _Thread_local char time_str[20];
+  static _Thread_local time_t cached = -1;
+  if (time != cached) {
+    struct tm tm_info;
+    localtime_r(&time, &tm_info);
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &tm_info);
+    cached = time;
+  }
   return time_str;
 }
@@ -8,16 +8,51 @@ typedef enum {
   LOG_LEVEL_ERROR,
 } LogLevel;
 
+// Messages below this level are compiled out, e.g. make LOG_MIN_LEVEL=1
+// drops every LOG_DEBUG. Numeric so it can be tested by the preprocessor.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
 extern LogLevel currentLogLevel;
+// Per thread on top of currentLogLevel. Threads simulating for their own
+// purposes raise it, e.g. the bot search, so their rollouts stay quiet.
+extern _Thread_local LogLevel threadLogLevel;
 
 const char *log_level_to_string(LogLevel level);
 
+// Formats the message on the calling thread and queues it, a background
+// thread writes it out. Messages are dropped while the queue is full.
 void log_message(LogLevel level, const char *format, ...);
 
-#define LOG_DEBUG(format, ...) log_message(LOG_LEVEL_DEBUG, format, __VA_ARGS__)
-#define LOG_INFO(format, ...) log_message(LOG_LEVEL_INFO, format, __VA_ARGS__)
-#define LOG_WARN(format, ...) log_message(LOG_LEVEL_WARN, format, __VA_ARGS__)
-#define LOG_ERROR(format, ...) log_message(LOG_LEVEL_ERROR, format, __VA_ARGS__)
+// Write out every queued message
+void log_flush();
+
+// The level check happens before the call, so filtered messages cost no
+// argument setup
+#define LOG_AT(level, format, ...)                                             \
+  do {                                                                         \
+    if ((level) >= currentLogLevel && (level) >= threadLogLevel) {             \
+      log_message(level, format, __VA_ARGS__);                                 \
+    }                                                                          \
+  } while (0)
+
+#if LOG_MIN_LEVEL <= 0
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, __VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= 1
+#define LOG_INFO(format, ...) LOG_AT(LOG_LEVEL_INFO, format, __VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) ((void)0)
+#endif
+#if LOG_MIN_LEVEL <= 2
+#define LOG_WARN(format, ...) LOG_AT(LOG_LEVEL_WARN, format, __VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) ((void)0)
+#endif
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, __VA_ARGS__)
 
 const char *get_current_time_str();
 
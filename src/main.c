@@ -31,7 +31,7 @@ int main() {
   LOG_DEBUG("InitRenderer", NULL);
   InitRenderer(game);
   LOG_DEBUG("GameLoop", NULL);
-  GameLoop();
+  GameLoop(game);
   LOG_DEBUG("CloseWindow", NULL);
   CloseWindow();
   return 0;
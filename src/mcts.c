@@ -0,0 +1,418 @@
+#include "mcts.h"
+#include "bitboard.h"
+#include "log.h"
+#include "pool.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Exploration constant of UCT, rewards are in [0, 1]
+#define MCTS_EXPLORATION 0.7
+// Decisions along one path of a tree
+#define MCTS_MAX_DEPTH 64
+
+// Children are created on first visit, -1 until then. The tree is open
+// loop: a node stands for the actions that led to it, not for a state.
+typedef struct {
+  int child[MCTS_ACTIONS];
+  int visits;
+  float value;
+} MctsNode;
+
+// One thread of the search with its own tree and match
+typedef struct {
+  MctsBot *bot;
+  Match *match;
+  MctsNode *nodes;
+  int numNodes;
+  int index;
+  // The player of the decision the tree is grown for
+  int player;
+  unsigned int rngState;
+  long rollouts;
+  // Root visits per decision of the batch and action
+  int visits[MAX_PLAYERS][MCTS_ACTIONS];
+  // Keeps the counters of neighbouring workers off each other's line
+  char padding[64];
+} MctsWorker;
+
+struct MctsBot {
+  MctsConfig config;
+  ThreadPool *pool;
+  MctsWorker *workers;
+  // Snapshot of the match at the current batch, read by every worker
+  void *root;
+  size_t size;
+  // Players deciding in the current batch
+  int players[MAX_PLAYERS];
+  int numPlayers;
+  int enemies;
+  double start;
+};
+
+// Search functions
+void searchTree(void *arg);
+void growTree(MctsWorker *worker, double deadline);
+void runIteration(MctsWorker *worker);
+int getLegalActions(Match *match, int player);
+int selectAction(MctsWorker *worker, int node, int legal);
+void playAction(MctsWorker *worker, int action);
+void playRollout(MctsWorker *worker, double horizon);
+void playPolicy(Match *match, int player, _Bool inTree,
+                unsigned int *state);
+float scoreRollout(Match *match, int player, int enemies);
+unsigned int mctsRand(unsigned int *state);
+double getSearchTime();
+
+MctsBot *CreateMctsBot(Match *match, MctsConfig config) {
+  // Without either limit the search would never end
+  if (config.budget <= 0 && config.maxRollouts <= 0) {
+    LOG_ERROR("MCTS config without a budget or rollout limit!", NULL);
+    return NULL;
+  }
+  if (config.threads < 1) {
+    config.threads = 1;
+  }
+  MctsBot *bot = (MctsBot *)malloc(sizeof(MctsBot));
+  if (bot == NULL) {
+    LOG_ERROR("Allocation of MCTS bot failed!", NULL);
+    return NULL;
+  }
+  bot->config = config;
+  bot->size = match->size;
+  bot->root = malloc(match->size);
+  bot->workers = (MctsWorker *)calloc(config.threads, sizeof(MctsWorker));
+  bot->pool = CreateThreadPool(config.threads);
+  _Bool failed = bot->root == NULL || bot->workers == NULL;
+  for (int i = 0; !failed && i < config.threads; i++) {
+    MctsWorker *worker = &bot->workers[i];
+    worker->bot = bot;
+    worker->index = i;
+    worker->match = CloneMatch(match);
+    worker->nodes = (MctsNode *)malloc(sizeof(MctsNode) * MCTS_MAX_NODES);
+    // Every tree gets its own random stream
+    worker->rngState = (match->seed ^ (i + 1) * 2654435761u) | 1;
+    worker->rollouts = 0;
+    failed = worker->match == NULL || worker->nodes == NULL;
+  }
+  if (failed || bot->pool == NULL) {
+    LOG_ERROR("Allocation of MCTS bot failed!", NULL);
+    FreeMctsBot(bot);
+    return NULL;
+  }
+  return bot;
+}
+
+void FreeMctsBot(MctsBot *bot) {
+  if (bot->pool != NULL) {
+    FreeThreadPool(bot->pool);
+  }
+  if (bot->workers != NULL) {
+    for (int i = 0; i < bot->config.threads; i++) {
+      if (bot->workers[i].match != NULL) {
+        FreeMatch(bot->workers[i].match);
+      }
+      free(bot->workers[i].nodes);
+    }
+  }
+  free(bot->workers);
+  free(bot->root);
+  free(bot);
+}
+
+_Bool PlanMctsCommand(MctsBot *bot, Match *match, int player,
+                      Command *command) {
+  return PlanMctsCommands(bot, match, (uint64_t)1 << player, command) == 1;
+}
+
+int PlanMctsCommands(MctsBot *bot, Match *match, uint64_t players,
+                     Command *commands) {
+  PlayerTable *table = &match->players;
+  if (IsMatchOver(match) || match->size != bot->size) {
+    return 0;
+  }
+  int alive = 0;
+  bot->numPlayers = 0;
+  for (int i = 0; i < match->config.players; i++) {
+    alive += table->isAlive[i];
+    if ((players >> i & 1) && table->isAlive[i] && table->state[i] == IDLE) {
+      bot->players[bot->numPlayers++] = i;
+    }
+  }
+  if (bot->numPlayers == 0) {
+    return 0;
+  }
+  bot->enemies = alive - 1;
+  SnapshotMatch(match, bot->root);
+  bot->start = getSearchTime();
+  for (int i = 0; i < bot->config.threads; i++) {
+    SubmitTask(bot->pool, searchTree, &bot->workers[i]);
+  }
+  WaitThreadPool(bot->pool);
+  // Sum the root statistics of all trees, the most visited action wins
+  int count = 0;
+  for (int d = 0; d < bot->numPlayers; d++) {
+    int visits[MCTS_ACTIONS] = {0};
+    for (int i = 0; i < bot->config.threads; i++) {
+      for (int a = 0; a < MCTS_ACTIONS; a++) {
+        visits[a] += bot->workers[i].visits[d][a];
+      }
+    }
+    int best = MCTS_WAIT;
+    for (int a = 0; a < MCTS_ACTIONS; a++) {
+      if (visits[a] > visits[best]) {
+        best = a;
+      }
+    }
+    if (best == MCTS_WAIT) {
+      continue;
+    }
+    Command *command = &commands[count++];
+    *command =
+        (Command){match->tick, bot->players[d], COMMAND_MOVE, (Direction)best};
+    if (best == MCTS_PLANT) {
+      command->type = COMMAND_PLANT;
+      command->direction = NORTH;
+    }
+  }
+  return count;
+}
+
+long GetMctsRollouts(MctsBot *bot) {
+  long rollouts = 0;
+  for (int i = 0; i < bot->config.threads; i++) {
+    rollouts += bot->workers[i].rollouts;
+  }
+  return rollouts;
+}
+
+// Takes the decisions of the batch round robin, every thread at least one,
+// and gives each of them an equal share of the budget
+void searchTree(void *arg) {
+  MctsWorker *worker = (MctsWorker *)arg;
+  MctsBot *bot = worker->bot;
+  threadLogLevel = LOG_LEVEL_WARN;
+  int threads = bot->config.threads;
+  int total = bot->numPlayers > threads ? bot->numPlayers : threads;
+  int shares = (total - 1 - worker->index) / threads + 1;
+  memset(worker->visits, 0, sizeof(worker->visits[0]) * bot->numPlayers);
+  int share = 0;
+  for (int j = worker->index; j < total; j += threads) {
+    int decision = j % bot->numPlayers;
+    worker->player = bot->players[decision];
+    share++;
+    growTree(worker, bot->start + bot->config.budget * share / shares);
+    MctsNode *nodes = worker->nodes;
+    for (int a = 0; a < MCTS_ACTIONS; a++) {
+      if (nodes[0].child[a] >= 0) {
+        worker->visits[decision][a] += nodes[nodes[0].child[a]].visits;
+      }
+    }
+  }
+}
+
+// Grows a new tree for the player of the worker until the deadline
+void growTree(MctsWorker *worker, double deadline) {
+  MctsBot *bot = worker->bot;
+  worker->numNodes = 1;
+  memset(&worker->nodes[0], 0, sizeof(MctsNode));
+  memset(worker->nodes[0].child, -1, sizeof(worker->nodes[0].child));
+  for (int i = 0;
+       bot->config.maxRollouts == 0 || i < bot->config.maxRollouts; i++) {
+    if (bot->config.budget > 0 && getSearchTime() >= deadline) {
+      break;
+    }
+    runIteration(worker);
+    worker->rollouts++;
+  }
+}
+
+// Selection and expansion down the tree, a rollout from the new leaf and
+// its score back up the path
+void runIteration(MctsWorker *worker) {
+  MctsBot *bot = worker->bot;
+  Match *match = worker->match;
+  MctsNode *nodes = worker->nodes;
+  RestoreMatch(match, bot->root);
+  double horizon = match->time + MCTS_HORIZON;
+  int path[MCTS_MAX_DEPTH];
+  int depth = 0;
+  int node = 0;
+  path[depth++] = node;
+  while (depth < MCTS_MAX_DEPTH && match->players.isAlive[worker->player] &&
+         !IsMatchOver(match) && match->time < horizon) {
+    int legal = getLegalActions(match, worker->player);
+    int untried = 0;
+    for (int a = 0; a < MCTS_ACTIONS; a++) {
+      if ((legal >> a & 1) && nodes[node].child[a] < 0) {
+        untried |= 1 << a;
+      }
+    }
+    if (untried == 0) {
+      int action = selectAction(worker, node, legal);
+      playAction(worker, action);
+      node = nodes[node].child[action];
+      path[depth++] = node;
+      continue;
+    }
+    // Expand one untried action, a full tree only plays it out
+    int action;
+    do {
+      action = mctsRand(&worker->rngState) % MCTS_ACTIONS;
+    } while (!(untried >> action & 1));
+    playAction(worker, action);
+    if (worker->numNodes < MCTS_MAX_NODES) {
+      int child = worker->numNodes++;
+      memset(&nodes[child], 0, sizeof(MctsNode));
+      memset(nodes[child].child, -1, sizeof(nodes[child].child));
+      nodes[node].child[action] = child;
+      path[depth++] = child;
+    }
+    break;
+  }
+  playRollout(worker, horizon);
+  float score = scoreRollout(match, worker->player, bot->enemies);
+  for (int i = 0; i < depth; i++) {
+    nodes[path[i]].visits++;
+    nodes[path[i]].value += score;
+  }
+}
+
+// Bit mask of the actions player can take, waiting always is one
+int getLegalActions(Match *match, int player) {
+  BoardLayers *layers = &match->layers;
+  PlayerTable *players = &match->players;
+  Position position = players->position[player];
+  int legal = 1 << MCTS_WAIT;
+  Position next[_DIRECTION_NUM] = {{position.x, position.y - 1},
+                                   {position.x + 1, position.y},
+                                   {position.x, position.y + 1},
+                                   {position.x - 1, position.y}};
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    if (!BoardTest(&layers->walls, next[d]) &&
+        !BoardTest(&layers->crates, next[d]) &&
+        !BoardTest(&layers->bombs, next[d])) {
+      legal |= 1 << d;
+    }
+  }
+  if (players->activeBombs[player] < players->bombs[player] &&
+      !BoardTest(&layers->bombs, position)) {
+    legal |= 1 << MCTS_PLANT;
+  }
+  return legal;
+}
+
+// UCT among the legal children of node, all of them expanded
+int selectAction(MctsWorker *worker, int node, int legal) {
+  MctsNode *nodes = worker->nodes;
+  double logVisits = log(nodes[node].visits);
+  int best = MCTS_WAIT;
+  double bestScore = -1;
+  for (int a = 0; a < MCTS_ACTIONS; a++) {
+    if (!(legal >> a & 1)) {
+      continue;
+    }
+    MctsNode *child = &nodes[nodes[node].child[a]];
+    double score = child->value / child->visits +
+                   MCTS_EXPLORATION * sqrt(logVisits / child->visits);
+    if (score > bestScore) {
+      best = a;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+// Issues the action and steps the match until the player may decide again
+void playAction(MctsWorker *worker, int action) {
+  Match *match = worker->match;
+  PlayerTable *players = &match->players;
+  int player = worker->player;
+  if (action < _DIRECTION_NUM) {
+    MovePlayer(match, player, (Direction)action);
+  } else if (action == MCTS_PLANT) {
+    PlantBomb(match, player);
+  }
+  // Waiting and planting take as long as a step
+  int ticks = (int)(TICK_RATE / players->speed[player]) + 1;
+  for (int tick = 1; tick <= 2 * TICK_RATE; tick++) {
+    playPolicy(match, player, 1, &worker->rngState);
+    StepMatch(match, TICK_TIME);
+    if (!players->isAlive[player] || IsMatchOver(match)) {
+      break;
+    }
+    if (players->state[player] == IDLE &&
+        (action < _DIRECTION_NUM || tick >= ticks)) {
+      break;
+    }
+  }
+}
+
+void playRollout(MctsWorker *worker, double horizon) {
+  Match *match = worker->match;
+  int player = worker->player;
+  while (match->time < horizon && match->players.isAlive[player] &&
+         !IsMatchOver(match)) {
+    playPolicy(match, player, 0, &worker->rngState);
+    StepMatch(match, TICK_TIME);
+  }
+}
+
+// Rollout policy: idle players wander and now and then plant, nobody walks
+// into flames. While the tree decides for player it is left out, in the
+// rollout it only wanders so all of its bombs are planted by the tree.
+void playPolicy(Match *match, int player, _Bool inTree,
+                unsigned int *state) {
+  PlayerTable *players = &match->players;
+  for (int i = 0; i < match->config.players; i++) {
+    if (!players->isAlive[i] || players->state[i] != IDLE ||
+        (inTree && i == player)) {
+      continue;
+    }
+    unsigned int r = mctsRand(state);
+    if (r % 4 != 0) {
+      continue;
+    }
+    if ((r >> 2) % 8 == 0 && i != player) {
+      PlantBomb(match, i);
+      continue;
+    }
+    Direction direction = (Direction)((r >> 5) % _DIRECTION_NUM);
+    Position position = players->position[i];
+    Position next[_DIRECTION_NUM] = {{position.x, position.y - 1},
+                                     {position.x + 1, position.y},
+                                     {position.x, position.y + 1},
+                                     {position.x - 1, position.y}};
+    if (!BoardTest(&match->layers.flames, next[direction])) {
+      MovePlayer(match, i, direction);
+    }
+  }
+}
+
+float scoreRollout(Match *match, int player, int enemies) {
+  if (!match->players.isAlive[player]) {
+    return 0;
+  }
+  int alive = 0;
+  for (int i = 0; i < match->config.players; i++) {
+    alive += i != player && match->players.isAlive[i];
+  }
+  return 1.0f - 0.5f * alive / enemies;
+}
+
+unsigned int mctsRand(unsigned int *state) {
+  // xorshift32
+  unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+double getSearchTime() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
@@ -0,0 +1,60 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include "record.h"
+#include "sim.h"
+
+// Monte-Carlo tree search bot for the strong difficulty. A decision is
+// taken whenever the player stands, from six actions: the four moves,
+// planting and waiting for one step. Moves last until the player has
+// arrived, planting and waiting as long as a step would.
+//
+// The search is root parallel: every thread grows its own tree from the
+// same root state on its own clone of the match and the root statistics
+// are summed at the end, so threads share nothing while they search.
+// PlanMctsCommands decides for several players in one batch: the threads
+// take the decisions round robin and split the budget among the decisions
+// they got, so the whole batch takes the budget once.
+// Rollouts play every player with a cheap random policy that does not walk
+// into flames, up to MCTS_HORIZON seconds past the root. A rollout scores
+// 0 if the player died, otherwise more the fewer enemies are left.
+//
+// BOT_LEVEL=strong plays the bots of a local match with it, MCTS_BUDGET sets
+// the search time per tick for all bots together in milliseconds.
+
+#define MCTS_ACTIONS 6
+#define MCTS_PLANT 4
+#define MCTS_WAIT 5
+// Seconds a rollout looks past the root, longer than a fuse
+#define MCTS_HORIZON 4.0
+#define MCTS_DEFAULT_BUDGET 4
+// Tree nodes per thread
+#define MCTS_MAX_NODES (1 << 15)
+
+typedef struct {
+  int threads;
+  // Search time per call in seconds, 0 for no limit
+  double budget;
+  // Rollouts per decision a thread takes, 0 for no limit
+  int maxRollouts;
+} MctsConfig;
+
+typedef struct MctsBot MctsBot;
+
+// The bot searches matches of the config of match. NULL if the config has
+// neither a budget nor a rollout limit, or if a thread or an allocation
+// fails.
+MctsBot *CreateMctsBot(Match *match, MctsConfig config);
+void FreeMctsBot(MctsBot *bot);
+
+// Returns 1 and the command if player acts this tick, as PlanBotCommand
+_Bool PlanMctsCommand(MctsBot *bot, Match *match, int player,
+                      Command *command);
+// Plans for every player in the mask that decides this tick, returns the
+// number of commands written
+int PlanMctsCommands(MctsBot *bot, Match *match, uint64_t players,
+                     Command *commands);
+
+// Rollouts of every thread since the bot was created
+long GetMctsRollouts(MctsBot *bot);
+#endif // MCTS_H
@@ -0,0 +1,752 @@
+#define _POSIX_C_SOURCE 200809L
+#include "net.h"
+#include "log.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// Packets, little endian: magic, type, player, round, then for a hello the
+// proposed width, height, players and seed, for inputs the first tick the
+// sender is missing from the receiver, the first tick and count of the
+// inputs that follow, and the tick and hash of the sender's last sync
+// point. Inputs are resent until acknowledged, so a lost packet only costs
+// time.
+#define NET_MAGIC 0x504e4d42 // "BMNP"
+#define PACKET_HELLO 0
+#define PACKET_INPUT 1
+#define NET_MAX_PACKET 512
+#define NET_HEADER_SIZE 8
+#define NET_MAX_INPUTS 255
+// Ticks of input kept, must hold the rollback window plus the inputs peers
+// may send ahead of it
+#define NET_INPUT_WINDOW 128
+#define NET_MAX_DELAY 8
+#define NET_SNAPSHOTS (NET_MAX_ROLLBACK + 1)
+// Milliseconds between hellos while connecting
+#define NET_HELLO_INTERVAL 100
+// Every this many ticks peers compare the hash of their final state
+#define NET_SYNC_INTERVAL 60
+#define NET_SYNC_HISTORY 8
+#define NET_DELAY_QUEUE 256
+// Milliseconds between warnings about a peer that holds up the match
+#define NET_STALL_WARNING 1000
+
+typedef struct {
+  double due;
+  int peer;
+  int length;
+  uint8_t data[NET_MAX_PACKET];
+} DelayedPacket;
+
+struct NetSession {
+  NetConfig config;
+  int socket;
+  struct sockaddr_in address[NET_MAX_PEERS];
+  // Counts matches, packets of another round are ignored
+  uint16_t round;
+  _Bool playing;
+  // Handshake
+  _Bool ready[NET_MAX_PEERS];
+  _Bool hasProposal;
+  MatchConfig proposal;
+  unsigned int proposalSeed;
+  double lastHello;
+  // Inputs by tick modulo NET_INPUT_WINDOW and player
+  uint8_t inputs[NET_INPUT_WINDOW][NET_MAX_PEERS];
+  // Inputs a tick was simulated with, predicted where they were missing
+  uint8_t used[NET_INPUT_WINDOW][NET_MAX_PEERS];
+  // Inputs of every tick before received are known
+  long received[NET_MAX_PEERS];
+  // The peer knows our inputs of every tick before acked
+  long acked[NET_MAX_PEERS];
+  // Earliest tick simulated with a wrong prediction, -1 if there is none
+  long rollbackTick;
+  uint8_t pending;
+  // Match state before a tick, by tick modulo NET_SNAPSHOTS
+  void *snapshots[NET_SNAPSHOTS];
+  size_t snapshotSize;
+  Recording *recording;
+  long recordedTick;
+  // Hashes of final states, by sync point modulo NET_SYNC_HISTORY
+  long syncTick[NET_SYNC_HISTORY];
+  uint64_t syncHash[NET_SYNC_HISTORY];
+  long lastSyncTick;
+  double lastStallWarning;
+  double lastSend;
+  // Network simulation, drawn from its own state so it never touches the
+  // match
+  unsigned int rngState;
+  int numDelayed;
+  DelayedPacket delayed[NET_DELAY_QUEUE];
+  NetStats stats;
+};
+
+// Config
+_Bool parsePeers(NetConfig *config, const char *peers);
+_Bool resolveAddress(const char *host, int port, struct sockaddr_in *address);
+
+// Simulation
+void simulateTick(NetSession *session, Match *match);
+uint8_t predictInput(NetSession *session, int player);
+void rollback(NetSession *session, Match *match);
+long confirmedTick(NetSession *session);
+void recordConfirmed(NetSession *session, long tick);
+void storeSyncHash(NetSession *session, Match *match);
+void warnStall(NetSession *session);
+
+// Packets
+void receivePackets(NetSession *session, Match *match);
+void handleHello(NetSession *session, int player, const uint8_t *data,
+                 int length);
+void handleInputs(NetSession *session, Match *match, int player,
+                  const uint8_t *data, int length);
+void sendHello(NetSession *session, int peer);
+void sendAllInputs(NetSession *session, _Bool force);
+void sendInputs(NetSession *session, int peer, uint16_t round);
+void sendPacket(NetSession *session, int peer, const uint8_t *data,
+                int length);
+void flushDelayed(NetSession *session);
+int writeHeader(uint8_t *data, int type, int player, uint16_t round);
+void putUint(uint8_t *data, uint64_t value, int bytes);
+uint64_t getUint(const uint8_t *data, int bytes);
+unsigned int nextNetRandom(NetSession *session);
+double getNetTime();
+
+_Bool LoadNetConfig(NetConfig *config) {
+  const char *peers = getenv("NET_PEERS");
+  if (peers == NULL) {
+    return 0;
+  }
+  *config = (NetConfig){.delay = NET_DEFAULT_DELAY};
+  if (!parsePeers(config, peers)) {
+    LOG_ERROR("Invalid NET_PEERS: %s", peers);
+    return 0;
+  }
+  if (getenv("NET_PLAYER")) {
+    config->player = atoi(getenv("NET_PLAYER"));
+  }
+  if (getenv("NET_DELAY")) {
+    config->delay = atoi(getenv("NET_DELAY"));
+  }
+  if (getenv("NET_LOSS")) {
+    config->loss = atof(getenv("NET_LOSS"));
+  }
+  if (getenv("NET_LATENCY")) {
+    config->latency = atoi(getenv("NET_LATENCY"));
+  }
+  if (getenv("NET_JITTER")) {
+    config->jitter = atoi(getenv("NET_JITTER"));
+  }
+  if (config->player < 0 || config->player >= config->numPeers) {
+    LOG_ERROR("NET_PLAYER %i is not in NET_PEERS!", config->player);
+    return 0;
+  }
+  if (config->delay < 0 || config->delay > NET_MAX_DELAY) {
+    LOG_WARN("NET_DELAY out of range, using %i", NET_DEFAULT_DELAY);
+    config->delay = NET_DEFAULT_DELAY;
+  }
+  return 1;
+}
+
+// Comma separated host:port list, the port defaults to NET_DEFAULT_PORT
+_Bool parsePeers(NetConfig *config, const char *peers) {
+  config->numPeers = 0;
+  const char *entry = peers;
+  while (*entry != '\0') {
+    if (config->numPeers == NET_MAX_PEERS) {
+      return 0;
+    }
+    size_t length = strcspn(entry, ",");
+    if (length == 0 || length >= sizeof(config->host[0])) {
+      return 0;
+    }
+    char *host = config->host[config->numPeers];
+    memcpy(host, entry, length);
+    host[length] = '\0';
+    char *colon = strrchr(host, ':');
+    int port = NET_DEFAULT_PORT;
+    if (colon != NULL) {
+      *colon = '\0';
+      port = atoi(colon + 1);
+    }
+    if (port <= 0 || port > 65535) {
+      return 0;
+    }
+    config->port[config->numPeers++] = port;
+    entry += length;
+    if (*entry == ',') {
+      entry++;
+    }
+  }
+  return config->numPeers > 1;
+}
+
+NetSession *CreateNetSession(NetConfig *config) {
+  NetSession *session = (NetSession *)calloc(1, sizeof(NetSession));
+  if (session == NULL) {
+    LOG_ERROR("Allocation of net session failed!", NULL);
+    return NULL;
+  }
+  session->config = *config;
+  session->rngState = (unsigned int)time(NULL) ^ (config->player + 1);
+  for (int i = 0; i < config->numPeers; i++) {
+    if (!resolveAddress(config->host[i], config->port[i],
+                        &session->address[i])) {
+      LOG_ERROR("Cannot resolve peer %s", config->host[i]);
+      free(session);
+      return NULL;
+    }
+  }
+  session->socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (session->socket < 0) {
+    LOG_ERROR("Cannot create socket: %s", strerror(errno));
+    free(session);
+    return NULL;
+  }
+  struct sockaddr_in local = {.sin_family = AF_INET,
+                              .sin_addr.s_addr = htonl(INADDR_ANY),
+                              .sin_port = htons(config->port[config->player])};
+  if (bind(session->socket, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+      fcntl(session->socket, F_SETFL, O_NONBLOCK) < 0) {
+    LOG_ERROR("Cannot bind port %i: %s", config->port[config->player],
+              strerror(errno));
+    close(session->socket);
+    free(session);
+    return NULL;
+  }
+  LOG_INFO("Net player %i of %i on port %i, input delay %i", config->player,
+           config->numPeers, config->port[config->player], config->delay);
+  return session;
+}
+
+_Bool resolveAddress(const char *host, int port, struct sockaddr_in *address) {
+  *address = (struct sockaddr_in){.sin_family = AF_INET,
+                                  .sin_port = htons(port)};
+  if (inet_pton(AF_INET, host, &address->sin_addr) == 1) {
+    return 1;
+  }
+  struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+  struct addrinfo *result;
+  if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+    return 0;
+  }
+  address->sin_addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr;
+  freeaddrinfo(result);
+  return 1;
+}
+
+void FreeNetSession(NetSession *session) {
+  if (session == NULL) {
+    return;
+  }
+  close(session->socket);
+  for (int i = 0; i < NET_SNAPSHOTS; i++) {
+    free(session->snapshots[i]);
+  }
+  free(session);
+}
+
+_Bool NetConnect(NetSession *session, MatchConfig *config, unsigned int *seed) {
+  NetConfig *net = &session->config;
+  if (session->playing) {
+    // Leaving a match, its inputs are still acknowledged for peers that
+    // have not finished yet
+    session->playing = 0;
+    session->recording = NULL;
+    session->round++;
+    session->hasProposal = 0;
+    memset(session->ready, 0, sizeof(session->ready));
+    session->lastHello = 0;
+  }
+  if (net->player == 0) {
+    if (config->players < net->numPeers) {
+      config->players = net->numPeers;
+    }
+    session->proposal = *config;
+    session->proposalSeed = *seed;
+    session->hasProposal = 1;
+  }
+  session->ready[net->player] = 1;
+  double now = getNetTime();
+  if (now - session->lastHello >= NET_HELLO_INTERVAL) {
+    session->lastHello = now;
+    for (int i = 0; i < net->numPeers; i++) {
+      if (i != net->player) {
+        sendHello(session, i);
+      }
+    }
+  }
+  receivePackets(session, NULL);
+  flushDelayed(session);
+  for (int i = 0; i < net->numPeers; i++) {
+    if (!session->ready[i]) {
+      return 0;
+    }
+  }
+  if (!session->hasProposal) {
+    return 0;
+  }
+  *config = session->proposal;
+  *seed = session->proposalSeed;
+  return 1;
+}
+
+_Bool NetStartMatch(NetSession *session, Match *match, Recording *recording) {
+  NetConfig *net = &session->config;
+  if (match->config.players < net->numPeers) {
+    LOG_WARN("Only %i of %i peers have a player", match->config.players,
+             net->numPeers);
+  }
+  if (session->snapshotSize != match->size) {
+    // The old snapshots stay until all new ones are there
+    void *snapshots[NET_SNAPSHOTS];
+    _Bool failed = 0;
+    for (int i = 0; i < NET_SNAPSHOTS; i++) {
+      snapshots[i] = malloc(match->size);
+      failed |= snapshots[i] == NULL;
+    }
+    if (failed) {
+      LOG_ERROR("Allocation of net snapshots failed!", NULL);
+      for (int i = 0; i < NET_SNAPSHOTS; i++) {
+        free(snapshots[i]);
+      }
+      return 0;
+    }
+    for (int i = 0; i < NET_SNAPSHOTS; i++) {
+      free(session->snapshots[i]);
+      session->snapshots[i] = snapshots[i];
+    }
+    session->snapshotSize = match->size;
+  }
+  memset(session->inputs, 0, sizeof(session->inputs));
+  memset(session->used, 0, sizeof(session->used));
+  for (int i = 0; i < NET_MAX_PEERS; i++) {
+    session->received[i] = 0;
+    session->acked[i] = 0;
+  }
+  // The first ticks of the delay carry no local input
+  session->received[net->player] = match->tick + net->delay;
+  for (int i = 0; i < NET_SYNC_HISTORY; i++) {
+    session->syncTick[i] = -1;
+  }
+  session->lastSyncTick = -1;
+  session->rollbackTick = -1;
+  session->pending = 0;
+  session->recording = recording;
+  session->recordedTick = match->tick;
+  session->playing = 1;
+  LOG_INFO("Net match %i started with seed %u", session->round, match->seed);
+  return 1;
+}
+
+void NetQueueCommand(NetSession *session, Command command) {
+  session->pending = AddInputCommand(session->pending, command);
+}
+
+_Bool NetStep(NetSession *session, Match *match) {
+  receivePackets(session, match);
+  rollback(session, match);
+  NetConfig *net = &session->config;
+  _Bool step = match->tick - confirmedTick(session) < NET_MAX_ROLLBACK;
+  if (step) {
+    long tick = match->tick + net->delay;
+    session->inputs[tick % NET_INPUT_WINDOW][net->player] = session->pending;
+    session->received[net->player] = tick + 1;
+    session->pending = 0;
+    simulateTick(session, match);
+  } else {
+    session->stats.stalls++;
+    warnStall(session);
+  }
+  recordConfirmed(session, match->tick);
+  // Also while waiting, the peers may miss our inputs and acks just the same
+  sendAllInputs(session, 1);
+  flushDelayed(session);
+  return step;
+}
+
+void NetPoll(NetSession *session, Match *match) {
+  receivePackets(session, match);
+  rollback(session, match);
+  recordConfirmed(session, match->tick);
+  sendAllInputs(session, 0);
+  flushDelayed(session);
+}
+
+_Bool NetSettled(NetSession *session, long tick) {
+  if (confirmedTick(session) < tick) {
+    return 0;
+  }
+  for (int i = 0; i < session->config.numPeers; i++) {
+    if (i != session->config.player && session->acked[i] < tick) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+NetStats GetNetStats(NetSession *session) { return session->stats; }
+
+// Steps the match with the known inputs and predicts the missing ones
+void simulateTick(NetSession *session, Match *match) {
+  long tick = match->tick;
+  SnapshotMatch(match, session->snapshots[tick % NET_SNAPSHOTS]);
+  int players = session->config.numPeers;
+  if (players > match->config.players) {
+    players = match->config.players;
+  }
+  for (int i = 0; i < players; i++) {
+    uint8_t input = tick < session->received[i]
+                        ? session->inputs[tick % NET_INPUT_WINDOW][i]
+                        : predictInput(session, i);
+    session->used[tick % NET_INPUT_WINDOW][i] = input;
+    ApplyInput(match, i, input);
+  }
+  StepMatch(match, TICK_TIME);
+  if (tick < confirmedTick(session) && match->tick % NET_SYNC_INTERVAL == 0) {
+    storeSyncHash(session, match);
+  }
+}
+
+// Players mostly keep walking the way they did, bombs are rare and not
+// repeated
+uint8_t predictInput(NetSession *session, int player) {
+  long last = session->received[player] - 1;
+  if (last < 0) {
+    return 0;
+  }
+  return session->inputs[last % NET_INPUT_WINDOW][player] & ~INPUT_PLANT;
+}
+
+void rollback(NetSession *session, Match *match) {
+  long from = session->rollbackTick;
+  session->rollbackTick = -1;
+  if (from < 0 || from >= match->tick) {
+    return;
+  }
+  long to = match->tick;
+  RestoreMatch(match, session->snapshots[from % NET_SNAPSHOTS]);
+  session->stats.rollbacks++;
+  while (match->tick < to) {
+    simulateTick(session, match);
+    session->stats.resimulatedTicks++;
+  }
+}
+
+long confirmedTick(NetSession *session) {
+  long tick = session->received[0];
+  for (int i = 1; i < session->config.numPeers; i++) {
+    if (session->received[i] < tick) {
+      tick = session->received[i];
+    }
+  }
+  return tick;
+}
+
+// Appends the commands of the ticks every input is known for, up to tick
+void recordConfirmed(NetSession *session, long tick) {
+  long confirmed = confirmedTick(session);
+  if (confirmed < tick) {
+    tick = confirmed;
+  }
+  for (; session->recordedTick < tick; session->recordedTick++) {
+    long t = session->recordedTick;
+    if (session->recording == NULL) {
+      continue;
+    }
+    for (int i = 0; i < session->config.numPeers; i++) {
+      uint8_t input = session->inputs[t % NET_INPUT_WINDOW][i];
+      if (input & INPUT_MOVE) {
+        Direction direction = (Direction)(input & INPUT_DIRECTION);
+        RecordCommand(session->recording,
+                      (Command){t, i, COMMAND_MOVE, direction});
+      }
+      if (input & INPUT_PLANT) {
+        RecordCommand(session->recording,
+                      (Command){.tick = t, .player = i, .type = COMMAND_PLANT});
+      }
+    }
+  }
+}
+
+void storeSyncHash(NetSession *session, Match *match) {
+  int slot = match->tick / NET_SYNC_INTERVAL % NET_SYNC_HISTORY;
+  session->syncTick[slot] = match->tick;
+  session->syncHash[slot] = HashMatch(match);
+  if (match->tick > session->lastSyncTick) {
+    session->lastSyncTick = match->tick;
+  }
+}
+
+void warnStall(NetSession *session) {
+  double now = getNetTime();
+  if (now - session->lastStallWarning < NET_STALL_WARNING) {
+    return;
+  }
+  session->lastStallWarning = now;
+  long confirmed = confirmedTick(session);
+  for (int i = 0; i < session->config.numPeers; i++) {
+    if (session->received[i] == confirmed) {
+      LOG_WARN("Waiting for inputs of player %i", i);
+    }
+  }
+}
+
+// Without a match only handshake packets are taken
+void receivePackets(NetSession *session, Match *match) {
+  uint8_t data[NET_MAX_PACKET];
+  for (;;) {
+    struct sockaddr_in from;
+    socklen_t fromLength = sizeof(from);
+    ssize_t length = recvfrom(session->socket, data, sizeof(data), 0,
+                              (struct sockaddr *)&from, &fromLength);
+    if (length < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        LOG_WARN("Receive failed: %s", strerror(errno));
+      }
+      return;
+    }
+    if (length < NET_HEADER_SIZE || getUint(data, 4) != NET_MAGIC) {
+      continue;
+    }
+    int type = data[4];
+    int player = data[5];
+    uint16_t round = getUint(data + 6, 2);
+    if (player >= session->config.numPeers ||
+        player == session->config.player) {
+      continue;
+    }
+    struct sockaddr_in *peer = &session->address[player];
+    if (from.sin_port != peer->sin_port ||
+        from.sin_addr.s_addr != peer->sin_addr.s_addr) {
+      continue;
+    }
+    session->stats.packetsReceived++;
+    if (type == PACKET_HELLO && round == session->round) {
+      handleHello(session, player, data + NET_HEADER_SIZE,
+                  length - NET_HEADER_SIZE);
+    } else if (type == PACKET_INPUT && round == session->round &&
+               session->playing && match != NULL) {
+      handleInputs(session, match, player, data + NET_HEADER_SIZE,
+                   length - NET_HEADER_SIZE);
+    } else if (type == PACKET_INPUT && !session->playing &&
+               (uint16_t)(round + 1) == session->round) {
+      // The peer still finishes the last match and waits for our ack
+      sendInputs(session, player, round);
+    }
+  }
+}
+
+void handleHello(NetSession *session, int player, const uint8_t *data,
+                 int length) {
+  if (length < 9) {
+    return;
+  }
+  if (player == 0) {
+    session->proposal = (MatchConfig){getUint(data, 2), getUint(data + 2, 2),
+                                      data[4]};
+    session->proposalSeed = getUint(data + 5, 4);
+    session->hasProposal = 1;
+  }
+  if (!session->ready[player] || session->playing) {
+    // Answer so the peer learns of us even if our hellos were lost
+    sendHello(session, player);
+  }
+  session->ready[player] = 1;
+}
+
+void handleInputs(NetSession *session, Match *match, int player,
+                  const uint8_t *data, int length) {
+  if (length < 21) {
+    return;
+  }
+  long acked = getUint(data, 4);
+  if (acked > session->acked[player]) {
+    session->acked[player] = acked;
+  }
+  long start = getUint(data + 4, 4);
+  int count = data[8];
+  if (length < 21 + count) {
+    return;
+  }
+  const uint8_t *inputs = data + 9;
+  for (int i = 0; i < count; i++) {
+    long tick = start + i;
+    if (tick < session->received[player]) {
+      continue;
+    }
+    // A gap means a lost packet, the peer sends the inputs again
+    if (tick > session->received[player] ||
+        tick - session->recordedTick >= NET_INPUT_WINDOW - 1) {
+      break;
+    }
+    int slot = tick % NET_INPUT_WINDOW;
+    session->inputs[slot][player] = inputs[i];
+    if (tick < match->tick && session->used[slot][player] != inputs[i] &&
+        (session->rollbackTick < 0 || tick < session->rollbackTick)) {
+      session->rollbackTick = tick;
+    }
+    session->received[player] = tick + 1;
+  }
+  const uint8_t *sync = inputs + count;
+  long syncTick = (long)(int32_t)getUint(sync, 4);
+  if (syncTick < 0) {
+    return;
+  }
+  int slot = syncTick / NET_SYNC_INTERVAL % NET_SYNC_HISTORY;
+  if (session->syncTick[slot] == syncTick &&
+      session->syncHash[slot] != getUint(sync + 4, 8)) {
+    session->stats.desyncs++;
+    LOG_ERROR("Desync with player %i at tick %li!", player, syncTick);
+  }
+}
+
+void sendHello(NetSession *session, int peer) {
+  uint8_t data[NET_MAX_PACKET];
+  int length = writeHeader(data, PACKET_HELLO, session->config.player,
+                           session->round);
+  MatchConfig *config = &session->proposal;
+  putUint(data + length, config->width, 2);
+  putUint(data + length + 2, config->height, 2);
+  data[length + 4] = config->players;
+  putUint(data + length + 5, session->proposalSeed, 4);
+  sendPacket(session, peer, data, length + 9);
+}
+
+// Unless forced at most once per tick
+void sendAllInputs(NetSession *session, _Bool force) {
+  double now = getNetTime();
+  if (!force && now - session->lastSend < 1000.0 / TICK_RATE) {
+    return;
+  }
+  session->lastSend = now;
+  for (int i = 0; i < session->config.numPeers; i++) {
+    if (i != session->config.player) {
+      sendInputs(session, i, session->round);
+    }
+  }
+}
+
+// Every local input the peer has not acknowledged yet
+void sendInputs(NetSession *session, int peer, uint16_t round) {
+  uint8_t data[NET_MAX_PACKET];
+  int length = writeHeader(data, PACKET_INPUT, session->config.player, round);
+  int local = session->config.player;
+  long start = session->acked[peer];
+  long end = session->received[local];
+  if (start < end - NET_INPUT_WINDOW + 1) {
+    start = end - NET_INPUT_WINDOW + 1;
+  }
+  if (start > end) {
+    start = end;
+  }
+  if (end - start > NET_MAX_INPUTS) {
+    end = start + NET_MAX_INPUTS;
+  }
+  putUint(data + length, session->received[peer], 4);
+  putUint(data + length + 4, start, 4);
+  data[length + 8] = end - start;
+  length += 9;
+  for (long tick = start; tick < end; tick++) {
+    data[length++] = session->inputs[tick % NET_INPUT_WINDOW][local];
+  }
+  putUint(data + length, (uint32_t)session->lastSyncTick, 4);
+  uint64_t hash = 0;
+  if (session->lastSyncTick >= 0) {
+    int slot = session->lastSyncTick / NET_SYNC_INTERVAL % NET_SYNC_HISTORY;
+    hash = session->syncHash[slot];
+  }
+  putUint(data + length + 4, hash, 8);
+  sendPacket(session, peer, data, length + 12);
+}
+
+// Goes through the network simulation if one is configured
+void sendPacket(NetSession *session, int peer, const uint8_t *data,
+                int length) {
+  NetConfig *net = &session->config;
+  if (net->loss > 0 && nextNetRandom(session) % 10000 < net->loss * 10000) {
+    session->stats.packetsDropped++;
+    return;
+  }
+  if (net->latency > 0 || net->jitter > 0) {
+    if (session->numDelayed == NET_DELAY_QUEUE) {
+      session->stats.packetsDropped++;
+      return;
+    }
+    DelayedPacket *packet = &session->delayed[session->numDelayed++];
+    int jitter = net->jitter > 0 ? nextNetRandom(session) % net->jitter : 0;
+    packet->due = getNetTime() + net->latency + jitter;
+    packet->peer = peer;
+    packet->length = length;
+    memcpy(packet->data, data, length);
+    return;
+  }
+  sendto(session->socket, data, length, 0,
+         (struct sockaddr *)&session->address[peer],
+         sizeof(session->address[peer]));
+  session->stats.packetsSent++;
+}
+
+void flushDelayed(NetSession *session) {
+  double now = getNetTime();
+  int kept = 0;
+  for (int i = 0; i < session->numDelayed; i++) {
+    DelayedPacket *packet = &session->delayed[i];
+    if (packet->due > now) {
+      session->delayed[kept++] = *packet;
+      continue;
+    }
+    sendto(session->socket, packet->data, packet->length, 0,
+           (struct sockaddr *)&session->address[packet->peer],
+           sizeof(session->address[packet->peer]));
+    session->stats.packetsSent++;
+  }
+  session->numDelayed = kept;
+}
+
+int writeHeader(uint8_t *data, int type, int player, uint16_t round) {
+  putUint(data, NET_MAGIC, 4);
+  data[4] = type;
+  data[5] = player;
+  putUint(data + 6, round, 2);
+  return NET_HEADER_SIZE;
+}
+
+void putUint(uint8_t *data, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    data[i] = value >> (8 * i);
+  }
+}
+
+uint64_t getUint(const uint8_t *data, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value |= (uint64_t)data[i] << (8 * i);
+  }
+  return value;
+}
+
+unsigned int nextNetRandom(NetSession *session) {
+  // xorshift32
+  unsigned int x = session->rngState ? session->rngState : 1;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  session->rngState = x;
+  return x;
+}
+
+// Monotonic milliseconds
+double getNetTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
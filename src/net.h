@@ -0,0 +1,84 @@
+#ifndef NET_H
+#define NET_H
+
+#include "record.h"
+#include "sim.h"
+
+// Peer-to-peer rollback netcode over UDP. Every peer steps its own copy of
+// the match and only exchanges inputs. Inputs of remote players that have
+// not arrived yet are predicted; once the real input of an already
+// simulated tick turns out different, the match is restored to a snapshot
+// of that tick and the ticks since are simulated again.
+//
+// Every peer is started with the same address list, player i is the peer at
+// entry i:
+//
+//   NET_PEERS=127.0.0.1:7000,127.0.0.1:7001 NET_PLAYER=0 ./main
+//   NET_PEERS=127.0.0.1:7000,127.0.0.1:7001 NET_PLAYER=1 ./main
+//
+// NET_DELAY sets the local input delay in ticks. NET_LOSS (0 to 1),
+// NET_LATENCY and NET_JITTER (ms) simulate a bad network on outgoing
+// packets.
+
+#define NET_MAX_PEERS 8
+// Ticks the match may run ahead of the inputs of the slowest peer. A peer
+// further ahead waits, so this is the longest rollback.
+#define NET_MAX_ROLLBACK 16
+#define NET_DEFAULT_DELAY 2
+#define NET_DEFAULT_PORT 7000
+
+typedef struct {
+  int numPeers;
+  // IPv4 address and port of every peer in player order
+  char host[NET_MAX_PEERS][64];
+  int port[NET_MAX_PEERS];
+  // Player of this peer, its entry in the list is the bound port
+  int player;
+  int delay;
+  // Network simulation for outgoing packets
+  float loss;
+  int latency;
+  int jitter;
+} NetConfig;
+
+typedef struct {
+  long rollbacks;
+  long resimulatedTicks;
+  // Ticks not stepped because a peer fell behind
+  long stalls;
+  long packetsSent;
+  long packetsReceived;
+  long packetsDropped;
+  // Sync checks against peers that disagreed
+  long desyncs;
+} NetStats;
+
+typedef struct NetSession NetSession;
+
+// Reads the NET_ variables, 0 if NET_PEERS is not set
+_Bool LoadNetConfig(NetConfig *config);
+// NULL if the socket cannot be bound
+NetSession *CreateNetSession(NetConfig *config);
+void FreeNetSession(NetSession *session);
+
+// Handshake for the next match, call once per frame until it returns 1.
+// config and seed propose a match and hold the one of player 0 on return.
+_Bool NetConnect(NetSession *session, MatchConfig *config, unsigned int *seed);
+// Starts the match agreed on by NetConnect. Commands are appended to
+// recording in tick order once every peer's input for the tick is known.
+// Returns 0 if the rollback snapshots cannot be allocated.
+_Bool NetStartMatch(NetSession *session, Match *match, Recording *recording);
+
+// Command of the local player for the next tick. A tick carries at most one
+// move and one plant, later moves of the same tick are dropped.
+void NetQueueCommand(NetSession *session, Command command);
+// Exchanges inputs, rolls back mispredicted ticks and advances the match by
+// one tick. Returns 0 without stepping while a peer is too far behind.
+_Bool NetStep(NetSession *session, Match *match);
+// Exchanges inputs and rolls back without advancing
+void NetPoll(NetSession *session, Match *match);
+// 1 once every peer has the inputs of every tick before tick
+_Bool NetSettled(NetSession *session, long tick);
+
+NetStats GetNetStats(NetSession *session);
+#endif // NET_H
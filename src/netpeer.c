@@ -0,0 +1,107 @@
+#define _POSIX_C_SOURCE 200809L
+#include "clock.h"
+#include "log.h"
+#include "net.h"
+#include "rand.h"
+#include "record.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Headless netplay peer. Plays the random policy for its player at the real
+// tick rate and prints the hash of the final state, every peer of a session
+// has to print the same one. Start one per entry of NET_PEERS:
+//
+//   NET_PEERS=127.0.0.1:7000,127.0.0.1:7001 NET_PLAYER=0 ./netpeer [ticks]
+//
+// NET_LOSS, NET_LATENCY and NET_JITTER simulate the network, see net.h.
+
+#define DEFAULT_TICKS 1800
+// Seconds to wait for the other peers
+#define CONNECT_TIMEOUT 30
+// Seconds the finished peer keeps answering peers that are still waiting
+#define LINGER_TIME 1
+
+
+int main(int argc, char *argv[]) {
+  currentLogLevel = LOG_LEVEL_WARN;
+  NetConfig config;
+  if (!LoadNetConfig(&config)) {
+    fprintf(stderr, "usage: NET_PEERS=host:port,... NET_PLAYER=n %s [ticks]\n",
+            argv[0]);
+    return 1;
+  }
+  long ticks = argc > 1 ? atol(argv[1]) : DEFAULT_TICKS;
+  NetSession *session = CreateNetSession(&config);
+  if (session == NULL) {
+    return 1;
+  }
+  MatchConfig matchConfig = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE,
+                             DEFAULT_PLAYERS};
+  unsigned int seed = (unsigned int)time(NULL);
+  double start = GetWallTime();
+  while (!NetConnect(session, &matchConfig, &seed)) {
+    if (GetWallTime() - start > CONNECT_TIMEOUT) {
+      fprintf(stderr, "player %i: peers did not connect\n", config.player);
+      return 1;
+    }
+    SleepUntil(GetWallTime() + TICK_TIME);
+  }
+  Match *match = InitMatchWithConfig(matchConfig, seed);
+  Recording *recording = CreateRecording(matchConfig, seed);
+  if (match == NULL || recording == NULL ||
+      !NetStartMatch(session, match, recording)) {
+    return 1;
+  }
+
+  unsigned int policyState = seed ^ (config.player + 1) * 2654435761u;
+  int player = config.player;
+  double next = GetWallTime();
+  while (match->tick < ticks) {
+    PlayerTable *players = &match->players;
+    if (players->isAlive[player] && players->state[player] == IDLE) {
+      unsigned int r = NextRandom(&policyState);
+      if (r % 8 == 0 && (r >> 3) % 5 == 0) {
+        NetQueueCommand(session, (Command){.type = COMMAND_PLANT});
+      } else if (r % 8 == 0) {
+        Direction direction = (Direction)((r >> 6) % _DIRECTION_NUM);
+        NetQueueCommand(session, (Command){.type = COMMAND_MOVE,
+                                           .direction = direction});
+      }
+    }
+    NetStep(session, match);
+    next += TICK_TIME;
+    SleepUntil(next);
+  }
+  while (!NetSettled(session, match->tick)) {
+    NetPoll(session, match);
+    SleepUntil(GetWallTime() + 0.001);
+  }
+  double seconds = GetWallTime() - start;
+  // Leaving the match answers the acks peers may still wait for
+  double linger = GetWallTime() + LINGER_TIME;
+  while (GetWallTime() < linger) {
+    NetConnect(session, &matchConfig, &seed);
+    SleepUntil(GetWallTime() + 0.001);
+  }
+
+  FinishRecording(recording, match);
+  Match *replay = ReplayRecording(recording);
+  _Bool replayed = replay != NULL && HashMatch(replay) == recording->hash;
+  NetStats stats = GetNetStats(session);
+  printf("player %i: tick %ld hash %016llx in %.1f s, %ld rollbacks, %ld "
+         "resimulated, %ld stalls, %ld sent, %ld received, %ld dropped, %ld "
+         "desyncs, replay %s\n",
+         player, match->tick, (unsigned long long)recording->hash, seconds,
+         stats.rollbacks, stats.resimulatedTicks, stats.stalls,
+         stats.packetsSent, stats.packetsReceived, stats.packetsDropped,
+         stats.desyncs, replayed ? "ok" : "MISMATCH");
+  if (replay != NULL) {
+    FreeMatch(replay);
+  }
+  FreeRecording(recording);
+  FreeMatch(match);
+  FreeNetSession(session);
+  return !replayed || stats.desyncs > 0;
+}
@@ -0,0 +1,18 @@
+#include "atlas.h"
+#include <stdio.h>
+
+// Build step: packs the sprites of a directory into one archive of decoded
+// pages, so the game maps a single file instead of opening and inflating
+// every PNG at startup.
+//
+//   ./pack [directory] [archive]
+
+int main(int argc, char *argv[]) {
+  const char *directory = argc > 1 ? argv[1] : "assets";
+  const char *archive = argc > 2 ? argv[2] : "assets" ATLAS_ARCHIVE_EXTENSION;
+  if (!PackAtlas(directory, archive)) {
+    fprintf(stderr, "usage: %s [directory] [archive]\n", argv[0]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,277 @@
+#include "pool.h"
+#include "log.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+typedef struct {
+  TaskFunction function;
+  void *arg;
+} Task;
+
+typedef struct {
+  pthread_mutex_t lock;
+  Task *tasks;
+  // Ring buffer indices, capacity is a power of two
+  int capacity;
+  int top;
+  int bottom;
+} TaskDeque;
+
+typedef struct {
+  ThreadPool *pool;
+  int id;
+} Worker;
+
+struct ThreadPool {
+  int numThreads;
+  pthread_t *threads;
+  Worker *workers;
+  TaskDeque *deques;
+  pthread_mutex_t lock;
+  pthread_cond_t workAvailable;
+  pthread_cond_t workDone;
+  // Tasks waiting in a deque and tasks not yet finished
+  atomic_int queued;
+  atomic_int pending;
+  atomic_uint nextDeque;
+  _Bool shutdown;
+};
+
+static _Thread_local ThreadPool *currentPool = NULL;
+static _Thread_local int currentWorker = -1;
+
+void destroyPool(ThreadPool *pool, int deques, int threads);
+
+// Deque functions
+_Bool initDeque(TaskDeque *deque);
+_Bool pushTask(TaskDeque *deque, Task task);
+_Bool popTask(TaskDeque *deque, Task *task);
+_Bool stealTask(TaskDeque *deque, Task *task);
+
+// Worker functions
+void *workerMain(void *arg);
+_Bool findTask(ThreadPool *pool, int id, Task *task);
+void finishTask(ThreadPool *pool);
+
+ThreadPool *CreateThreadPool(int numThreads) {
+  if (numThreads < 1) {
+    numThreads = 1;
+  }
+  ThreadPool *pool = (ThreadPool *)malloc(sizeof(ThreadPool));
+  if (pool == NULL) {
+    LOG_ERROR("Allocation of thread pool failed!", NULL);
+    return NULL;
+  }
+  pool->numThreads = numThreads;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->workAvailable, NULL);
+  pthread_cond_init(&pool->workDone, NULL);
+  atomic_init(&pool->queued, 0);
+  atomic_init(&pool->pending, 0);
+  atomic_init(&pool->nextDeque, 0);
+  pool->shutdown = 0;
+  pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * numThreads);
+  pool->workers = (Worker *)malloc(sizeof(Worker) * numThreads);
+  pool->deques = (TaskDeque *)malloc(sizeof(TaskDeque) * numThreads);
+  if (pool->threads == NULL || pool->workers == NULL || pool->deques == NULL) {
+    LOG_ERROR("Allocation of thread pool workers failed!", NULL);
+    destroyPool(pool, 0, 0);
+    return NULL;
+  }
+  for (int i = 0; i < numThreads; i++) {
+    if (!initDeque(&pool->deques[i])) {
+      destroyPool(pool, i, 0);
+      return NULL;
+    }
+  }
+  for (int i = 0; i < numThreads; i++) {
+    pool->workers[i] = (Worker){pool, i};
+    if (pthread_create(&pool->threads[i], NULL, workerMain,
+                       &pool->workers[i]) != 0) {
+      LOG_ERROR("Creation of thread pool worker failed!", NULL);
+      destroyPool(pool, numThreads, i);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+void FreeThreadPool(ThreadPool *pool) {
+  WaitThreadPool(pool);
+  destroyPool(pool, pool->numThreads, pool->numThreads);
+}
+
+// Stops the first threads workers and frees the first deques deques, also
+// for a pool that was only partly created
+void destroyPool(ThreadPool *pool, int deques, int threads) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->workAvailable);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < threads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  for (int i = 0; i < deques; i++) {
+    pthread_mutex_destroy(&pool->deques[i].lock);
+    free(pool->deques[i].tasks);
+  }
+  pthread_cond_destroy(&pool->workDone);
+  pthread_cond_destroy(&pool->workAvailable);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->deques);
+  free(pool->workers);
+  free(pool->threads);
+  free(pool);
+}
+
+void SubmitTask(ThreadPool *pool, TaskFunction function, void *arg) {
+  int id;
+  if (currentPool == pool) {
+    id = currentWorker;
+  } else {
+    id = atomic_fetch_add(&pool->nextDeque, 1) % pool->numThreads;
+  }
+  atomic_fetch_add(&pool->pending, 1);
+  atomic_fetch_add(&pool->queued, 1);
+  if (!pushTask(&pool->deques[id], (Task){function, arg})) {
+    // No room for the task, run it here instead
+    atomic_fetch_sub(&pool->queued, 1);
+    function(arg);
+    finishTask(pool);
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_signal(&pool->workAvailable);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void WaitThreadPool(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (atomic_load(&pool->pending) > 0) {
+    pthread_cond_wait(&pool->workDone, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int GetNumCores() {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores > 0 ? (int)cores : 1;
+}
+
+_Bool initDeque(TaskDeque *deque) {
+  deque->capacity = DEQUE_INITIAL_CAPACITY;
+  deque->tasks = (Task *)malloc(sizeof(Task) * deque->capacity);
+  if (deque->tasks == NULL) {
+    LOG_ERROR("Allocation of task deque failed!", NULL);
+    return 0;
+  }
+  pthread_mutex_init(&deque->lock, NULL);
+  deque->top = 0;
+  deque->bottom = 0;
+  return 1;
+}
+
+// Returns 0 if the deque is full and cannot grow, it keeps its tasks then
+_Bool pushTask(TaskDeque *deque, Task task) {
+  pthread_mutex_lock(&deque->lock);
+  int size = deque->bottom - deque->top;
+  if (size == deque->capacity) {
+    // Grow and unwrap the ring buffer
+    Task *tasks = (Task *)malloc(sizeof(Task) * deque->capacity * 2);
+    if (tasks == NULL) {
+      LOG_ERROR("Allocation of task deque failed!", NULL);
+      pthread_mutex_unlock(&deque->lock);
+      return 0;
+    }
+    for (int i = 0; i < size; i++) {
+      tasks[i] = deque->tasks[(deque->top + i) & (deque->capacity - 1)];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->capacity *= 2;
+    deque->top = 0;
+    deque->bottom = size;
+  }
+  deque->tasks[deque->bottom & (deque->capacity - 1)] = task;
+  deque->bottom++;
+  pthread_mutex_unlock(&deque->lock);
+  return 1;
+}
+
+_Bool popTask(TaskDeque *deque, Task *task) {
+  _Bool found = 0;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->bottom > deque->top) {
+    deque->bottom--;
+    *task = deque->tasks[deque->bottom & (deque->capacity - 1)];
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+_Bool stealTask(TaskDeque *deque, Task *task) {
+  _Bool found = 0;
+  // Do not wait behind the owner, there are other victims to try
+  if (pthread_mutex_trylock(&deque->lock) != 0) {
+    return 0;
+  }
+  if (deque->bottom > deque->top) {
+    *task = deque->tasks[deque->top & (deque->capacity - 1)];
+    deque->top++;
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+_Bool findTask(ThreadPool *pool, int id, Task *task) {
+  if (popTask(&pool->deques[id], task)) {
+    return 1;
+  }
+  for (int i = 1; i < pool->numThreads; i++) {
+    if (stealTask(&pool->deques[(id + i) % pool->numThreads], task)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void *workerMain(void *arg) {
+  Worker *worker = (Worker *)arg;
+  ThreadPool *pool = worker->pool;
+  currentPool = pool;
+  currentWorker = worker->id;
+  while (1) {
+    Task task;
+    if (findTask(pool, worker->id, &task)) {
+      atomic_fetch_sub(&pool->queued, 1);
+      task.function(task.arg);
+      finishTask(pool);
+      continue;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->queued) == 0 && !pool->shutdown) {
+      pthread_cond_wait(&pool->workAvailable, &pool->lock);
+    }
+    _Bool done = pool->shutdown && atomic_load(&pool->queued) == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (done) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+// The last pending task wakes WaitThreadPool
+void finishTask(ThreadPool *pool) {
+  if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->workDone);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Work-stealing thread pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the bottom and steals from the top of other workers'
+// deques when it runs dry.
+
+typedef void (*TaskFunction)(void *arg);
+
+typedef struct ThreadPool ThreadPool;
+
+ThreadPool *CreateThreadPool(int numThreads);
+void FreeThreadPool(ThreadPool *pool);
+
+// Tasks submitted from a worker go to that worker's deque, all others are
+// spread round-robin. If a deque cannot grow the task runs right away on
+// the calling thread.
+void SubmitTask(ThreadPool *pool, TaskFunction function, void *arg);
+
+// Block until every submitted task has finished
+void WaitThreadPool(ThreadPool *pool);
+
+// Number of online cores, used as default pool size
+int GetNumCores();
+#endif // POOL_H
@@ -0,0 +1,181 @@
+#include "profiler.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Upper bound of zones recorded by one capture
+#define PROFILE_MAX_EVENTS (1 << 18)
+
+typedef struct {
+  int zone;
+  unsigned long long start;
+  unsigned long long duration;
+} ProfileEvent;
+
+typedef struct {
+  int zone;
+  unsigned long long start;
+} ProfileScope;
+
+static ProfileZone zones[PROFILE_MAX_ZONES];
+static int numZones;
+static ProfileScope stack[PROFILE_MAX_DEPTH];
+static int depth;
+static long frames;
+static unsigned long long frameStart;
+static _Bool overlayVisible;
+// Only the thread driving the frames is measured
+static _Thread_local _Bool profiledThread;
+
+// Capture
+static ProfileEvent *events;
+static int numEvents;
+static int captureFrames;
+static char captureFile[256];
+
+unsigned long long getNanoseconds();
+int findZone(const char *name);
+void recordEvent(int zone, unsigned long long start, unsigned long long end);
+void writeCapture();
+int compareFloats(const void *a, const void *b);
+
+void ProfileFrame() {
+  unsigned long long now = getNanoseconds();
+  if (!profiledThread) {
+    profiledThread = 1;
+    frameStart = now;
+    findZone("Frame");
+    return;
+  }
+  // Zones still open belong to the next frame
+  for (int i = 0; i < depth; i++) {
+    zones[stack[i].zone].current += now - stack[i].start;
+    stack[i].start = now;
+  }
+  zones[0].current = now - frameStart;
+  recordEvent(0, frameStart, now);
+  for (int i = 0; i < numZones; i++) {
+    zones[i].history[frames % PROFILE_HISTORY] = zones[i].current / 1e6f;
+    zones[i].current = 0;
+  }
+  frames++;
+  frameStart = now;
+  if (captureFrames > 0 && --captureFrames == 0) {
+    writeCapture();
+  }
+}
+
+void ProfileBegin(const char *name) {
+  if (!profiledThread || depth == PROFILE_MAX_DEPTH) {
+    return;
+  }
+  int zone = findZone(name);
+  if (zone < 0) {
+    return;
+  }
+  stack[depth++] = (ProfileScope){zone, getNanoseconds()};
+}
+
+void ProfileEnd() {
+  if (!profiledThread || depth == 0) {
+    return;
+  }
+  ProfileScope scope = stack[--depth];
+  unsigned long long now = getNanoseconds();
+  zones[scope.zone].current += now - scope.start;
+  recordEvent(scope.zone, scope.start, now);
+}
+
+int GetProfileZones(ProfileZone **out) {
+  *out = zones;
+  return numZones;
+}
+
+long GetProfileFrames() { return frames; }
+
+float GetProfilePercentile(const ProfileZone *zone, float percentile) {
+  int count = frames < PROFILE_HISTORY ? frames : PROFILE_HISTORY;
+  if (count == 0) {
+    return 0;
+  }
+  float sorted[PROFILE_HISTORY];
+  memcpy(sorted, zone->history, sizeof(float) * count);
+  qsort(sorted, count, sizeof(float), compareFloats);
+  return sorted[(int)(percentile * (count - 1) + 0.5f)];
+}
+
+void ToggleProfileOverlay() { overlayVisible = !overlayVisible; }
+
+_Bool IsProfileOverlayVisible() { return overlayVisible; }
+
+void StartProfileCapture(const char *fileName, int frames) {
+  if (captureFrames > 0) {
+    LOG_WARN("Profile capture already running", NULL);
+    return;
+  }
+  events = (ProfileEvent *)malloc(sizeof(ProfileEvent) * PROFILE_MAX_EVENTS);
+  if (events == NULL) {
+    LOG_ERROR("Allocation of profile events failed!", NULL);
+    return;
+  }
+  numEvents = 0;
+  captureFrames = frames;
+  snprintf(captureFile, sizeof(captureFile), "%s", fileName);
+  LOG_INFO("Capturing %i frames to %s", frames, captureFile);
+}
+
+unsigned long long getNanoseconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int findZone(const char *name) {
+  for (int i = 0; i < numZones; i++) {
+    if (zones[i].name == name || strcmp(zones[i].name, name) == 0) {
+      return i;
+    }
+  }
+  if (numZones == PROFILE_MAX_ZONES) {
+    return -1;
+  }
+  zones[numZones] = (ProfileZone){.name = name, .depth = depth};
+  return numZones++;
+}
+
+void recordEvent(int zone, unsigned long long start, unsigned long long end) {
+  if (captureFrames > 0 && numEvents < PROFILE_MAX_EVENTS) {
+    events[numEvents++] = (ProfileEvent){zone, start, end - start};
+  }
+}
+
+// Complete events ("ph": "X") with microsecond timestamps
+void writeCapture() {
+  FILE *file = fopen(captureFile, "w");
+  if (file == NULL) {
+    LOG_ERROR("Failed to open profile capture: %s", captureFile);
+  } else {
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (int i = 0; i < numEvents; i++) {
+      ProfileEvent *event = &events[i];
+      fprintf(file,
+              "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+              "\"pid\":1,\"tid\":1}%s\n",
+              zones[event->zone].name, event->start / 1e3,
+              event->duration / 1e3, i + 1 < numEvents ? "," : "");
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    LOG_INFO("Wrote %i profile events to %s", numEvents, captureFile);
+  }
+  free(events);
+  events = NULL;
+}
+
+int compareFloats(const void *a, const void *b) {
+  float x = *(const float *)a;
+  float y = *(const float *)b;
+  return (x > y) - (x < y);
+}
@@ -0,0 +1,52 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame profiler. Zones nest and are summed per frame, only the thread that
+// calls ProfileFrame is measured so simulations on other threads cost
+// nothing. Build with make PROFILE=1, otherwise every macro compiles to
+// nothing.
+
+#define PROFILE_MAX_ZONES 48
+#define PROFILE_MAX_DEPTH 16
+// Frames kept per zone for graphs and percentiles
+#define PROFILE_HISTORY 240
+
+typedef struct {
+  const char *name;
+  // Nesting depth the zone was first entered at
+  int depth;
+  // Milliseconds per frame, indexed by frame modulo PROFILE_HISTORY
+  float history[PROFILE_HISTORY];
+  unsigned long long current;
+} ProfileZone;
+
+#ifdef PROFILE
+#define PROFILE_FRAME() ProfileFrame()
+#define PROFILE_BEGIN(name) ProfileBegin(name)
+#define PROFILE_END() ProfileEnd()
+#else
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_BEGIN(name) ((void)0)
+#define PROFILE_END() ((void)0)
+#endif
+
+// Closes the current frame and opens the next one. The first zone is the
+// frame itself.
+void ProfileFrame();
+// name must outlive the profiler, zones are told apart by name
+void ProfileBegin(const char *name);
+void ProfileEnd();
+
+int GetProfileZones(ProfileZone **zones);
+// Number of completed frames
+long GetProfileFrames();
+// Milliseconds over the kept history, percentile in [0, 1]
+float GetProfilePercentile(const ProfileZone *zone, float percentile);
+
+void ToggleProfileOverlay();
+_Bool IsProfileOverlayVisible();
+
+// Records every zone of the next frames and writes them as Chrome trace
+// JSON, to be opened in chrome://tracing or Perfetto
+void StartProfileCapture(const char *fileName, int frames);
+#endif // PROFILER_H
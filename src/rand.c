@@ -0,0 +1,10 @@
+#include "rand.h"
+
+unsigned int NextRandom(unsigned int *state) {
+  unsigned int x = *state ? *state : 1;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
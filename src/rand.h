@@ -0,0 +1,9 @@
+#ifndef RAND_H
+#define RAND_H
+
+// Random stream of the headless tools. Each caller keeps its own state, so
+// runs are reproducible and threads do not share one like with rand().
+
+// xorshift32, a zero state is taken as 1
+unsigned int NextRandom(unsigned int *state);
+#endif // RAND_H
@@ -0,0 +1,231 @@
+#include "record.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// File layout, little endian: magic, version, width, height, players, seed,
+// ticks, hash, command count, then per command the tick delta to the
+// previous command as varint, the player and the action. Actions 0 to 3 are
+// moves in that direction, 4 is planting a bomb.
+#define RECORDING_MAGIC 0x43524d42 // "BMRC"
+#define RECORDING_VERSION 1
+#define RECORDING_INITIAL_CAPACITY 1024
+#define ACTION_PLANT _DIRECTION_NUM
+
+void writeUint(FILE *file, uint64_t value, int bytes);
+_Bool readUint(FILE *file, uint64_t *value, int bytes);
+void writeVarint(FILE *file, uint64_t value);
+_Bool readVarint(FILE *file, uint64_t *value);
+
+void ApplyCommand(Match *match, Command command) {
+  switch (command.type) {
+  case COMMAND_MOVE:
+    MovePlayer(match, command.player, command.direction);
+    break;
+  case COMMAND_PLANT:
+    PlantBomb(match, command.player);
+    break;
+  }
+}
+
+uint8_t AddInputCommand(uint8_t input, Command command) {
+  switch (command.type) {
+  case COMMAND_MOVE:
+    if (!(input & INPUT_MOVE)) {
+      input |= INPUT_MOVE | (command.direction & INPUT_DIRECTION);
+    }
+    break;
+  case COMMAND_PLANT:
+    input |= INPUT_PLANT;
+    break;
+  }
+  return input;
+}
+
+void ApplyInput(Match *match, int player, uint8_t input) {
+  if (input & INPUT_MOVE) {
+    MovePlayer(match, player, (Direction)(input & INPUT_DIRECTION));
+  }
+  if (input & INPUT_PLANT) {
+    PlantBomb(match, player);
+  }
+}
+
+Recording *CreateRecording(MatchConfig config, unsigned int seed) {
+  Recording *recording = (Recording *)malloc(sizeof(Recording));
+  if (recording == NULL) {
+    LOG_ERROR("Allocation of recording failed!", NULL);
+    return NULL;
+  }
+  *recording = (Recording){.config = config, .seed = seed};
+  return recording;
+}
+
+void FreeRecording(Recording *recording) {
+  free(recording->commands);
+  free(recording);
+}
+
+void RecordCommand(Recording *recording, Command command) {
+  if (recording->numCommands == recording->capacity) {
+    int capacity = recording->capacity ? recording->capacity * 2
+                                       : RECORDING_INITIAL_CAPACITY;
+    Command *commands = (Command *)realloc(recording->commands,
+                                           sizeof(Command) * capacity);
+    if (commands == NULL) {
+      LOG_ERROR("Allocation of recorded commands failed!", NULL);
+      return;
+    }
+    recording->commands = commands;
+    recording->capacity = capacity;
+  }
+  recording->commands[recording->numCommands++] = command;
+}
+
+void FinishRecording(Recording *recording, Match *match) {
+  recording->ticks = match->tick;
+  recording->hash = HashMatch(match);
+}
+
+_Bool SaveRecording(Recording *recording, const char *fileName) {
+  FILE *file = fopen(fileName, "wb");
+  if (file == NULL) {
+    LOG_ERROR("Failed to open recording: %s", fileName);
+    return 0;
+  }
+  writeUint(file, RECORDING_MAGIC, 4);
+  writeUint(file, RECORDING_VERSION, 4);
+  writeUint(file, recording->config.width, 4);
+  writeUint(file, recording->config.height, 4);
+  writeUint(file, recording->config.players, 4);
+  writeUint(file, recording->seed, 4);
+  writeUint(file, recording->ticks, 8);
+  writeUint(file, recording->hash, 8);
+  writeUint(file, recording->numCommands, 4);
+  long tick = 0;
+  for (int i = 0; i < recording->numCommands; i++) {
+    Command *command = &recording->commands[i];
+    writeVarint(file, command->tick - tick);
+    writeUint(file, command->player, 1);
+    writeUint(file,
+              command->type == COMMAND_PLANT ? ACTION_PLANT
+                                             : command->direction,
+              1);
+    tick = command->tick;
+  }
+  _Bool ok = ferror(file) == 0;
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    LOG_ERROR("Failed to write recording: %s", fileName);
+  }
+  return ok;
+}
+
+Recording *LoadRecording(const char *fileName) {
+  FILE *file = fopen(fileName, "rb");
+  if (file == NULL) {
+    LOG_ERROR("Failed to open recording: %s", fileName);
+    return NULL;
+  }
+  uint64_t magic, version, width, height, players, seed, ticks, hash, count;
+  if (!readUint(file, &magic, 4) || !readUint(file, &version, 4) ||
+      magic != RECORDING_MAGIC || version != RECORDING_VERSION ||
+      !readUint(file, &width, 4) || !readUint(file, &height, 4) ||
+      !readUint(file, &players, 4) || !readUint(file, &seed, 4) ||
+      !readUint(file, &ticks, 8) || !readUint(file, &hash, 8) ||
+      !readUint(file, &count, 4)) {
+    LOG_ERROR("Not a recording: %s", fileName);
+    fclose(file);
+    return NULL;
+  }
+  MatchConfig config = {width, height, players};
+  Recording *recording = CreateRecording(config, seed);
+  if (recording == NULL) {
+    fclose(file);
+    return NULL;
+  }
+  recording->ticks = ticks;
+  recording->hash = hash;
+  uint64_t tick = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t delta, player, action;
+    if (!readVarint(file, &delta) || !readUint(file, &player, 1) ||
+        !readUint(file, &action, 1) || player >= (uint64_t)players ||
+        action > ACTION_PLANT) {
+      LOG_ERROR("Corrupt recording: %s", fileName);
+      FreeRecording(recording);
+      fclose(file);
+      return NULL;
+    }
+    tick += delta;
+    Command command = {tick, player, COMMAND_MOVE, (Direction)action};
+    if (action == ACTION_PLANT) {
+      command = (Command){tick, player, COMMAND_PLANT, NORTH};
+    }
+    RecordCommand(recording, command);
+  }
+  fclose(file);
+  return recording;
+}
+
+Match *ReplayRecording(Recording *recording) {
+  Match *match = InitMatchWithConfig(recording->config, recording->seed);
+  if (match == NULL) {
+    return NULL;
+  }
+  int next = 0;
+  while (match->tick < recording->ticks) {
+    while (next < recording->numCommands &&
+           recording->commands[next].tick <= match->tick) {
+      ApplyCommand(match, recording->commands[next++]);
+    }
+    StepMatch(match, TICK_TIME);
+  }
+  // Commands after the last tick still change the state
+  while (next < recording->numCommands) {
+    ApplyCommand(match, recording->commands[next++]);
+  }
+  return match;
+}
+
+void writeUint(FILE *file, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    fputc((value >> (8 * i)) & 0xff, file);
+  }
+}
+
+_Bool readUint(FILE *file, uint64_t *value, int bytes) {
+  *value = 0;
+  for (int i = 0; i < bytes; i++) {
+    int byte = fgetc(file);
+    if (byte == EOF) {
+      return 0;
+    }
+    *value |= (uint64_t)byte << (8 * i);
+  }
+  return 1;
+}
+
+// Seven bits per byte, the high bit marks that more bytes follow
+void writeVarint(FILE *file, uint64_t value) {
+  while (value >= 0x80) {
+    fputc((value & 0x7f) | 0x80, file);
+    value >>= 7;
+  }
+  fputc(value, file);
+}
+
+_Bool readVarint(FILE *file, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = fgetc(file);
+    if (byte == EOF) {
+      return 0;
+    }
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "sim.h"
+
+// Input recordings. A match is fully determined by its config, its seed and
+// the commands issued between ticks, so that is all a recording stores,
+// plus the final state hash to verify a replay against.
+
+typedef enum {
+  COMMAND_MOVE,
+  COMMAND_PLANT,
+} CommandType;
+
+typedef struct {
+  // Ticks the match had stepped when the command was issued
+  long tick;
+  int player;
+  CommandType type;
+  // Only for COMMAND_MOVE
+  Direction direction;
+} Command;
+
+typedef struct {
+  MatchConfig config;
+  unsigned int seed;
+  int numCommands;
+  int capacity;
+  Command *commands;
+  // Set by FinishRecording
+  long ticks;
+  uint64_t hash;
+} Recording;
+
+// Issue a command to a match, the only way input should reach it
+void ApplyCommand(Match *match, Command command);
+
+// Commands of a player for one tick packed into a byte for the network: a
+// move in the low two bits if INPUT_MOVE is set, and a plant. A tick carries
+// at most one of each, a later move of the same tick is dropped.
+#define INPUT_DIRECTION 0x03
+#define INPUT_MOVE 0x04
+#define INPUT_PLANT 0x08
+
+uint8_t AddInputCommand(uint8_t input, Command command);
+void ApplyInput(Match *match, int player, uint8_t input);
+
+Recording *CreateRecording(MatchConfig config, unsigned int seed);
+void FreeRecording(Recording *recording);
+// Commands must be recorded in the order they are applied
+void RecordCommand(Recording *recording, Command command);
+// Store the tick count and hash of the final state
+void FinishRecording(Recording *recording, Match *match);
+
+_Bool SaveRecording(Recording *recording, const char *fileName);
+Recording *LoadRecording(const char *fileName);
+
+// Plays a recording into a new match up to its final tick
+Match *ReplayRecording(Recording *recording);
+#endif // RECORD_H
@@ -1,6 +1,9 @@
 #include "renderer.h"
+#include "atlas.h"
+#include "bitboard.h"
 #include "game.h"
 #include "log.h"
+#include "profiler.h"
 #include "util.h"
 #include <raylib.h>
 #include <stdio.h>
@@ -9,24 +12,72 @@
 
 #define BACKGROUND_COLOR (Color){30, 30, 30, 255}
 
+// Decoded sprites uploaded into the atlas per frame, bounds the upload cost
+// of a frame while assets are still loading
+#define ATLAS_UPLOADS_PER_FRAME 32
+// Decode order of the atlas: menu and match assets first, then the
+// characters the player is likely to pick
+#define PRELOAD_ASSETS 3
+#define PRELOAD_CHARACTER 2
+#define PRELOAD_NEIGHBOUR 1
+
+// Every sprite is drawn from the atlas so a frame needs only a few batches
+static Atlas *atlas;
+// Sprites not uploaded into the atlas yet
+static int atlasRemaining;
+// Character whose frames were last moved up in the decode order
+static int preloadedCharacter = -1;
+
 // Raylib Logo
-static Texture2D raylibLogo;
+static AtlasSprite raylibLogo;
 
 // UI
-static Texture2D arrowTexture;
-
-// Map
-static Texture2D mapTexture;
+static AtlasSprite arrowSprite;
+
+// Map, drawn for the default size and cut into wall and floor tiles for
+// any other size
+static AtlasSprite mapSprite;
+// Screen position of the grid origin, set once per frame by renderRunning
+static Vector2 gridOffset;
+// Map and crates are cached in a render texture, a frame only redraws the
+// cells whose crate changed. Larger maps are drawn cell by cell.
+#define BOARD_LAYER_MAX_SIZE 4096
+static RenderTexture2D boardLayer;
+// Map size of the layer, zero before it is created
+static int boardWidth;
+static int boardHeight;
+// Crates currently drawn on the layer
+static BoardRow boardCrateRows[MAX_GRID_SIZE];
+static Bitboard boardCrates = {.row = boardCrateRows};
+// The layer was drawn while map sprites might still have been missing
+static _Bool boardIncomplete;
+// Whether this frame's crates come from the layer
+static _Bool boardLayerActive;
 
 // Items
-static Texture2D crateTexture;
-Texture2D *starFrames;
+static AtlasSprite crateSprite;
+AtlasSprite *starFrames;
 Animation *starAnimation;
 
 // Bomb
-static Texture2D bombTexture;
-Texture2D *bombSparkFrames;
-Texture2D *explosionBlastFrames;
+static AtlasSprite bombSprite;
+AtlasSprite *bombSparkFrames;
+Animation *bombSparkAnimation;
+AtlasSprite *explosionBlastFrames;
+Animation *explosionBlastAnimation;
+
+// Players
+// Frame tables of a character are shared by every player using it and freed
+// once the last of them releases the character
+typedef struct {
+  AtlasSprite *frames;
+  int numFrames;
+  int refCount;
+} CharFrames;
+static CharFrames charFrames[CHARACTERS][_PLAYER_STATE_NUM];
+// Per player only the playback state is kept, character -1 means none
+static Animation playerAnimation[MAX_PLAYERS][_PLAYER_STATE_NUM];
+static int playerCharacter[MAX_PLAYERS];
 
 // File pointer
 char *starFiles[] = {
@@ -49,48 +100,64 @@ char *explosionBlastFiles[] = {
 };
 
 // Animation functions
-Texture2D *loadFrames(char *fileNames[], int numFrames);
+AtlasSprite *loadFrames(char *fileNames[], int numFrames);
 void updateAnimation(Animation *animation, float deltaTime);
 void drawAnimationPro(Animation *animation, Rectangle sourceRec,
                       Rectangle destRec, Vector2 origin, float rotation,
                       Color color);
+int getAnimationFrame(Animation *animation, double elapsedTime);
+CharFrames *acquireCharFrames(int char_id, PlayerState state);
+void preloadCharacter(int char_id, int priority);
+void releaseCharFrames(int char_id, PlayerState state);
 
 // Draw functions
 void drawCenteredText(const char *text, int pos_y, int font_size, Color color);
 
-// Entity animation functions
-void loadPlayerAnimation(Player *player);
-void loadBombAnimation(Bomb *bomb);
-void loadExplosionAnimation(Explosion *explosion);
-
 // Render state functions
 void renderMainMenu(Game *game);
 void renderCharSelectMenu(Game *game);
 void renderRunningCountdown(Game *game);
-void renderRunning(Game *game);
+void renderRunning(Game *game, float alpha);
 void renderPauseMenu(Game *game);
 
 // Render elements
-Vector2 getGridOffset();
+Vector2 getGridOffset(Game *game, float alpha);
+Vector2 getPlayerCell(Game *game, int player, float alpha);
+void getVisibleCells(Game *game, Position *min, Position *max);
+int getMapSourceCell(int v, int size);
+_Bool updateBoardLayer(Game *game);
+void drawBoardCell(Game *game, int x, int y);
 void renderStats(Game *game);
 void renderMap(Game *game);
-void renderPlayer(Game *game);
-void renderBombs(Game *game);
-void renderExplosions(Game *game);
+void renderPlayer(Game *game, float alpha);
+void renderBombs(Game *game, float alpha);
+void renderExplosions(Game *game, float alpha);
 void renderItems(Game *game);
+void renderProfiler();
 
 void InitRenderer(Game *game) {
-  // Textures
-  LOG_DEBUG("Load static textures", NULL);
-  raylibLogo = LoadTexture("assets/raylib_logo.png");
-  arrowTexture = LoadTexture("assets/ui/arrow.png");
-  mapTexture = LoadTexture("assets/map.png");
-  crateTexture = LoadTexture("assets/items/crate.png");
-  bombTexture = LoadTexture("assets/items/bomb.png");
+  // Textures, decoded in the background while the menus are shown
+  LOG_DEBUG("Load texture atlas", NULL);
+  atlas = LoadAtlas("assets");
+  if (atlas == NULL) {
+    LOG_ERROR("Loading the texture atlas failed!", NULL);
+    return;
+  }
+  PrioritizeAtlasSprites(atlas, "assets/", PRELOAD_ASSETS);
+  PrioritizeAtlasSprites(atlas, "assets/characters/", 0);
+  raylibLogo = GetAtlasSprite(atlas, "assets/raylib_logo.png");
+  arrowSprite = GetAtlasSprite(atlas, "assets/ui/arrow.png");
+  mapSprite = GetAtlasSprite(atlas, "assets/map.png");
+  crateSprite = GetAtlasSprite(atlas, "assets/items/crate.png");
+  bombSprite = GetAtlasSprite(atlas, "assets/items/bomb.png");
   for (int i = 0; i < CHARACTERS; i++) {
     char path[256];
     sprintf(path, "assets/characters/%02d/idle/sprite_000.png", i);
-    game->charSelectMenu->charTexture[i] = LoadTexture(path);
+    game->charSelectMenu->charSprite[i] = GetAtlasSprite(atlas, path);
+    PrioritizeAtlasSprites(atlas, path, PRELOAD_ASSETS);
+  }
+  for (int i = 0; i < MAX_PLAYERS; i++) {
+    playerCharacter[i] = -1;
   }
   // Frames
   LOG_DEBUG("Load static frames", NULL);
@@ -100,10 +167,17 @@ void InitRenderer(Game *game) {
       loadFrames(explosionBlastFiles, EXPLOSION_BLAST_FRAMES_NUM);
   // Animations
   starAnimation = CreateAnimation(starFrames, STAR_FRAMES_NUM, 0.1f);
+  bombSparkAnimation =
+      CreateAnimation(bombSparkFrames, BOMB_SPARK_FRAMES_NUM, 0.1f);
+  explosionBlastAnimation =
+      CreateAnimation(explosionBlastFrames, EXPLOSION_BLAST_FRAMES_NUM, 0.1f);
 }
 
-void Render(Game *game) {
+void Render(Game *game, float alpha) {
   LOG_DEBUG("Render", NULL);
+  PROFILE_BEGIN("UpdateAtlas");
+  atlasRemaining = UpdateAtlas(atlas, ATLAS_UPLOADS_PER_FRAME);
+  PROFILE_END();
   BeginDrawing();
   ClearBackground(BACKGROUND_COLOR);
   switch (game->state) {
@@ -113,7 +187,7 @@ void Render(Game *game) {
     break;
   case RUNNING_COUNTDOWN:
     LOG_DEBUG("Render: renderRunning", NULL);
-    renderRunning(game);
+    renderRunning(game, alpha);
     LOG_DEBUG("Render: renderRunningCountdown", NULL);
     renderRunningCountdown(game);
     break;
@@ -123,43 +197,53 @@ void Render(Game *game) {
     break;
   case RUNNING:
     LOG_DEBUG("Render: renderRunning", NULL);
-    renderRunning(game);
+    renderRunning(game, alpha);
     break;
   case PAUSE_MENU:
     LOG_DEBUG("Render: renderRunning", NULL);
-    renderRunning(game);
+    renderRunning(game, alpha);
     LOG_DEBUG("Render: renderPauseMenu", NULL);
     renderPauseMenu(game);
     break;
   case EXIT:
     break;
   }
+#ifdef PROFILE
+  if (IsProfileOverlayVisible()) {
+    renderProfiler();
+  }
+#endif
+  // Submits the batched draw calls and waits for the swap
+  PROFILE_BEGIN("EndDrawing");
   EndDrawing();
+  PROFILE_END();
 }
 
-Texture2D *loadFrames(char *fileNames[], int numFrames) {
-  Texture2D *frames = (Texture2D *)malloc(sizeof(Texture2D) * numFrames);
+AtlasSprite *loadFrames(char *fileNames[], int numFrames) {
+  AtlasSprite *frames = (AtlasSprite *)malloc(sizeof(AtlasSprite) * numFrames);
   if (frames == NULL) {
     LOG_ERROR("Allocation of frames failed!", NULL);
+    return NULL;
   }
   for (int i = 0; i < numFrames; i++) {
     LOG_DEBUG("%s", fileNames[i]);
-    frames[i] = LoadTexture(fileNames[i]);
-    if (frames[i].id == 0) {
-      LOG_ERROR("Failed to load texture for file: ", fileNames[i]);
-    }
+    frames[i] = GetAtlasSprite(atlas, fileNames[i]);
   }
   return frames;
 }
 
-Animation *CreateAnimation(Texture2D *frames, int numFrames, float frameSpeed) {
+Animation *CreateAnimation(AtlasSprite *frames, int numFrames,
+                           float frameSpeed) {
   Animation *animation = (Animation *)malloc(sizeof(Animation));
-  animation->frames = frames;
-  animation->numFrames = numFrames;
-  animation->frameSpeed = frameSpeed;
   if (animation == NULL) {
     LOG_ERROR("Allocation of animation failed!", NULL);
+    return NULL;
   }
+  animation->frames = frames;
+  animation->numFrames = numFrames;
+  animation->frameSpeed = frameSpeed;
+  animation->currentFrame = 0;
+  animation->elapsedTime = 0;
   return animation;
 }
 
@@ -193,9 +277,12 @@ int getCharAnimationFiles(char *file_names[], int num_frames, PlayerState state,
   return 0;
 }
 
-void loadCharacterAnimation(Player *player, PlayerState state, int char_id) {
+CharFrames *acquireCharFrames(int char_id, PlayerState state) {
+  CharFrames *entry = &charFrames[char_id][state];
+  if (entry->refCount++ > 0) {
+    return entry;
+  }
   char **file_names;
-  Texture2D *frames;
   int num_frames;
   switch (state) {
   case SPAWN:
@@ -214,16 +301,82 @@ void loadCharacterAnimation(Player *player, PlayerState state, int char_id) {
     num_frames = 0;
     break;
   }
-  file_names = (char **)malloc(sizeof(char[256]) * num_frames);
+  LOG_DEBUG("Load frames of character %i:%i", char_id, state);
+  // Frames may still be decoding, they appear once uploaded
+  preloadCharacter(char_id, PRELOAD_CHARACTER);
+  file_names = (char **)malloc(sizeof(char *) * num_frames);
+  if (file_names == NULL) {
+    LOG_ERROR("Allocation of file names failed!", NULL);
+    entry->refCount--;
+    return NULL;
+  }
   getCharAnimationFiles(file_names, num_frames, state, char_id);
-  frames = loadFrames(file_names, num_frames);
-  player->animation[state] = CreateAnimation(frames, num_frames, 0.1f);
+  entry->frames = loadFrames(file_names, num_frames);
+  entry->numFrames = num_frames;
+  for (int i = 0; i < num_frames; i++) {
+    free(file_names[i]);
+  }
   free(file_names);
+  if (entry->frames == NULL) {
+    entry->refCount--;
+    return NULL;
+  }
+  return entry;
+}
+
+void preloadCharacter(int char_id, int priority) {
+  char prefix[32];
+  sprintf(prefix, "assets/characters/%02d/", char_id);
+  PrioritizeAtlasSprites(atlas, prefix, priority);
+}
+
+void releaseCharFrames(int char_id, PlayerState state) {
+  CharFrames *entry = &charFrames[char_id][state];
+  if (entry->refCount <= 0 || --entry->refCount > 0) {
+    return;
+  }
+  LOG_DEBUG("Free frames of character %i:%i", char_id, state);
+  free(entry->frames);
+  entry->frames = NULL;
+  entry->numFrames = 0;
 }
 
-void SetCharAnimationSet(int char_id, Player *player) {
+void SetCharAnimationSet(int char_id, int player) {
+  ReleaseCharAnimationSet(player);
   for (int i = 0; i < _PLAYER_STATE_NUM; i++) {
-    loadCharacterAnimation(player, (PlayerState)i, char_id);
+    CharFrames *entry = acquireCharFrames(char_id, (PlayerState)i);
+    if (entry == NULL) {
+      // The player is drawn without sprites rather than with released ones
+      for (int j = 0; j < i; j++) {
+        releaseCharFrames(char_id, (PlayerState)j);
+        playerAnimation[player][j] = (Animation){0};
+      }
+      return;
+    }
+    playerAnimation[player][i] = (Animation){.frames = entry->frames,
+                                             .numFrames = entry->numFrames,
+                                             .frameSpeed = 0.1f,
+                                             .currentFrame = 0,
+                                             .elapsedTime = 0};
+  }
+  playerCharacter[player] = char_id;
+}
+
+void ReleaseCharAnimationSet(int player) {
+  int char_id = playerCharacter[player];
+  if (char_id < 0) {
+    return;
+  }
+  for (int i = 0; i < _PLAYER_STATE_NUM; i++) {
+    releaseCharFrames(char_id, (PlayerState)i);
+    playerAnimation[player][i] = (Animation){0};
+  }
+  playerCharacter[player] = -1;
+}
+
+void ReleaseCharAnimationSets() {
+  for (int i = 0; i < MAX_PLAYERS; i++) {
+    ReleaseCharAnimationSet(i);
   }
 }
 
@@ -237,17 +390,23 @@ void updateAnimation(Animation *animation, float deltaTime) {
   }
 }
 
+// Frame of a shared animation for an entity that started elapsedTime ago
+int getAnimationFrame(Animation *animation, double elapsedTime) {
+  return (int)(elapsedTime / animation->frameSpeed) % animation->numFrames;
+}
+
 void drawAnimationV(Animation *animation, Vector2 position, Color color) {
-  LOG_DEBUG("drawAnimationV: %i", animation->frames->id);
-  DrawTextureV(animation->frames[animation->currentFrame], position, color);
+  LOG_DEBUG("drawAnimationV: %i", animation->currentFrame);
+  DrawSpriteV(atlas, animation->frames[animation->currentFrame], position,
+              color);
 }
 
 void drawAnimationPro(Animation *animation, Rectangle sourceRec,
                       Rectangle destRec, Vector2 origin, float rotation,
                       Color color) {
-  LOG_DEBUG("drawAnimationPro: %i", animation->frames->id);
-  DrawTexturePro(animation->frames[animation->currentFrame], sourceRec, destRec,
-                 origin, rotation, color);
+  LOG_DEBUG("drawAnimationPro: %i", animation->currentFrame);
+  DrawSpritePro(atlas, animation->frames[animation->currentFrame], sourceRec,
+                destRec, origin, rotation, color);
 }
 
 void drawCenteredText(const char *text, int pos_y, int font_size, Color color) {
@@ -287,8 +446,10 @@ void renderMainMenu(Game *game) {
            screenHeight - TILE_SIZE, TILE_SIZE / 2, WHITE);
   DrawText("Powered by", (maxTileWidth - 7) * TILE_SIZE,
            screenHeight - TILE_SIZE, TILE_SIZE / 4, WHITE);
-  DrawTexture(raylibLogo, (maxTileWidth - 5) * TILE_SIZE,
-              (maxTileHeight - 4) * TILE_SIZE, WHITE);
+  DrawSpriteV(atlas, raylibLogo,
+              (Vector2){(maxTileWidth - 5) * TILE_SIZE,
+                        (maxTileHeight - 4) * TILE_SIZE},
+              WHITE);
 }
 
 void renderCharSelectMenu(Game *game) {
@@ -301,9 +462,18 @@ void renderCharSelectMenu(Game *game) {
            TILE_SIZE * 2, fontSize, WHITE);
   // Draw Character
   int select = game->charSelectMenu->selectedOption;
-  Texture2D texture = game->charSelectMenu->charTexture[select];
+  if (select != preloadedCharacter) {
+    // Load the frames of the shown character and its neighbours first
+    PrioritizeAtlasSprites(atlas, "assets/characters/", 0);
+    preloadCharacter((select + 1) % CHARACTERS, PRELOAD_NEIGHBOUR);
+    preloadCharacter((select - 1 + CHARACTERS) % CHARACTERS,
+                     PRELOAD_NEIGHBOUR);
+    preloadCharacter(select, PRELOAD_CHARACTER);
+    preloadedCharacter = select;
+  }
+  AtlasSprite sprite = game->charSelectMenu->charSprite[select];
   Rectangle source = {0, 0, 64, 64};
-  DrawTexturePro(texture, source,
+  DrawSpritePro(atlas, sprite, source,
                  (Rectangle){screenWidth / 2 - TILE_SIZE * 6 / 2, TILE_SIZE * 4,
                              TILE_SIZE * 6, TILE_SIZE * 6},
                  (Vector2){0, 0}, 0, WHITE);
@@ -320,11 +490,16 @@ void renderCharSelectMenu(Game *game) {
   Rectangle left = {0, 0, 32, 32};
   Rectangle dest = {screenWidth / 2 - TILE_SIZE * 2 / 2 - TILE_SIZE - 8,
                     TILE_SIZE * 10, TILE_SIZE * 2, TILE_SIZE * 2};
-  DrawTexturePro(arrowTexture, left, dest, (Vector2){0, 0}, 0, WHITE);
+  DrawSpritePro(atlas, arrowSprite, left, dest, (Vector2){0, 0}, 0, WHITE);
   Rectangle right = {0, 0, -32, 32};
   dest = (Rectangle){screenWidth / 2 - TILE_SIZE * 2 / 2 + TILE_SIZE + 8,
                      TILE_SIZE * 10, TILE_SIZE * 2, TILE_SIZE * 2};
-  DrawTexturePro(arrowTexture, right, dest, (Vector2){0, 0}, 0, WHITE);
+  DrawSpritePro(atlas, arrowSprite, right, dest, (Vector2){0, 0}, 0, WHITE);
+  if (game->net != NULL && game->charSelectMenu->next) {
+    const char *waiting = "Warte auf Mitspieler...";
+    DrawText(waiting, screenWidth / 2 - MeasureText(waiting, fontSize / 2) / 2,
+             TILE_SIZE * 13, fontSize / 2, WHITE);
+  }
 }
 
 void renderRunningCountdown(Game *game) {
@@ -335,23 +510,36 @@ void renderRunningCountdown(Game *game) {
   DrawRectangle(0, 0, screenWidth, GetScreenHeight(), overlayColor);
   drawCenteredText("Countdown", TILE_SIZE, fontSize, WHITE);
   char timerText[100];
-  sprintf(timerText, "%.0f", game->countdown);
+  sprintf(timerText, "%.0f", game->match->countdown);
   drawCenteredText(timerText, maxTileHeight / 2 * TILE_SIZE, fontSize * 4, RED);
 }
 
-void renderRunning(Game *game) {
+void renderRunning(Game *game, float alpha) {
+  gridOffset = getGridOffset(game, alpha);
   LOG_DEBUG("renderRunning: renderStats", NULL);
+  PROFILE_BEGIN("renderStats");
   renderStats(game);
+  PROFILE_END();
   LOG_DEBUG("renderRunning: renderMap", NULL);
+  PROFILE_BEGIN("renderMap");
   renderMap(game);
+  PROFILE_END();
   LOG_DEBUG("renderRunning: renderItems", NULL);
+  PROFILE_BEGIN("renderItems");
   renderItems(game);
+  PROFILE_END();
   LOG_DEBUG("renderRunning: renderBombs", NULL);
-  renderBombs(game);
+  PROFILE_BEGIN("renderBombs");
+  renderBombs(game, alpha);
+  PROFILE_END();
   LOG_DEBUG("renderRunning: renderPlayer", NULL);
-  renderPlayer(game);
+  PROFILE_BEGIN("renderPlayer");
+  renderPlayer(game, alpha);
+  PROFILE_END();
   LOG_DEBUG("renderRunning: renderExplosions", NULL);
-  renderExplosions(game);
+  PROFILE_BEGIN("renderExplosions");
+  renderExplosions(game, alpha);
+  PROFILE_END();
 }
 
 void renderPauseMenu(Game *game) {
@@ -362,14 +550,153 @@ void renderPauseMenu(Game *game) {
   drawCenteredText(game->pauseMenu->title, TILE_SIZE, fontSize, WHITE);
 }
 
-Vector2 getGridOffset() {
-  return (Vector2){GetScreenWidth() / 2 - (TILE_SIZE * GRID_WIDTH) / 2,
-                   GetScreenHeight() / 2 - (TILE_SIZE * GRID_HEIGHT) / 2};
+Vector2 getGridOffset(Game *game, float alpha) {
+  int screenWidth = GetScreenWidth();
+  int screenHeight = GetScreenHeight();
+  int width = TILE_SIZE * game->match->config.width;
+  int height = TILE_SIZE * game->match->config.height;
+  Vector2 offset = {screenWidth / 2 - width / 2, screenHeight / 2 - height / 2};
+  // Maps larger than the window scroll with the local player
+  Vector2 player = getPlayerCell(game, game->localPlayer, alpha);
+  if (width > screenWidth) {
+    offset.x = screenWidth / 2 - TILE_SIZE * player.x - TILE_SIZE / 2;
+    offset.x = Clamp(offset.x, screenWidth - width, 0);
+  }
+  if (height > screenHeight) {
+    offset.y = screenHeight / 2 - TILE_SIZE * player.y - TILE_SIZE / 2;
+    offset.y = Clamp(offset.y, screenHeight - height, 0);
+  }
+  return offset;
+}
+
+// Interpolated cell coordinates of a player
+Vector2 getPlayerCell(Game *game, int player, float alpha) {
+  PlayerTable *players = &game->match->players;
+  float progress =
+      Lerp(players->prevProgress[player], players->progress[player], alpha);
+  return (Vector2){Lerp(players->position[player].x,
+                        players->targetPosition[player].x, progress),
+                   Lerp(players->position[player].y,
+                        players->targetPosition[player].y, progress)};
+}
+
+void getVisibleCells(Game *game, Position *min, Position *max) {
+  MatchConfig *config = &game->match->config;
+  min->x = Clamp(-gridOffset.x / TILE_SIZE, 0, config->width - 1);
+  min->y = Clamp(-gridOffset.y / TILE_SIZE, 0, config->height - 1);
+  max->x = Clamp((GetScreenWidth() - gridOffset.x) / TILE_SIZE, 0,
+                 config->width - 1);
+  max->y = Clamp((GetScreenHeight() - gridOffset.y) / TILE_SIZE, 0,
+                 config->height - 1);
 }
 
 void renderMap(Game *game) {
-  Vector2 offset = getGridOffset();
-  DrawTextureV(mapTexture, offset, WHITE);
+  MatchConfig *config = &game->match->config;
+  boardLayerActive = updateBoardLayer(game);
+  if (boardLayerActive) {
+    // Render textures are stored upside down
+    Texture2D texture = boardLayer.texture;
+    DrawTextureRec(texture, (Rectangle){0, 0, texture.width, -texture.height},
+                   gridOffset, WHITE);
+    return;
+  }
+  if (config->width == DEFAULT_GRID_SIZE &&
+      config->height == DEFAULT_GRID_SIZE) {
+    DrawSpriteV(atlas, mapSprite, gridOffset, WHITE);
+    return;
+  }
+  Position min, max;
+  getVisibleCells(game, &min, &max);
+  for (int x = min.x; x <= max.x; x++) {
+    for (int y = min.y; y <= max.y; y++) {
+      Rectangle source = {TILE_SIZE * getMapSourceCell(x, config->width),
+                          TILE_SIZE * getMapSourceCell(y, config->height),
+                          TILE_SIZE, TILE_SIZE};
+      DrawSpriteRec(atlas, mapSprite, source,
+                    (Vector2){TILE_SIZE * x + gridOffset.x,
+                              TILE_SIZE * y + gridOffset.y},
+                    WHITE);
+    }
+  }
+}
+
+// Redraws the cells of the board layer whose crate appeared or vanished,
+// 0 if the map is too large for a layer
+_Bool updateBoardLayer(Game *game) {
+  MatchConfig *config = &game->match->config;
+  int width = TILE_SIZE * config->width;
+  int height = TILE_SIZE * config->height;
+  if (width > BOARD_LAYER_MAX_SIZE || height > BOARD_LAYER_MAX_SIZE) {
+    return 0;
+  }
+  Bitboard *crates = &game->match->layers.crates;
+  BoardRow dirtyRows[MAX_GRID_SIZE];
+  Bitboard dirty = {.row = dirtyRows};
+  if (boardWidth != config->width || boardHeight != config->height ||
+      (boardIncomplete && atlasRemaining == 0)) {
+    if (boardWidth != config->width || boardHeight != config->height) {
+      if (boardWidth != 0) {
+        UnloadRenderTexture(boardLayer);
+      }
+      boardLayer = LoadRenderTexture(width, height);
+      boardWidth = config->width;
+      boardHeight = config->height;
+    }
+    BoardInit(&dirty, config->width, config->height);
+    BoardFill(&dirty);
+    boardIncomplete = atlasRemaining > 0;
+  } else {
+    // Walls only depend on the map size, so crates are all that changes,
+    // also across matches
+    BoardRow removedRows[MAX_GRID_SIZE];
+    Bitboard removed = {.row = removedRows};
+    BoardAndNot(&dirty, crates, &boardCrates);
+    BoardAndNot(&removed, &boardCrates, crates);
+    BoardOr(&dirty, &dirty, &removed);
+    if (BoardIsEmpty(&dirty)) {
+      return 1;
+    }
+  }
+  BeginTextureMode(boardLayer);
+  for (int y = 0; y < config->height; y++) {
+    for (int w = 0; w < BOARD_WORDS; w++) {
+      for (uint64_t bits = dirty.row[y][w]; bits != 0; bits &= bits - 1) {
+        drawBoardCell(game, w * 64 + __builtin_ctzll(bits), y);
+      }
+    }
+  }
+  EndTextureMode();
+  BoardCopy(&boardCrates, crates);
+  return 1;
+}
+
+void drawBoardCell(Game *game, int x, int y) {
+  MatchConfig *config = &game->match->config;
+  Vector2 position = {TILE_SIZE * x, TILE_SIZE * y};
+  Rectangle source = {TILE_SIZE * x, TILE_SIZE * y, TILE_SIZE, TILE_SIZE};
+  if (config->width != DEFAULT_GRID_SIZE ||
+      config->height != DEFAULT_GRID_SIZE) {
+    source.x = TILE_SIZE * getMapSourceCell(x, config->width);
+    source.y = TILE_SIZE * getMapSourceCell(y, config->height);
+  }
+  // Cover the crate that was drawn here before
+  DrawRectangle(position.x, position.y, TILE_SIZE, TILE_SIZE,
+                BACKGROUND_COLOR);
+  DrawSpriteRec(atlas, mapSprite, source, position, WHITE);
+  if (BoardTest(&game->match->layers.crates, (Position){x, y})) {
+    DrawSpriteV(atlas, crateSprite, position, WHITE);
+  }
+}
+
+// Cell of the default map art with the same role: border, corridor or pillar
+int getMapSourceCell(int v, int size) {
+  if (v == 0) {
+    return 0;
+  }
+  if (v == size - 1) {
+    return DEFAULT_GRID_SIZE - 1;
+  }
+  return v % 2 ? 1 : 2;
 }
 
 void renderStats(Game *game) {
@@ -386,47 +713,53 @@ void renderStats(Game *game) {
   DrawRectangleLines(TILE_SIZE, TILE_SIZE, TILE_SIZE * 7, TILE_SIZE * 5, WHITE);
 
   // Player Look
-  for (int i = 0; i < MAX_PLAYERS; i++) {
-    Texture2D characterTexture = game->player[i]->animation[IDLE]->frames[0];
+  int local = game->localPlayer;
+  // The other players from the right edge on
+  int slot = 0;
+  for (int i = 0; i < game->match->config.players; i++) {
+    if (playerAnimation[i][IDLE].frames == NULL) {
+      continue;
+    }
+    AtlasSprite characterSprite = playerAnimation[i][IDLE].frames[0];
     Rectangle source = (Rectangle){12, 12, 36, 36};
-    if (i == 0) {
-      DrawTexturePro(characterTexture, source,
+    if (i == local) {
+      DrawSpritePro(atlas, characterSprite, source,
                      (Rectangle){TILE_SIZE * 2 - 8, TILE_SIZE * 2 - 8,
                                  TILE_SIZE, TILE_SIZE},
                      (Vector2){0, 0}, 0, WHITE);
     } else {
-      float x = screenWidth - TILE_SIZE * i - 8;
+      float x = screenWidth - TILE_SIZE * ++slot - 8;
       float y = TILE_SIZE * 2 - 8;
-      DrawTexturePro(characterTexture, source,
-                     (Rectangle){x, y, TILE_SIZE, TILE_SIZE}, (Vector2){0, 0},
-                     0, WHITE);
-      if (!game->player[i]->isAlive) {
+      DrawSpritePro(atlas, characterSprite, source,
+                    (Rectangle){x, y, TILE_SIZE, TILE_SIZE}, (Vector2){0, 0},
+                    0, WHITE);
+      if (!game->match->players.isAlive[i]) {
         DrawLine(x, y, x + TILE_SIZE, y + TILE_SIZE, RED);
       }
     }
   }
 
   // Speed
+  PlayerTable *players = &game->match->players;
   char speedText[100];
-  sprintf(speedText, "Geschwindigkeit: %.0f", game->player[0]->speed);
+  sprintf(speedText, "Geschwindigkeit: %.0f", players->speed[local]);
   DrawText(speedText, TILE_SIZE * 2, TILE_SIZE * 3, fontSize / 2, WHITE);
 
   // Bombs
   DrawText("Bomben:", TILE_SIZE * 2, TILE_SIZE * 4, fontSize / 2, WHITE);
-  for (int i = 0; i < game->player[0]->bombs; i++) {
-    if (game->player[0]->bombList[i] == NULL) {
-      DrawTextureV(bombTexture,
-                   (Vector2){MeasureText("Bomben:", fontSize / 2) +
-                                 TILE_SIZE * 2 + (TILE_SIZE * i) + 8,
-                             TILE_SIZE * 4 - 8},
-                   WHITE);
-    }
+  int bombsLeft = players->bombs[local] - players->activeBombs[local];
+  for (int i = 0; i < bombsLeft; i++) {
+    DrawSpriteV(atlas, bombSprite,
+                (Vector2){MeasureText("Bomben:", fontSize / 2) +
+                              TILE_SIZE * 2 + (TILE_SIZE * i) + 8,
+                          TILE_SIZE * 4 - 8},
+                WHITE);
   }
 
   // Blast-Radius
   char blastRadiusText[100];
   sprintf(blastRadiusText, "Explosionsradius: %i",
-          game->player[0]->blastRadius);
+          players->blastRadius[local]);
   DrawText(blastRadiusText, TILE_SIZE * 2, TILE_SIZE * 5, fontSize / 2, WHITE);
 
   // Controls
@@ -445,48 +778,46 @@ _Bool isLastFrame(Animation *animation) {
 
 void renderPlayerAnimation(Animation *animation, Rectangle source,
                            Rectangle dest, float deltaTime) {
+  if (animation->frames == NULL) {
+    return;
+  }
   drawAnimationPro(animation, source, dest, (Vector2){0, 0}, 0, WHITE);
   updateAnimation(animation, deltaTime);
 }
 
-void renderPlayer(Game *game) {
-  Vector2 offset = getGridOffset();
-  for (int i = 0; i < MAX_PLAYERS; i++) {
-    Player *player = game->player[i];
-    Vector2 position = {
-        Lerp(player->entity.position.x, player->entity.targetPosition.x,
-             player->entity.progress),
-        Lerp(player->entity.position.y, player->entity.targetPosition.y,
-             player->entity.progress)};
+void renderPlayer(Game *game, float alpha) {
+  Vector2 offset = gridOffset;
+  for (int i = 0; i < game->match->config.players; i++) {
+    PlayerTable *players = &game->match->players;
+    Animation *animation = playerAnimation[i];
+    Vector2 position = getPlayerCell(game, i, alpha);
     position = (Vector2){TILE_SIZE * position.x + offset.x,
                          TILE_SIZE * position.y + offset.y - 8};
     Rectangle source;
-    if (player->entity.facing == EAST) {
+    if (players->facing[i] == EAST) {
       source = (Rectangle){12, 12, 36, 36};
     } else {
       source = (Rectangle){12, 12, -36, 36};
     }
-    LOG_DEBUG("player->state: %i:%i", i, player->state);
+    LOG_DEBUG("player->state: %i:%i", i, players->state[i]);
     Rectangle dest = {position.x, position.y, TILE_SIZE, TILE_SIZE};
-    switch (player->state) {
+    switch (players->state[i]) {
     case SPAWN:
-      if (!isLastFrame(player->animation[SPAWN])) {
-        renderPlayerAnimation(player->animation[SPAWN], source, dest,
+      if (!isLastFrame(&animation[SPAWN])) {
+        renderPlayerAnimation(&animation[SPAWN], source, dest,
                               game->deltaTime);
       }
       break;
     case IDLE:
-      renderPlayerAnimation(player->animation[IDLE], source, dest,
-                            game->deltaTime);
+      renderPlayerAnimation(&animation[IDLE], source, dest, game->deltaTime);
       break;
     case WALKING:
-      renderPlayerAnimation(player->animation[WALKING], source, dest,
+      renderPlayerAnimation(&animation[WALKING], source, dest,
                             game->deltaTime);
       break;
     case DEATH:
-      if (player->animation[DEATH]->numFrames - 1 !=
-          player->animation[DEATH]->currentFrame) {
-        renderPlayerAnimation(player->animation[DEATH], source, dest,
+      if (!isLastFrame(&animation[DEATH])) {
+        renderPlayerAnimation(&animation[DEATH], source, dest,
                               game->deltaTime);
       }
     default:
@@ -495,92 +826,135 @@ void renderPlayer(Game *game) {
   }
 }
 
-void renderBombs(Game *game) {
-  Vector2 offset = getGridOffset();
-  for (int i = 0; i < MAX_PLAYERS; i++) {
-    Player *player = game->player[i];
-    for (int j = 0; j < player->bombs; j++) {
-      if (player->bombList[j] != NULL) {
-        Bomb *bomb = player->bombList[j];
-        if (bomb->endTime != 0) {
-          Vector2 position = {TILE_SIZE * bomb->entity.position.x + offset.x,
-                              TILE_SIZE * bomb->entity.position.y + offset.y};
-          DrawTextureV(bombTexture, position, WHITE);
-          position.y -= 8;
-          drawAnimationV(bomb->animation, position, WHITE);
-          updateAnimation(bomb->animation, game->deltaTime);
-        }
-      }
+void renderBombs(Game *game, float alpha) {
+  Vector2 offset = gridOffset;
+  BombTable *bombs = &game->match->bombs;
+  for (int i = 0; i < bombs->count; i++) {
+    if (bombs->endTime[i] != 0) {
+      Vector2 position = {TILE_SIZE * bombs->position[i].x + offset.x,
+                          TILE_SIZE * bombs->position[i].y + offset.y};
+      DrawSpriteV(atlas, bombSprite, position, WHITE);
+      position.y -= 8;
+      bombSparkAnimation->currentFrame = getAnimationFrame(
+          bombSparkAnimation,
+          game->match->time + alpha * TICK_TIME - bombs->startTime[i]);
+      drawAnimationV(bombSparkAnimation, position, WHITE);
     }
   }
 }
 
-void renderExplosions(Game *game) {
-  Vector2 offset = getGridOffset();
-  for (int i = 0; i < MAX_PLAYERS; i++) {
-    Player *player = game->player[i];
-    for (int j = 0; j < player->bombs; j++) {
-      Bomb *bomb = player->bombList[j];
-      if (bomb != NULL && bomb->endTime == 0) {
-        for (int k = 0; k < _DIRECTION_NUM; k++) {
-          if (bomb->explosion[k] != NULL) {
-            Explosion *explosion = bomb->explosion[k];
-            float x, y;
-            x = Lerp(explosion->entity.position.x,
-                     explosion->entity.targetPosition.x,
-                     explosion->entity.progress);
-            y = Lerp(explosion->entity.position.y,
-                     explosion->entity.targetPosition.y,
-                     explosion->entity.progress);
-            Vector2 v = {TILE_SIZE * x + offset.x, TILE_SIZE * y + offset.y};
-            Rectangle rec;
-            int rotation = 0;
-            Vector2 origin = {0, 0};
-            switch (k) {
-            case NORTH:
-              rec = (Rectangle){0, 0, 32, 32};
-              rotation = 270;
-              origin = (Vector2){32, 0};
-              break;
-            case EAST:
-              rec = (Rectangle){0, 0, 32, 32};
-              break;
-            case SOUTH:
-              rec = (Rectangle){0, 0, 32, 32};
-              rotation = 90;
-              origin = (Vector2){0, 32};
-              break;
-            case WEST:
-              rec = (Rectangle){0, 0, -32, 32};
-              break;
-            }
-            drawAnimationPro(explosion->animation, rec,
-                             (Rectangle){v.x, v.y, TILE_SIZE, TILE_SIZE},
-                             origin, rotation, WHITE);
-            updateAnimation(explosion->animation, game->deltaTime);
-          }
+void renderExplosions(Game *game, float alpha) {
+  Vector2 offset = gridOffset;
+  ExplosionTable *explosions = &game->match->explosions;
+  for (int i = 0; i < explosions->count; i++) {
+    float elapsed =
+        game->match->time + alpha * TICK_TIME - explosions->startTime[i];
+    float progress = elapsed * explosions->speed[i];
+    if (progress > 1) {
+      progress = 1;
+    }
+    float x, y;
+    x = Lerp(explosions->position[i].x, explosions->targetPosition[i].x,
+             progress);
+    y = Lerp(explosions->position[i].y, explosions->targetPosition[i].y,
+             progress);
+    Vector2 v = {TILE_SIZE * x + offset.x, TILE_SIZE * y + offset.y};
+    Rectangle rec;
+    int rotation = 0;
+    Vector2 origin = {0, 0};
+    switch (explosions->direction[i]) {
+    case NORTH:
+      rec = (Rectangle){0, 0, 32, 32};
+      rotation = 270;
+      origin = (Vector2){32, 0};
+      break;
+    case EAST:
+      rec = (Rectangle){0, 0, 32, 32};
+      break;
+    case SOUTH:
+      rec = (Rectangle){0, 0, 32, 32};
+      rotation = 90;
+      origin = (Vector2){0, 32};
+      break;
+    case WEST:
+    default:
+      rec = (Rectangle){0, 0, -32, 32};
+      break;
+    }
+    explosionBlastAnimation->currentFrame =
+        getAnimationFrame(explosionBlastAnimation, elapsed);
+    drawAnimationPro(explosionBlastAnimation, rec,
+                     (Rectangle){v.x, v.y, TILE_SIZE, TILE_SIZE}, origin,
+                     rotation, WHITE);
+  }
+}
+
+// Visits only the set cells of the item layers, crates just while the
+// board layer is not cached
+void renderItems(Game *game) {
+  Vector2 offset = gridOffset;
+  BoardLayers *layers = &game->match->layers;
+  Position min, max;
+  getVisibleCells(game, &min, &max);
+  for (int y = min.y; y <= max.y; y++) {
+    for (int w = 0; w < BOARD_WORDS; w++) {
+      uint64_t crates = boardLayerActive ? 0 : layers->crates.row[y][w];
+      uint64_t items = layers->powerUps.row[y][w] | crates;
+      for (uint64_t bits = items; bits != 0; bits &= bits - 1) {
+        int bit = __builtin_ctzll(bits);
+        int x = w * 64 + bit;
+        if (x < min.x || x > max.x) {
+          continue;
+        }
+        Vector2 position = {TILE_SIZE * x + offset.x,
+                            TILE_SIZE * y + offset.y};
+        if ((crates >> bit) & 1) {
+          DrawSpriteV(atlas, crateSprite, position, WHITE);
+        } else {
+          drawAnimationV(starAnimation, position, WHITE);
+          updateAnimation(starAnimation, game->deltaTime);
         }
       }
     }
   }
 }
 
-void renderItems(Game *game) {
-  Vector2 offset = getGridOffset();
-  for (int x = 0; x < GRID_WIDTH; x++) {
-    for (int y = 0; y < GRID_HEIGHT; y++) {
-      Cell cell = game->grid[x][y];
-      Vector2 position = {TILE_SIZE * x + offset.x, TILE_SIZE * y + offset.y};
-      switch (cell.type) {
-      case CELL_DESTRUCTIBLE:
-        DrawTextureV(crateTexture, position, WHITE);
-        break;
-      case CELL_POWERUP:
-        drawAnimationV(starAnimation, position, WHITE);
-        updateAnimation(starAnimation, game->deltaTime);
-      default:
-        break;
+// Per zone p50 and p99 in milliseconds and a graph of the kept frames, a
+// bar reaching the top of its row is a full tick
+void renderProfiler() {
+  ProfileZone *zones;
+  int numZones = GetProfileZones(&zones);
+  long frames = GetProfileFrames();
+  int rowHeight = 18;
+  int textWidth = 220;
+  int width = textWidth + PROFILE_HISTORY;
+  int x = GetScreenWidth() - width - TILE_SIZE;
+  int y = TILE_SIZE * 2;
+  DrawRectangle(x - 4, y - 4, width + 8, rowHeight * (numZones + 1) + 8,
+                Fade(BLACK, 0.7f));
+  DrawText("zone", x, y, 10, GRAY);
+  DrawText("p50    p99", x + 140, y, 10, GRAY);
+  for (int i = 0; i < numZones; i++) {
+    ProfileZone *zone = &zones[i];
+    int rowY = y + rowHeight * (i + 1);
+    char text[32];
+    DrawText(zone->name, x + zone->depth * 8, rowY, 10, WHITE);
+    sprintf(text, "%5.2f  %5.2f", GetProfilePercentile(zone, 0.5f),
+            GetProfilePercentile(zone, 0.99f));
+    DrawText(text, x + 140, rowY, 10, WHITE);
+    // Oldest frame on the left
+    for (int j = 0; j < PROFILE_HISTORY; j++) {
+      long frame = frames - PROFILE_HISTORY + j;
+      if (frame < 0) {
+        continue;
       }
+      float ms = zone->history[frame % PROFILE_HISTORY];
+      int height = Clamp(ms * TICK_RATE / 1000 * (rowHeight - 2), 0,
+                         rowHeight - 2);
+      int lineX = x + textWidth + j;
+      DrawLine(lineX, rowY + rowHeight - 2, lineX,
+               rowY + rowHeight - 2 - height,
+               ms * TICK_RATE > 1000 ? RED : GREEN);
     }
   }
 }
@@ -3,22 +3,30 @@
 #include "game.h"
 #include <raylib.h>
 void InitRenderer(Game *game);
-void Render(Game *game);
-Animation *CreateAnimation(Texture2D *frames, int numFrames, float frameSpeed);
-void SetCharAnimationSet(int char_id, Player *player);
+// alpha is the fraction of a tick elapsed since the last simulation step and
+// is used to interpolate moving entities between ticks
+void Render(Game *game, float alpha);
+Animation *CreateAnimation(AtlasSprite *frames, int numFrames,
+                           float frameSpeed);
+// Players using the same character share its frames, the frames are freed
+// once no player holds a reference anymore
+void SetCharAnimationSet(int char_id, int player);
+void ReleaseCharAnimationSet(int player);
+// Called at match end, drops the characters of all players
+void ReleaseCharAnimationSets();
 
 #define STAR_FRAMES_NUM 7
-extern Texture2D *starFrames;
+extern AtlasSprite *starFrames;
 #define BOMB_SPARK_FRAMES_NUM 2
-extern Texture2D *bombSparkFrames;
+extern AtlasSprite *bombSparkFrames;
 #define EXPLOSION_BLAST_FRAMES_NUM 4
-extern Texture2D *explosionBlastFrames;
+extern AtlasSprite *explosionBlastFrames;
 #define CHARACTER_SPAWN_FRAMES_NUM 12
-extern Texture2D *characterSpawnFrames;
+extern AtlasSprite *characterSpawnFrames;
 #define CHARACTER_IDLE_FRAMES_NUM 4
-extern Texture2D *characterIdleFrames;
+extern AtlasSprite *characterIdleFrames;
 #define CHARACTER_WALKING_FRAMES_NUM 6
-extern Texture2D *characterWalkingFrames;
+extern AtlasSprite *characterWalkingFrames;
 #define CHARACTER_DEATH_FRAMES_NUM 10
-extern Texture2D *characterDeathFrames;
+extern AtlasSprite *characterDeathFrames;
 #endif // RENDERER_H
@@ -0,0 +1,58 @@
+#include "clock.h"
+#include "log.h"
+#include "record.h"
+#include "sim.h"
+#include <stdio.h>
+
+// Headless replay. Re-simulates recordings as fast as possible and checks
+// the final state hash, a mismatch means the simulation is no longer
+// deterministic or changed its rules.
+//
+//   ./replay recording...
+
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s recording...\n", argv[0]);
+    return 1;
+  }
+  currentLogLevel = LOG_LEVEL_WARN;
+  int failed = 0;
+  long totalTicks = 0;
+  double totalSeconds = 0;
+  for (int i = 1; i < argc; i++) {
+    Recording *recording = LoadRecording(argv[i]);
+    if (recording == NULL) {
+      failed++;
+      continue;
+    }
+    double start = GetWallTime();
+    Match *match = ReplayRecording(recording);
+    double seconds = GetWallTime() - start;
+    if (match == NULL) {
+      fprintf(stderr, "%s: invalid match config\n", argv[i]);
+      FreeRecording(recording);
+      failed++;
+      continue;
+    }
+    uint64_t hash = HashMatch(match);
+    _Bool ok = hash == recording->hash;
+    printf("%s: %ld ticks, %d commands, %.3f ms, %.0f ticks/s, %s\n", argv[i],
+           recording->ticks, recording->numCommands, seconds * 1000,
+           recording->ticks / seconds, ok ? "ok" : "HASH MISMATCH");
+    if (!ok) {
+      fprintf(stderr, "%s: expected hash %016llx, got %016llx\n", argv[i],
+              (unsigned long long)recording->hash, (unsigned long long)hash);
+      failed++;
+    }
+    totalTicks += recording->ticks;
+    totalSeconds += seconds;
+    FreeMatch(match);
+    FreeRecording(recording);
+  }
+  if (argc > 2) {
+    printf("total: %ld ticks, %.3f s, %.0f ticks/s, %d failed\n", totalTicks,
+           totalSeconds, totalTicks / totalSeconds, failed);
+  }
+  return failed > 0;
+}
@@ -0,0 +1,712 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include "clock.h"
+#include "delta.h"
+#include "log.h"
+#include "pool.h"
+#include "record.h"
+#include "sim.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// Dedicated match server. Hosts independent lobbies without window or GPU.
+// Lobbies are split into shards, one thread per shard pinned to a core, and
+// every shard owns its socket, timer and lobbies, so shards share nothing.
+// A shard sleeps in epoll until packets arrive or its tick timer fires,
+// reads and writes in batches with recvmmsg and sendmmsg and after every
+// tick sends every client the state of its match as a delta to the last
+// state it acknowledged. See server.h for the protocol and loadgen.c for a
+// client.
+//
+//   ./server [port] [shards]
+//
+// SERVER_LOBBIES caps the lobbies of a shard, SERVER_MAP_SIZE sets the map
+// and SERVER_SEND_INTERVAL the ticks between two states sent to a client.
+
+#define DEFAULT_LOBBIES 1024
+// Messages per recvmmsg and sendmmsg call
+#define SERVER_BATCH 64
+// A tick timer that fell further behind drops the rest
+#define MAX_CATCHUP_TICKS 5
+// Ticks the decided match keeps running before the next one starts
+#define MATCH_END_TICKS (3 * TICK_RATE)
+// A lobby no client sent anything to for this long is closed
+#define LOBBY_IDLE_TICKS (10 * TICK_RATE)
+// Seconds between two stats reports
+#define STATS_INTERVAL 5
+
+typedef enum {
+  LOBBY_FREE,
+  LOBBY_ACTIVE,
+  // Removed, kept so lookups probe past it
+  LOBBY_CLOSED,
+} LobbyState;
+
+typedef struct {
+  uint32_t nonce;
+  struct sockaddr_in address;
+  // Commands received since the last tick
+  uint8_t input;
+  // Last state the client decoded, 0 for none
+  uint32_t ack;
+} LobbyClient;
+
+typedef struct {
+  LobbyState state;
+  uint32_t id;
+  int numClients;
+  LobbyClient clients[SERVER_MAX_LOBBY_PLAYERS];
+  Match *match;
+  long lastPacketTick;
+  // Views of the last states sent, state i is at i % SERVER_STATE_HISTORY
+  StateView *history[SERVER_STATE_HISTORY];
+  uint32_t lastState;
+} Lobby;
+
+// Written by the shard, read by the stats report
+typedef struct {
+  atomic_long ticks;
+  atomic_long busyNs;
+  atomic_long overruns;
+  atomic_int lobbies;
+  atomic_int clients;
+  atomic_long packetsIn;
+  atomic_long packetsOut;
+  atomic_long bytesOut;
+  atomic_long sendDrops;
+} ShardStats;
+
+typedef struct {
+  int index;
+  int port;
+  int socket;
+  int epoll;
+  int timer;
+  pthread_t thread;
+  // Open addressing on the lobby id with linear probing
+  Lobby *lobbies;
+  // Same size, the lobbies are rehashed into it once too many are closed
+  Lobby *spareLobbies;
+  int capacity;
+  int maxLobbies;
+  int numLobbies;
+  int numClosed;
+  long tick;
+  MatchConfig config;
+  int sendInterval;
+  // Batched receive
+  struct mmsghdr recvMessages[SERVER_BATCH];
+  struct iovec recvVectors[SERVER_BATCH];
+  struct sockaddr_in recvAddresses[SERVER_BATCH];
+  uint8_t recvBuffers[SERVER_BATCH][SERVER_MAX_PACKET];
+  // Batched send, flushed when full and after every tick
+  int numSends;
+  struct mmsghdr sendMessages[SERVER_BATCH];
+  struct iovec sendVectors[SERVER_BATCH];
+  struct sockaddr_in sendAddresses[SERVER_BATCH];
+  uint8_t sendBuffers[SERVER_BATCH][SERVER_MAX_PACKET];
+  ShardStats stats;
+} Shard;
+
+static volatile sig_atomic_t running = 1;
+
+_Bool initShard(Shard *shard, int index, int port);
+void *runShard(void *arg);
+void receiveBatch(Shard *shard);
+void handlePacket(Shard *shard, const uint8_t *data, int length,
+                  struct sockaddr_in *from);
+void handleJoin(Shard *shard, const uint8_t *data, int length,
+                struct sockaddr_in *from);
+void handleInput(Shard *shard, const uint8_t *data, int length);
+void tickShard(Shard *shard);
+void tickLobby(Shard *shard, Lobby *lobby);
+void startMatch(Shard *shard, Lobby *lobby, MatchConfig config);
+void sendState(Shard *shard, Lobby *lobby);
+Lobby *findLobby(Shard *shard, uint32_t id, _Bool create);
+void closeLobby(Shard *shard, Lobby *lobby);
+void rehashLobbies(Shard *shard);
+void addBusyTime(Shard *shard, double start);
+uint8_t *queueSend(Shard *shard, struct sockaddr_in *address);
+void commitSend(Shard *shard, int length);
+void flushSends(Shard *shard);
+void reportStats(Shard *shards, int numShards, double seconds,
+                 ShardStats *previous);
+void stopServer(int signum);
+
+int main(int argc, char *argv[]) {
+  int port = argc > 1 ? atoi(argv[1]) : SERVER_DEFAULT_PORT;
+  int numShards = argc > 2 ? atoi(argv[2]) : GetNumCores();
+  if (port <= 0 || port > 65535 || numShards < 1) {
+    fprintf(stderr, "usage: %s [port] [shards]\n", argv[0]);
+    return 1;
+  }
+  // The matches log every bomb
+  currentLogLevel = LOG_LEVEL_WARN;
+  signal(SIGINT, stopServer);
+  signal(SIGTERM, stopServer);
+
+  Shard *shards = (Shard *)calloc(numShards, sizeof(Shard));
+  ShardStats *previous = (ShardStats *)calloc(numShards, sizeof(ShardStats));
+  if (shards == NULL || previous == NULL) {
+    LOG_ERROR("Allocation of shards failed!", NULL);
+    return 1;
+  }
+  for (int i = 0; i < numShards; i++) {
+    if (!initShard(&shards[i], i, port + i)) {
+      return 1;
+    }
+  }
+  for (int i = 0; i < numShards; i++) {
+    if (pthread_create(&shards[i].thread, NULL, runShard, &shards[i]) != 0) {
+      LOG_ERROR("Starting shard %i failed!", i);
+      return 1;
+    }
+  }
+  printf("Serving %ix%i matches on ports %i-%i with %i shards\n",
+         shards[0].config.width, shards[0].config.height, port,
+         port + numShards - 1, numShards);
+  fflush(stdout);
+  double last = GetWallTime();
+  while (running) {
+    sleep(1);
+    double now = GetWallTime();
+    if (now - last >= STATS_INTERVAL) {
+      reportStats(shards, numShards, now - last, previous);
+      last = now;
+    }
+  }
+  for (int i = 0; i < numShards; i++) {
+    pthread_join(shards[i].thread, NULL);
+  }
+  reportStats(shards, numShards, GetWallTime() - last, previous);
+  return 0;
+}
+
+_Bool initShard(Shard *shard, int index, int port) {
+  shard->index = index;
+  shard->port = port;
+  shard->maxLobbies =
+      getenv("SERVER_LOBBIES") ? atoi(getenv("SERVER_LOBBIES")) : 0;
+  if (shard->maxLobbies < 1) {
+    shard->maxLobbies = DEFAULT_LOBBIES;
+  }
+  // Twice the lobbies keeps probe sequences short
+  shard->capacity = shard->maxLobbies * 2;
+  shard->lobbies = (Lobby *)calloc(shard->capacity, sizeof(Lobby));
+  shard->spareLobbies = (Lobby *)calloc(shard->capacity, sizeof(Lobby));
+  if (shard->lobbies == NULL || shard->spareLobbies == NULL) {
+    LOG_ERROR("Allocation of lobbies failed!", NULL);
+    return 0;
+  }
+  int size = getenv("SERVER_MAP_SIZE") ? atoi(getenv("SERVER_MAP_SIZE"))
+                                       : DEFAULT_GRID_SIZE;
+  shard->config = (MatchConfig){size, size, DEFAULT_PLAYERS};
+  // Joining clients get a full state, it has to fit into a packet
+  Match *probe = InitMatchWithConfig(shard->config, 1);
+  StateView *view = CreateStateView(shard->config);
+  if (probe == NULL || view == NULL) {
+    return 0;
+  }
+  CaptureStateView(view, probe);
+  uint8_t state[SERVER_MAX_PACKET];
+  int length = EncodeStateDelta(NULL, view, state,
+                                SERVER_MAX_PACKET - SERVER_STATE_HEADER);
+  FreeStateView(view);
+  FreeMatch(probe);
+  if (length < 0) {
+    LOG_ERROR("A %ix%i map does not fit into a state packet!", size, size);
+    return 0;
+  }
+  shard->sendInterval = getenv("SERVER_SEND_INTERVAL")
+                            ? atoi(getenv("SERVER_SEND_INTERVAL"))
+                            : 1;
+  if (shard->sendInterval < 1) {
+    shard->sendInterval = 1;
+  }
+  // Receive buffers are fixed, only the lengths change between calls
+  for (int i = 0; i < SERVER_BATCH; i++) {
+    shard->recvVectors[i] = (struct iovec){shard->recvBuffers[i],
+                                           SERVER_MAX_PACKET};
+    shard->recvMessages[i].msg_hdr = (struct msghdr){
+        .msg_name = &shard->recvAddresses[i],
+        .msg_namelen = sizeof(struct sockaddr_in),
+        .msg_iov = &shard->recvVectors[i],
+        .msg_iovlen = 1,
+    };
+  }
+
+  shard->socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  struct sockaddr_in local = {.sin_family = AF_INET,
+                              .sin_addr.s_addr = htonl(INADDR_ANY),
+                              .sin_port = htons(port)};
+  if (shard->socket < 0 ||
+      bind(shard->socket, (struct sockaddr *)&local, sizeof(local)) < 0) {
+    LOG_ERROR("Cannot bind port %i: %s", port, strerror(errno));
+    return 0;
+  }
+  // Room for the bursts of a tick
+  int buffer = 4 << 20;
+  setsockopt(shard->socket, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+  setsockopt(shard->socket, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+
+  shard->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  long interval = 1000000000L / TICK_RATE;
+  struct itimerspec spec = {{0, interval}, {0, interval}};
+  if (shard->timer < 0 || timerfd_settime(shard->timer, 0, &spec, NULL) < 0) {
+    LOG_ERROR("Cannot create tick timer: %s", strerror(errno));
+    return 0;
+  }
+  shard->epoll = epoll_create1(0);
+  struct epoll_event socketEvent = {.events = EPOLLIN,
+                                    .data.fd = shard->socket};
+  struct epoll_event timerEvent = {.events = EPOLLIN, .data.fd = shard->timer};
+  if (shard->epoll < 0 ||
+      epoll_ctl(shard->epoll, EPOLL_CTL_ADD, shard->socket, &socketEvent) < 0 ||
+      epoll_ctl(shard->epoll, EPOLL_CTL_ADD, shard->timer, &timerEvent) < 0) {
+    LOG_ERROR("Cannot create epoll: %s", strerror(errno));
+    return 0;
+  }
+  return 1;
+}
+
+void *runShard(void *arg) {
+  Shard *shard = (Shard *)arg;
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(shard->index % GetNumCores(), &cpus);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+    LOG_WARN("Cannot pin shard %i", shard->index);
+  }
+  struct epoll_event events[2];
+  while (running) {
+    // Wakes up regularly to notice a stop
+    int count = epoll_wait(shard->epoll, events, 2, 100);
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.fd == shard->socket) {
+        receiveBatch(shard);
+        continue;
+      }
+      uint64_t expirations;
+      if (read(shard->timer, &expirations, sizeof(expirations)) <= 0) {
+        continue;
+      }
+      if (expirations > MAX_CATCHUP_TICKS) {
+        atomic_fetch_add(&shard->stats.overruns,
+                         expirations - MAX_CATCHUP_TICKS);
+        expirations = MAX_CATCHUP_TICKS;
+      }
+      for (uint64_t j = 0; j < expirations; j++) {
+        tickShard(shard);
+      }
+    }
+  }
+  return NULL;
+}
+
+// Handling packets counts as busy time just like ticks
+void receiveBatch(Shard *shard) {
+  double start = GetWallTime();
+  for (;;) {
+    for (int i = 0; i < SERVER_BATCH; i++) {
+      shard->recvMessages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    int count = recvmmsg(shard->socket, shard->recvMessages, SERVER_BATCH,
+                         MSG_DONTWAIT, NULL);
+    if (count <= 0) {
+      break;
+    }
+    atomic_fetch_add_explicit(&shard->stats.packetsIn, count,
+                              memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+      handlePacket(shard, shard->recvBuffers[i],
+                   shard->recvMessages[i].msg_len, &shard->recvAddresses[i]);
+    }
+    if (count < SERVER_BATCH) {
+      break;
+    }
+  }
+  addBusyTime(shard, start);
+}
+
+void handlePacket(Shard *shard, const uint8_t *data, int length,
+                  struct sockaddr_in *from) {
+  if (length < 5 || ServerGetUint(data, 4) != SERVER_MAGIC) {
+    return;
+  }
+  switch (data[4]) {
+  case SERVER_JOIN:
+    handleJoin(shard, data + 5, length - 5, from);
+    break;
+  case SERVER_INPUT:
+    handleInput(shard, data + 5, length - 5);
+    break;
+  }
+}
+
+// Takes the next free player of the lobby, a repeated JOIN gets the same
+void handleJoin(Shard *shard, const uint8_t *data, int length,
+                struct sockaddr_in *from) {
+  if (length < 9) {
+    return;
+  }
+  uint32_t id = ServerGetUint(data, 4);
+  int players = data[4];
+  uint32_t nonce = ServerGetUint(data + 5, 4);
+  Lobby *lobby = findLobby(shard, id, 1);
+  if (lobby != NULL && lobby->match == NULL) {
+    MatchConfig config = shard->config;
+    if (players >= 1 && players <= SERVER_MAX_LOBBY_PLAYERS) {
+      config.players = players;
+    }
+    startMatch(shard, lobby, config);
+    if (lobby->match == NULL) {
+      closeLobby(shard, lobby);
+      lobby = NULL;
+    }
+  }
+  int player = -1;
+  if (lobby != NULL) {
+    for (int i = 0; i < lobby->numClients; i++) {
+      if (lobby->clients[i].nonce == nonce) {
+        player = i;
+      }
+    }
+    if (player < 0 && lobby->numClients < lobby->match->config.players) {
+      player = lobby->numClients++;
+      lobby->clients[player] = (LobbyClient){nonce, *from, 0, 0};
+      atomic_fetch_add(&shard->stats.clients, 1);
+    }
+  }
+  uint8_t *reply = queueSend(shard, from);
+  ServerPutUint(reply, SERVER_MAGIC, 4);
+  if (player < 0) {
+    reply[4] = SERVER_FULL;
+    ServerPutUint(reply + 5, id, 4);
+    commitSend(shard, 9);
+    return;
+  }
+  lobby->clients[player].address = *from;
+  lobby->lastPacketTick = shard->tick;
+  MatchConfig *config = &lobby->match->config;
+  reply[4] = SERVER_WELCOME;
+  ServerPutUint(reply + 5, id, 4);
+  reply[9] = player;
+  ServerPutUint(reply + 10, lobby->match->seed, 4);
+  reply[14] = config->width;
+  reply[15] = config->height;
+  reply[16] = config->players;
+  ServerPutUint(reply + 17, nonce, 4);
+  commitSend(shard, 21);
+}
+
+void handleInput(Shard *shard, const uint8_t *data, int length) {
+  if (length < 14) {
+    return;
+  }
+  Lobby *lobby = findLobby(shard, ServerGetUint(data, 4), 0);
+  int player = data[4];
+  if (lobby == NULL || player >= lobby->numClients ||
+      lobby->clients[player].nonce != ServerGetUint(data + 5, 4)) {
+    return;
+  }
+  LobbyClient *client = &lobby->clients[player];
+  uint8_t input = data[9];
+  // The first move since the last tick wins, plants are kept
+  if (client->input & INPUT_MOVE) {
+    input &= ~(INPUT_MOVE | INPUT_DIRECTION);
+  }
+  client->input |= input;
+  // Acks only move forward and never past the last state sent
+  uint32_t ack = ServerGetUint(data + 10, 4);
+  if (ack > client->ack && ack <= lobby->lastState) {
+    client->ack = ack;
+  }
+  lobby->lastPacketTick = shard->tick;
+}
+
+void tickShard(Shard *shard) {
+  double start = GetWallTime();
+  shard->tick++;
+  for (int i = 0; i < shard->capacity; i++) {
+    if (shard->lobbies[i].state == LOBBY_ACTIVE) {
+      tickLobby(shard, &shard->lobbies[i]);
+    }
+  }
+  flushSends(shard);
+  // Probes stay short while at least a quarter of the slots is free
+  if (shard->numClosed > shard->capacity / 4) {
+    rehashLobbies(shard);
+  }
+  addBusyTime(shard, start);
+  atomic_fetch_add_explicit(&shard->stats.ticks, 1, memory_order_relaxed);
+}
+
+void addBusyTime(Shard *shard, double start) {
+  long busy = (long)((GetWallTime() - start) * 1e9);
+  atomic_fetch_add_explicit(&shard->stats.busyNs, busy, memory_order_relaxed);
+}
+
+void tickLobby(Shard *shard, Lobby *lobby) {
+  if (shard->tick - lobby->lastPacketTick > LOBBY_IDLE_TICKS) {
+    closeLobby(shard, lobby);
+    return;
+  }
+  Match *match = lobby->match;
+  if (match->overTick >= 0 &&
+      match->tick >= match->overTick + MATCH_END_TICKS) {
+    startMatch(shard, lobby, match->config);
+    match = lobby->match;
+    if (match == NULL) {
+      closeLobby(shard, lobby);
+      return;
+    }
+  }
+  for (int i = 0; i < lobby->numClients; i++) {
+    ApplyInput(match, i, lobby->clients[i].input);
+    lobby->clients[i].input = 0;
+  }
+  StepMatch(match, TICK_TIME);
+  if (match->tick % shard->sendInterval == 0) {
+    sendState(shard, lobby);
+  }
+}
+
+// Clients that acknowledged the same state share its encoding
+void sendState(Shard *shard, Lobby *lobby) {
+  uint32_t id = ++lobby->lastState;
+  StateView *view = lobby->history[id % SERVER_STATE_HISTORY];
+  CaptureStateView(view, lobby->match);
+  uint32_t bases[SERVER_MAX_LOBBY_PLAYERS];
+  uint8_t *encoded[SERVER_MAX_LOBBY_PLAYERS];
+  int lengths[SERVER_MAX_LOBBY_PLAYERS];
+  int numEncoded = 0;
+  for (int i = 0; i < lobby->numClients; i++) {
+    LobbyClient *client = &lobby->clients[i];
+    // An ack the history no longer holds gets the full state
+    uint32_t base = id - client->ack < SERVER_STATE_HISTORY ? client->ack : 0;
+    uint8_t *data = queueSend(shard, &client->address);
+    int j = 0;
+    while (j < numEncoded && bases[j] != base) {
+      j++;
+    }
+    if (j < numEncoded) {
+      memcpy(data, encoded[j], lengths[j]);
+      commitSend(shard, lengths[j]);
+    } else {
+      ServerPutUint(data, SERVER_MAGIC, 4);
+      data[4] = SERVER_STATE;
+      ServerPutUint(data + 5, lobby->id, 4);
+      ServerPutUint(data + 9, id, 4);
+      ServerPutUint(data + 13, base, 4);
+      StateView *from =
+          base != 0 ? lobby->history[base % SERVER_STATE_HISTORY] : NULL;
+      int length = EncodeStateDelta(from, view, data + SERVER_STATE_HEADER,
+                                    SERVER_MAX_PACKET - SERVER_STATE_HEADER);
+      if (length < 0) {
+        atomic_fetch_add(&shard->stats.sendDrops, 1);
+        continue;
+      }
+      bases[numEncoded] = base;
+      encoded[numEncoded] = data;
+      lengths[numEncoded++] = SERVER_STATE_HEADER + length;
+      commitSend(shard, SERVER_STATE_HEADER + length);
+    }
+    // A flush moved the encoded states out of the batch
+    if (shard->numSends == 0) {
+      numEncoded = 0;
+    }
+  }
+}
+
+// Seeds are drawn from the lobby and the shard clock
+void startMatch(Shard *shard, Lobby *lobby, MatchConfig config) {
+  FreeMatch(lobby->match);
+  unsigned int seed = lobby->id * 2654435761u ^ (unsigned int)shard->tick;
+  lobby->match = InitMatchWithConfig(config, seed);
+  // The history outlives the matches, clients keep their acks
+  for (int i = 0; i < SERVER_STATE_HISTORY && lobby->match != NULL; i++) {
+    if (lobby->history[i] == NULL) {
+      lobby->history[i] = CreateStateView(config);
+    }
+    if (lobby->history[i] == NULL) {
+      FreeMatch(lobby->match);
+      lobby->match = NULL;
+    }
+  }
+}
+
+Lobby *findLobby(Shard *shard, uint32_t id, _Bool create) {
+  Lobby *closed = NULL;
+  uint32_t home = id % shard->capacity;
+  for (int i = 0; i < shard->capacity; i++) {
+    Lobby *lobby = &shard->lobbies[(home + i) % shard->capacity];
+    if (lobby->state == LOBBY_ACTIVE && lobby->id == id) {
+      return lobby;
+    }
+    if (lobby->state == LOBBY_CLOSED && closed == NULL) {
+      closed = lobby;
+    }
+    if (lobby->state == LOBBY_FREE) {
+      if (closed == NULL) {
+        closed = lobby;
+      }
+      break;
+    }
+  }
+  if (!create || closed == NULL || shard->numLobbies >= shard->maxLobbies) {
+    return NULL;
+  }
+  if (closed->state == LOBBY_CLOSED) {
+    shard->numClosed--;
+  }
+  *closed = (Lobby){.state = LOBBY_ACTIVE,
+                    .id = id,
+                    .lastPacketTick = shard->tick};
+  shard->numLobbies++;
+  atomic_fetch_add(&shard->stats.lobbies, 1);
+  return closed;
+}
+
+void closeLobby(Shard *shard, Lobby *lobby) {
+  FreeMatch(lobby->match);
+  for (int i = 0; i < SERVER_STATE_HISTORY; i++) {
+    FreeStateView(lobby->history[i]);
+  }
+  atomic_fetch_sub(&shard->stats.clients, lobby->numClients);
+  atomic_fetch_sub(&shard->stats.lobbies, 1);
+  *lobby = (Lobby){.state = LOBBY_CLOSED};
+  shard->numLobbies--;
+  shard->numClosed++;
+  // A tombstone in front of a free slot ends no probe sequence, nor does
+  // one in front of it then
+  int i = lobby - shard->lobbies;
+  while (shard->lobbies[i].state == LOBBY_CLOSED &&
+         shard->lobbies[(i + 1) % shard->capacity].state == LOBBY_FREE) {
+    shard->lobbies[i].state = LOBBY_FREE;
+    shard->numClosed--;
+    i = (i + shard->capacity - 1) % shard->capacity;
+  }
+}
+
+// Moves the active lobbies into the spare table without tombstones, only
+// between ticks as it moves lobbies to other slots
+void rehashLobbies(Shard *shard) {
+  Lobby *lobbies = shard->spareLobbies;
+  memset(lobbies, 0, sizeof(Lobby) * shard->capacity);
+  for (int i = 0; i < shard->capacity; i++) {
+    Lobby *lobby = &shard->lobbies[i];
+    if (lobby->state != LOBBY_ACTIVE) {
+      continue;
+    }
+    uint32_t slot = lobby->id % shard->capacity;
+    while (lobbies[slot].state != LOBBY_FREE) {
+      slot = (slot + 1) % shard->capacity;
+    }
+    lobbies[slot] = *lobby;
+  }
+  shard->spareLobbies = shard->lobbies;
+  shard->lobbies = lobbies;
+  shard->numClosed = 0;
+}
+
+// Buffer of the next message in the send batch
+uint8_t *queueSend(Shard *shard, struct sockaddr_in *address) {
+  if (shard->numSends == SERVER_BATCH) {
+    flushSends(shard);
+  }
+  int i = shard->numSends;
+  shard->sendAddresses[i] = *address;
+  return shard->sendBuffers[i];
+}
+
+void commitSend(Shard *shard, int length) {
+  int i = shard->numSends++;
+  shard->sendVectors[i] = (struct iovec){shard->sendBuffers[i], length};
+  shard->sendMessages[i].msg_hdr = (struct msghdr){
+      .msg_name = &shard->sendAddresses[i],
+      .msg_namelen = sizeof(struct sockaddr_in),
+      .msg_iov = &shard->sendVectors[i],
+      .msg_iovlen = 1,
+  };
+  atomic_fetch_add_explicit(&shard->stats.bytesOut, length,
+                            memory_order_relaxed);
+  if (shard->numSends == SERVER_BATCH) {
+    flushSends(shard);
+  }
+}
+
+// A full socket buffer drops the rest of the batch, the next state
+// replaces it anyway
+void flushSends(Shard *shard) {
+  int sent = 0;
+  while (sent < shard->numSends) {
+    int count = sendmmsg(shard->socket, shard->sendMessages + sent,
+                         shard->numSends - sent, 0);
+    if (count <= 0) {
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      atomic_fetch_add(&shard->stats.sendDrops, shard->numSends - sent);
+      break;
+    }
+    sent += count;
+  }
+  atomic_fetch_add_explicit(&shard->stats.packetsOut, sent,
+                            memory_order_relaxed);
+  shard->numSends = 0;
+}
+
+// Capacity is estimated from the time the shards spend ticking and handling
+// packets per tick: a shard is full once that takes as long as the tick
+// interval
+void reportStats(Shard *shards, int numShards, double seconds,
+                 ShardStats *previous) {
+  long totalLobbies = 0;
+  double totalCapacity = 0;
+  for (int i = 0; i < numShards; i++) {
+    ShardStats *stats = &shards[i].stats;
+    ShardStats *last = &previous[i];
+    long ticks = atomic_load(&stats->ticks) - atomic_load(&last->ticks);
+    long busyNs = atomic_load(&stats->busyNs) - atomic_load(&last->busyNs);
+    long packetsIn =
+        atomic_load(&stats->packetsIn) - atomic_load(&last->packetsIn);
+    long packetsOut =
+        atomic_load(&stats->packetsOut) - atomic_load(&last->packetsOut);
+    long bytesOut =
+        atomic_load(&stats->bytesOut) - atomic_load(&last->bytesOut);
+    int lobbies = atomic_load(&stats->lobbies);
+    double tickUs = ticks > 0 ? busyNs / 1e3 / ticks : 0;
+    double load = tickUs * TICK_RATE / 1e6;
+    double capacity = load > 0.001 ? lobbies / load : 0;
+    printf("shard %i: %i lobbies, %i clients, busy %.0f us/tick (%.0f%% load), "
+           "%.0f in/s, %.0f out/s, %.2f MB/s, %ld overruns, %ld send drops"
+           ", ~%.0f matches/core\n",
+           i, lobbies, atomic_load(&stats->clients), tickUs, load * 100,
+           packetsIn / seconds, packetsOut / seconds, bytesOut / seconds / 1e6,
+           atomic_load(&stats->overruns), atomic_load(&stats->sendDrops),
+           capacity);
+    totalLobbies += lobbies;
+    totalCapacity += capacity;
+    atomic_store(&last->ticks, atomic_load(&stats->ticks));
+    atomic_store(&last->busyNs, atomic_load(&stats->busyNs));
+    atomic_store(&last->packetsIn, atomic_load(&stats->packetsIn));
+    atomic_store(&last->packetsOut, atomic_load(&stats->packetsOut));
+    atomic_store(&last->bytesOut, atomic_load(&stats->bytesOut));
+  }
+  printf("total: %ld lobbies, ~%.0f matches/core\n", totalLobbies,
+         totalCapacity / numShards);
+  fflush(stdout);
+}
+
+void stopServer(int signum) { running = 0; }
@@ -0,0 +1,57 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+// Protocol of the dedicated match server, shared with the load generator.
+// The server runs one shard per core, shard i listens on SERVER_PORT + i.
+// A lobby lives on the shard its clients send to, clients of lobby l pick
+// shard l % shards.
+//
+// Packets, little endian, start with the magic and the type:
+//   JOIN     lobby u32, players u8, nonce u32
+//   WELCOME  lobby u32, player u8, seed u32, width u8, height u8, players u8,
+//            nonce u32
+//   INPUT    lobby u32, player u8, nonce u32, input u8 (see record.h),
+//            ack u32
+//   STATE    lobby u32, state u32, base u32, delta (see delta.h)
+//   FULL     lobby u32
+// The nonce tells a repeated JOIN from a new client and keeps clients from
+// sending inputs for other players.
+//
+// States of a lobby are numbered from 1. A client acks the last state it
+// decoded with every input, the server encodes the next state against that
+// one, or against the empty view for base 0. A client has to keep the last
+// SERVER_STATE_HISTORY states, older acks get a full state.
+
+#define SERVER_MAGIC 0x56534d42 // "BMSV"
+#define SERVER_DEFAULT_PORT 7500
+// Largest packet either side sends, below a typical MTU
+#define SERVER_MAX_PACKET 1400
+#define SERVER_MAX_LOBBY_PLAYERS 8
+#define SERVER_STATE_HISTORY 16
+// Bytes of a STATE before the delta
+#define SERVER_STATE_HEADER 17
+
+typedef enum {
+  SERVER_JOIN = 1,
+  SERVER_WELCOME,
+  SERVER_INPUT,
+  SERVER_STATE,
+  SERVER_FULL,
+} ServerPacketType;
+
+static inline void ServerPutUint(uint8_t *data, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    data[i] = value >> (8 * i);
+  }
+}
+
+static inline uint64_t ServerGetUint(const uint8_t *data, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++) {
+    value |= (uint64_t)data[i] << (8 * i);
+  }
+  return value;
+}
+#endif // SERVER_H
@@ -0,0 +1,1051 @@
+#include "sim.h"
+#include "bitboard.h"
+#include "log.h"
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Random functions
+int matchRand(Match *match);
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size);
+
+// Where the layers of a match go. In a batch of count matches every layer
+// holds that layer of all of them, the match is the one at index.
+typedef struct {
+  char *base;
+  size_t offset;
+  int count;
+  int index;
+} MatchLayout;
+
+// Layout functions
+_Bool isValidConfig(MatchConfig config);
+size_t layoutMatch(Match *match, char *base, int count, int index);
+void *placeLayer(MatchLayout *layout, size_t size);
+void stepBatchPass(Match *matches, int count, float deltaTime);
+
+// Grid functions
+void initGrid(Match *match);
+void initWalls(Bitboard *walls);
+void initSpawnProtection(Match *match, Bitboard *protected);
+void initSpawns(Match *match);
+int spawnCoordinate(int index, int count, int size);
+void updateCell(Match *match, Position position, CellType cellType);
+Bitboard *getLayer(Match *match, CellType cellType);
+void updateBurning(Match *match, Position position, int change);
+void setBombAt(Match *match, Position position, int bomb);
+_Bool isCollision(Match *match, Position next);
+
+// Position functions
+_Bool isEqPos(Position p1, Position p2);
+
+// Player functions
+void initPlayer(Match *match, int id);
+void setPlayerPosition(Match *match, int player, Position position);
+void updatePlayerSpawn(Match *match);
+void storePrevProgress(Match *match);
+void checkPlayerAlive(Match *match);
+
+// Bomb
+void detonateBomb(Match *match, int bomb);
+void createExplosion(Match *match, int bomb, Direction direction);
+void removeExplosion(Match *match, int explosion);
+
+// Blast events
+void scheduleBlastEvent(Match *match, double time, int explosion);
+BlastEvent popBlastEvent(Match *match);
+void processBlastEvents(Match *match);
+void advanceFlameFront(Match *match, int explosion);
+int findBlocker(Match *match, Position pos, Direction direction, int first,
+                int radius);
+_Bool killPlayersAt(Match *match, Position pos);
+int getBomb(Match *match, Position pos);
+
+// Destructible
+void breakDestructibel(Match *match, Position pos);
+
+// Items
+void checkPlayerOnPowerUp(Match *match);
+void collectPowerUp(Match *match, Position pos, int player);
+
+Match *InitMatch(unsigned int seed) {
+  MatchConfig config = {DEFAULT_GRID_SIZE, DEFAULT_GRID_SIZE, DEFAULT_PLAYERS};
+  return InitMatchWithConfig(config, seed);
+}
+
+Match *InitMatchWithConfig(MatchConfig config, unsigned int seed) {
+  size_t size = GetMatchSize(config);
+  if (size == 0) {
+    LOG_ERROR("Invalid match config %ix%i with %i players!", config.width,
+              config.height, config.players);
+    return NULL;
+  }
+  Match *match = (Match *)malloc(size);
+  if (match == NULL) {
+    LOG_ERROR("Allocation of match failed!", NULL);
+    return NULL;
+  }
+  return InitMatchAt(match, config, seed);
+}
+
+size_t GetMatchSize(MatchConfig config) {
+  if (!isValidConfig(config)) {
+    return 0;
+  }
+  Match header = {.config = config};
+  return layoutMatch(&header, NULL, 1, 0);
+}
+
+Match *InitMatchAt(void *memory, MatchConfig config, unsigned int seed) {
+  Match *match = (Match *)memory;
+  match->config = config;
+  match->size = layoutMatch(match, (char *)match, 1, 0);
+  ResetMatch(match, seed);
+  return match;
+}
+
+void ResetMatch(Match *match, unsigned int seed) {
+  MatchConfig config = match->config;
+  match->seed = seed;
+  // xorshift must not start from zero
+  match->rngState = seed ? seed : 1;
+  match->time = 0;
+  match->tick = 0;
+  match->overTick = -1;
+  match->deltaTime = 0;
+  match->countdown = 3;
+  match->bombs.count = 0;
+  match->explosions.count = 0;
+  match->blastQueue.count = 0;
+  match->cellChanges = 0;
+  // Initialize grid
+  initSpawns(match);
+  initGrid(match);
+  // Initialize players
+  for (int i = 0; i < config.players; i++) {
+    initPlayer(match, i);
+  }
+}
+
+size_t GetMatchBatchSize(MatchConfig config, int count) {
+  if (!isValidConfig(config) || count < 1) {
+    return 0;
+  }
+  Match header = {.config = config};
+  return layoutMatch(&header, NULL, count, 0);
+}
+
+Match *InitMatchBatch(void *memory, MatchConfig config, int count) {
+  Match *matches = (Match *)memory;
+  for (int i = 0; i < count; i++) {
+    matches[i].config = config;
+    layoutMatch(&matches[i], (char *)memory, count, i);
+    // Not one block, see SnapshotMatch
+    matches[i].size = 0;
+  }
+  return matches;
+}
+
+_Bool isValidConfig(MatchConfig config) {
+  if (config.width < MIN_GRID_SIZE || config.width > MAX_GRID_SIZE ||
+      config.width % 2 == 0) {
+    return 0;
+  }
+  if (config.height < MIN_GRID_SIZE || config.height > MAX_GRID_SIZE ||
+      config.height % 2 == 0) {
+    return 0;
+  }
+  if (config.players < 1 || config.players > MAX_PLAYERS) {
+    return 0;
+  }
+  // Spawns sit on a lattice of the odd cells
+  int columns = 1;
+  while (columns * columns < config.players) {
+    columns++;
+  }
+  int rows = (config.players + columns - 1) / columns;
+  return columns <= (config.width - 1) / 2 && rows <= (config.height - 1) / 2;
+}
+
+// Point the layers of match into the allocation at base and return its
+// size, index is the match in a batch of count. With base NULL only the size
+// is computed.
+size_t layoutMatch(Match *match, char *base, int count, int index) {
+  MatchConfig *config = &match->config;
+  match->tilesX = (config->width + GRID_TILE - 1) >> GRID_TILE_SHIFT;
+  int tilesY = (config->height + GRID_TILE - 1) >> GRID_TILE_SHIFT;
+  size_t cells = (size_t)match->tilesX * tilesY * GRID_TILE * GRID_TILE;
+  int players = config->players;
+  int bombs = players * MAX_PLAYER_BOMBS;
+  int explosions = bombs * _DIRECTION_NUM;
+  MatchLayout layout = {base, 0, count, index};
+  placeLayer(&layout, sizeof(Match));
+  match->grid = placeLayer(&layout, sizeof(Cell) * cells);
+  match->bombAt = placeLayer(&layout, sizeof(int) * cells);
+  match->playersAt = placeLayer(&layout, sizeof(uint64_t) * cells);
+  match->burning = placeLayer(&layout, sizeof(int) * cells);
+
+  BoardLayers *l = &match->layers;
+  size_t rows = sizeof(BoardRow) * config->height;
+  l->walls.row = placeLayer(&layout, rows);
+  l->crates.row = placeLayer(&layout, rows);
+  l->bombs.row = placeLayer(&layout, rows);
+  l->powerUps.row = placeLayer(&layout, rows);
+  l->flames.row = placeLayer(&layout, rows);
+
+  PlayerTable *p = &match->players;
+  p->spawn = placeLayer(&layout, sizeof(Position) * players);
+  p->position = placeLayer(&layout, sizeof(Position) * players);
+  p->targetPosition = placeLayer(&layout, sizeof(Position) * players);
+  p->progress = placeLayer(&layout, sizeof(float) * players);
+  p->prevProgress = placeLayer(&layout, sizeof(float) * players);
+  p->facing = placeLayer(&layout, sizeof(Direction) * players);
+  p->speed = placeLayer(&layout, sizeof(float) * players);
+  p->isAlive = placeLayer(&layout, sizeof(_Bool) * players);
+  p->state = placeLayer(&layout, sizeof(PlayerState) * players);
+  p->bombs = placeLayer(&layout, sizeof(int) * players);
+  p->activeBombs = placeLayer(&layout, sizeof(int) * players);
+  p->blastRadius = placeLayer(&layout, sizeof(int) * players);
+
+  BombTable *b = &match->bombs;
+  b->capacity = bombs;
+  b->position = placeLayer(&layout, sizeof(Position) * bombs);
+  b->startTime = placeLayer(&layout, sizeof(double) * bombs);
+  b->endTime = placeLayer(&layout, sizeof(double) * bombs);
+  b->owner = placeLayer(&layout, sizeof(int) * bombs);
+  b->radius = placeLayer(&layout, sizeof(int) * bombs);
+  b->flames = placeLayer(&layout, sizeof(int) * bombs);
+
+  ExplosionTable *e = &match->explosions;
+  e->capacity = explosions;
+  e->position = placeLayer(&layout, sizeof(Position) * explosions);
+  e->targetPosition = placeLayer(&layout, sizeof(Position) * explosions);
+  e->direction = placeLayer(&layout, sizeof(Direction) * explosions);
+  e->speed = placeLayer(&layout, sizeof(float) * explosions);
+  e->startTime = placeLayer(&layout, sizeof(double) * explosions);
+  e->radius = placeLayer(&layout, sizeof(int) * explosions);
+  e->bomb = placeLayer(&layout, sizeof(int) * explosions);
+  e->front = placeLayer(&layout, sizeof(int) * explosions);
+  e->blocked = placeLayer(&layout, sizeof(int) * explosions);
+
+  match->blastQueue.event =
+      placeLayer(&layout, sizeof(BlastEvent) * explosions);
+  return layout.offset;
+}
+
+void *placeLayer(MatchLayout *layout, size_t size) {
+  size_t start = layout->offset;
+  // Keep every layer 16 byte aligned
+  layout->offset += (size * layout->count + 15) & ~(size_t)15;
+  return layout->base == NULL ? NULL
+                              : layout->base + start + size * layout->index;
+}
+
+void FreeMatch(Match *match) { free(match); }
+
+void SnapshotMatch(Match *match, void *snapshot) {
+  memcpy(snapshot, match, match->size);
+}
+
+_Bool RestoreMatch(Match *match, const void *snapshot) {
+  const Match *source = (const Match *)snapshot;
+  if (source->size != match->size ||
+      memcmp(&source->config, &match->config, sizeof(MatchConfig)) != 0) {
+    LOG_ERROR("Snapshot does not fit the match config!", NULL);
+    return 0;
+  }
+  memcpy(match, snapshot, match->size);
+  layoutMatch(match, (char *)match, 1, 0);
+  return 1;
+}
+
+Match *CloneMatch(Match *match) {
+  Match *clone = (Match *)malloc(match->size);
+  if (clone == NULL) {
+    LOG_ERROR("Allocation of match clone failed!", NULL);
+    return NULL;
+  }
+  memcpy(clone, match, match->size);
+  layoutMatch(clone, (char *)clone, 1, 0);
+  return clone;
+}
+
+void StepMatch(Match *match, float deltaTime) {
+  match->deltaTime = deltaTime;
+  match->time += deltaTime;
+  match->tick++;
+  storePrevProgress(match);
+  if (match->countdown > 0.0f) {
+    updatePlayerSpawn(match);
+    match->countdown -= deltaTime;
+    return;
+  }
+  LOG_DEBUG("StepMatch: UpdatePlayerPositionProgress", NULL);
+  PROFILE_BEGIN("UpdatePlayerPositionProgress");
+  UpdatePlayerPositionProgress(match);
+  PROFILE_END();
+  LOG_DEBUG("StepMatch: UpdateBombTimer", NULL);
+  PROFILE_BEGIN("UpdateBombTimer");
+  UpdateBombTimer(match);
+  PROFILE_END();
+  LOG_DEBUG("StepMatch: processBlastEvents", NULL);
+  PROFILE_BEGIN("processBlastEvents");
+  processBlastEvents(match);
+  PROFILE_END();
+  LOG_DEBUG("StepMatch: RemoveExplodedBombs", NULL);
+  PROFILE_BEGIN("RemoveExplodedBombs");
+  RemoveExplodedBombs(match);
+  PROFILE_END();
+  LOG_DEBUG("StepMatch: checkPlayerOnPowerUp", NULL);
+  PROFILE_BEGIN("checkPlayerOnPowerUp");
+  checkPlayerOnPowerUp(match);
+  PROFILE_END();
+  LOG_DEBUG("StepMatch: checkPlayerAlive", NULL);
+  PROFILE_BEGIN("checkPlayerAlive");
+  checkPlayerAlive(match);
+  if (match->overTick < 0 && IsMatchOver(match)) {
+    match->overTick = match->tick;
+  }
+  PROFILE_END();
+}
+
+void StepMatchBatch(Match *matches, int count, float deltaTime) {
+  for (int first = 0; first < count; first += 64) {
+    int pass = count - first < 64 ? count - first : 64;
+    stepBatchPass(matches + first, pass, deltaTime);
+  }
+}
+
+// The systems of StepMatch in the same order, each one over all running
+// matches of the pass before the next. Matches never share state, so every
+// match ends the tick as with StepMatch.
+void stepBatchPass(Match *matches, int count, float deltaTime) {
+  uint64_t running = 0;
+  for (int i = 0; i < count; i++) {
+    Match *match = &matches[i];
+    if (match->overTick >= 0) {
+      continue;
+    }
+    if (match->countdown > 0.0f) {
+      StepMatch(match, deltaTime);
+      continue;
+    }
+    match->deltaTime = deltaTime;
+    match->time += deltaTime;
+    match->tick++;
+    storePrevProgress(match);
+    running |= (uint64_t)1 << i;
+  }
+  for (uint64_t m = running; m != 0; m &= m - 1) {
+    UpdatePlayerPositionProgress(&matches[__builtin_ctzll(m)]);
+  }
+  for (uint64_t m = running; m != 0; m &= m - 1) {
+    UpdateBombTimer(&matches[__builtin_ctzll(m)]);
+  }
+  for (uint64_t m = running; m != 0; m &= m - 1) {
+    Match *match = &matches[__builtin_ctzll(m)];
+    processBlastEvents(match);
+    RemoveExplodedBombs(match);
+  }
+  for (uint64_t m = running; m != 0; m &= m - 1) {
+    checkPlayerOnPowerUp(&matches[__builtin_ctzll(m)]);
+  }
+  for (uint64_t m = running; m != 0; m &= m - 1) {
+    Match *match = &matches[__builtin_ctzll(m)];
+    checkPlayerAlive(match);
+    if (IsMatchOver(match)) {
+      match->overTick = match->tick;
+    }
+  }
+}
+
+_Bool IsMatchOver(Match *match) {
+  int alive = 0;
+  for (int i = 0; i < match->config.players; i++) {
+    alive += match->players.isAlive[i];
+  }
+  return alive <= 1;
+}
+
+// FNV-1a over every field the rules read. Rows past the table counts and
+// the pointers are left out, they differ between equal matches.
+uint64_t HashMatch(Match *match) {
+  uint64_t hash = 1469598103934665603ull;
+  hash = hashBytes(hash, &match->config, sizeof(MatchConfig));
+  hash = hashBytes(hash, &match->rngState, sizeof(match->rngState));
+  hash = hashBytes(hash, &match->time, sizeof(match->time));
+  hash = hashBytes(hash, &match->tick, sizeof(match->tick));
+  hash = hashBytes(hash, &match->overTick, sizeof(match->overTick));
+  hash = hashBytes(hash, &match->countdown, sizeof(match->countdown));
+  for (int x = 0; x < match->config.width; x++) {
+    for (int y = 0; y < match->config.height; y++) {
+      int i = GetCellIndex(match, (Position){x, y});
+      hash = hashBytes(hash, &match->grid[i].type, sizeof(CellType));
+      hash = hashBytes(hash, &match->bombAt[i], sizeof(int));
+      hash = hashBytes(hash, &match->burning[i], sizeof(int));
+    }
+  }
+  PlayerTable *players = &match->players;
+  int n = match->config.players;
+  hash = hashBytes(hash, players->position, sizeof(Position) * n);
+  hash = hashBytes(hash, players->targetPosition, sizeof(Position) * n);
+  hash = hashBytes(hash, players->progress, sizeof(float) * n);
+  hash = hashBytes(hash, players->facing, sizeof(Direction) * n);
+  hash = hashBytes(hash, players->speed, sizeof(float) * n);
+  hash = hashBytes(hash, players->isAlive, sizeof(_Bool) * n);
+  hash = hashBytes(hash, players->state, sizeof(PlayerState) * n);
+  hash = hashBytes(hash, players->bombs, sizeof(int) * n);
+  hash = hashBytes(hash, players->activeBombs, sizeof(int) * n);
+  hash = hashBytes(hash, players->blastRadius, sizeof(int) * n);
+  BombTable *bombs = &match->bombs;
+  n = bombs->count;
+  hash = hashBytes(hash, &bombs->count, sizeof(int));
+  hash = hashBytes(hash, bombs->position, sizeof(Position) * n);
+  hash = hashBytes(hash, bombs->endTime, sizeof(double) * n);
+  hash = hashBytes(hash, bombs->owner, sizeof(int) * n);
+  hash = hashBytes(hash, bombs->radius, sizeof(int) * n);
+  hash = hashBytes(hash, bombs->flames, sizeof(int) * n);
+  ExplosionTable *explosions = &match->explosions;
+  n = explosions->count;
+  hash = hashBytes(hash, &explosions->count, sizeof(int));
+  hash = hashBytes(hash, explosions->position, sizeof(Position) * n);
+  hash = hashBytes(hash, explosions->direction, sizeof(Direction) * n);
+  hash = hashBytes(hash, explosions->radius, sizeof(int) * n);
+  hash = hashBytes(hash, explosions->bomb, sizeof(int) * n);
+  hash = hashBytes(hash, explosions->front, sizeof(int) * n);
+  hash = hashBytes(hash, explosions->blocked, sizeof(int) * n);
+  return hash;
+}
+
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+int matchRand(Match *match) {
+  // xorshift32
+  unsigned int x = match->rngState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  match->rngState = x;
+  return (int)(x >> 1);
+}
+
+void storePrevProgress(Match *match) {
+  PlayerTable *players = &match->players;
+  for (int i = 0; i < match->config.players; i++) {
+    players->prevProgress[i] = players->progress[i];
+  }
+}
+
+void initGrid(Match *match) {
+  int width = match->config.width;
+  int height = match->config.height;
+  BoardLayers *layers = &match->layers;
+  BoardInit(&layers->walls, width, height);
+  BoardInit(&layers->crates, width, height);
+  BoardInit(&layers->bombs, width, height);
+  BoardInit(&layers->powerUps, width, height);
+  BoardInit(&layers->flames, width, height);
+  initWalls(&layers->walls);
+  BoardRow protectedRows[MAX_GRID_SIZE];
+  Bitboard protected = {.row = protectedRows};
+  initSpawnProtection(match, &protected);
+  for (int x = 0; x < width; x++) {
+    for (int y = 0; y < height; y++) {
+      Position position = {x, y};
+      int i = GetCellIndex(match, position);
+      match->bombAt[i] = -1;
+      match->playersAt[i] = 0;
+      match->burning[i] = 0;
+      if (BoardTest(&layers->walls, position)) {
+        match->grid[i].type = CELL_SOLID_WALL;
+      } else if (BoardTest(&protected, position)) {
+        match->grid[i].type = CELL_EMPTY;
+      } else {
+        match->grid[i].type = CELL_EMPTY;
+        // 80% Chance to create a destructible
+        if (matchRand(match) % 10 <= 7) {
+          updateCell(match, position, CELL_DESTRUCTIBLE);
+        }
+      }
+    };
+  };
+}
+
+// Border and every cell with even coordinates, built a row at a time
+void initWalls(Bitboard *walls) {
+  BoardRow columnsRows[MAX_GRID_SIZE];
+  Bitboard columns = {.row = columnsRows};
+  BoardInit(&columns, walls->width, walls->height);
+  for (int y = 0; y < walls->height; y += 2) {
+    for (int i = 0; i < BOARD_WORDS; i++) {
+      columns.row[y][i] = 0x5555555555555555ull;
+    }
+  }
+  BoardFill(walls);
+  BoardRow innerRows[MAX_GRID_SIZE];
+  Bitboard inner = {.row = innerRows};
+  BoardInit(&inner, walls->width, walls->height);
+  BoardFill(&inner);
+  for (int d = 0; d < _DIRECTION_NUM; d++) {
+    BoardRow shiftedRows[MAX_GRID_SIZE];
+    Bitboard shifted = {.row = shiftedRows};
+    BoardShift(&shifted, walls, (Direction)d);
+    BoardAnd(&inner, &inner, &shifted);
+  }
+  // Inner cells are walls on even rows and columns
+  BoardAnd(&columns, &columns, &inner);
+  BoardAndNot(walls, walls, &inner);
+  BoardOr(walls, walls, &columns);
+}
+
+// Keep every spawn and two cells along each corridor leaving it free of
+// crates
+void initSpawnProtection(Match *match, Bitboard *protected) {
+  BoardInit(protected, match->config.width, match->config.height);
+  for (int i = 0; i < match->config.players; i++) {
+    Position spawn = match->players.spawn[i];
+    BoardSet(protected, spawn);
+    for (int d = 0; d < _DIRECTION_NUM; d++) {
+      for (int k = 1; k <= 2; k++) {
+        Position pos = StepPosition(spawn, (Direction)d, k);
+        if (BoardTest(&match->layers.walls, pos)) {
+          break;
+        }
+        BoardSet(protected, pos);
+      }
+    }
+  }
+}
+
+// Spread the spawns over a lattice of odd cells. The corners are handed out
+// first so small matches start as far apart as possible.
+void initSpawns(Match *match) {
+  int players = match->config.players;
+  int columns = 1;
+  while (columns * columns < players) {
+    columns++;
+  }
+  int rows = (players + columns - 1) / columns;
+  int corners[4][2] = {
+      {0, 0}, {columns - 1, rows - 1}, {columns - 1, 0}, {0, rows - 1}};
+  int id = 0;
+  for (int c = 0; c < 4 && id < players; c++) {
+    _Bool taken = 0;
+    for (int k = 0; k < c; k++) {
+      if (corners[k][0] == corners[c][0] && corners[k][1] == corners[c][1]) {
+        taken = 1;
+      }
+    }
+    if (!taken) {
+      match->players.spawn[id++] = (Position){
+          spawnCoordinate(corners[c][0], columns, match->config.width),
+          spawnCoordinate(corners[c][1], rows, match->config.height)};
+    }
+  }
+  for (int row = 0; row < rows && id < players; row++) {
+    for (int column = 0; column < columns && id < players; column++) {
+      _Bool corner = (row == 0 || row == rows - 1) &&
+                     (column == 0 || column == columns - 1);
+      if (!corner) {
+        match->players.spawn[id++] =
+            (Position){spawnCoordinate(column, columns, match->config.width),
+                       spawnCoordinate(row, rows, match->config.height)};
+      }
+    }
+  }
+}
+
+// Odd coordinate of lattice line index out of count lines on a side
+int spawnCoordinate(int index, int count, int size) {
+  int lines = (size - 1) / 2;
+  if (count == 1) {
+    return 2 * (lines / 2) + 1;
+  }
+  return 2 * (index * (lines - 1) / (count - 1)) + 1;
+}
+
+Cell GetCell(Match *match, Position position) {
+  return match->grid[GetCellIndex(match, position)];
+}
+
+int GetCellIndex(Match *match, Position position) {
+  int tile = (position.y >> GRID_TILE_SHIFT) * match->tilesX +
+             (position.x >> GRID_TILE_SHIFT);
+  return (tile << (2 * GRID_TILE_SHIFT)) |
+         ((position.y & (GRID_TILE - 1)) << GRID_TILE_SHIFT) |
+         (position.x & (GRID_TILE - 1));
+}
+
+void updateCell(Match *match, Position position, CellType cellType) {
+  Cell *cell = &match->grid[GetCellIndex(match, position)];
+  Bitboard *layer = getLayer(match, cell->type);
+  if (layer != NULL) {
+    BoardReset(layer, position);
+  }
+  layer = getLayer(match, cellType);
+  if (layer != NULL) {
+    BoardSet(layer, position);
+  }
+  cell->type = cellType;
+  match->changedCells[match->cellChanges++ % CELL_JOURNAL_SIZE] = position;
+}
+
+void SetCell(Match *match, Position position, CellType type) {
+  if (type == CELL_BOMB || GetCell(match, position).type == CELL_BOMB) {
+    LOG_ERROR("SetCell cannot place or replace bombs!", NULL);
+    return;
+  }
+  updateCell(match, position, type);
+}
+
+Bitboard *getLayer(Match *match, CellType cellType) {
+  switch (cellType) {
+  case CELL_SOLID_WALL:
+    return &match->layers.walls;
+  case CELL_DESTRUCTIBLE:
+    return &match->layers.crates;
+  case CELL_BOMB:
+    return &match->layers.bombs;
+  case CELL_POWERUP:
+    return &match->layers.powerUps;
+  default:
+    return NULL;
+  }
+}
+
+void updateBurning(Match *match, Position position, int change) {
+  int *burning = &match->burning[GetCellIndex(match, position)];
+  *burning += change;
+  if (*burning > 0) {
+    BoardSet(&match->layers.flames, position);
+  } else {
+    BoardReset(&match->layers.flames, position);
+  }
+}
+
+void setBombAt(Match *match, Position position, int bomb) {
+  match->bombAt[GetCellIndex(match, position)] = bomb;
+}
+
+_Bool isCollision(Match *match, Position next) {
+  BoardLayers *layers = &match->layers;
+  return BoardTest(&layers->walls, next) | BoardTest(&layers->crates, next) |
+         BoardTest(&layers->bombs, next);
+}
+
+_Bool isEqPos(Position p1, Position p2) {
+  if (p1.x == p2.x && p1.y == p2.y) {
+    return 1;
+  }
+  return 0;
+}
+
+Position StepPosition(Position position, Direction direction, int steps) {
+  switch (direction) {
+  case NORTH:
+    return (Position){position.x, position.y - steps};
+  case EAST:
+    return (Position){position.x + steps, position.y};
+  case SOUTH:
+    return (Position){position.x, position.y + steps};
+  case WEST:
+    return (Position){position.x - steps, position.y};
+  default:
+    return position;
+  }
+}
+
+void initPlayer(Match *match, int id) {
+  PlayerTable *players = &match->players;
+  Position spawn = players->spawn[id];
+  players->position[id] = spawn;
+  match->playersAt[GetCellIndex(match, spawn)] |= (uint64_t)1 << id;
+  players->targetPosition[id] = spawn;
+  players->progress[id] = 0;
+  players->prevProgress[id] = 0;
+  // Face the middle of the map
+  players->facing[id] = spawn.x < match->config.width / 2 ? EAST : WEST;
+  players->isAlive[id] = 1;
+  players->state[id] = SPAWN;
+  players->speed[id] = 5;
+  players->blastRadius[id] = 3;
+  players->bombs[id] = 1;
+  players->activeBombs[id] = 0;
+}
+
+void setPlayerPosition(Match *match, int player, Position position) {
+  Position old = match->players.position[player];
+  uint64_t bit = (uint64_t)1 << player;
+  match->playersAt[GetCellIndex(match, old)] &= ~bit;
+  match->playersAt[GetCellIndex(match, position)] |= bit;
+  match->players.position[player] = position;
+}
+
+void PlacePlayer(Match *match, int player, Position position) {
+  setPlayerPosition(match, player, position);
+  match->players.targetPosition[player] = position;
+  match->players.progress[player] = 0;
+  match->players.prevProgress[player] = 0;
+}
+
+void updatePlayerSpawn(Match *match) {
+  if (match->time < PLAYER_SPAWN_TIME) {
+    return;
+  }
+  for (int i = 0; i < match->config.players; i++) {
+    if (match->players.state[i] == SPAWN) {
+      UpdatePlayerState(match, i, IDLE);
+    }
+  }
+}
+
+void MovePlayer(Match *match, int player, Direction direction) {
+  PlayerTable *players = &match->players;
+  // Keinen Animationsabbruch
+  if (players->state[player] == IDLE) {
+    Position targetPosition =
+        StepPosition(players->targetPosition[player], direction, 1);
+    if (!isCollision(match, targetPosition)) {
+      players->targetPosition[player] = targetPosition;
+      if (direction == EAST || direction == WEST) {
+        players->facing[player] = direction;
+      }
+    }
+    players->prevProgress[player] = players->progress[player];
+    players->state[player] = WALKING;
+  }
+};
+
+void UpdatePlayerPositionProgress(Match *match) {
+  PlayerTable *players = &match->players;
+  for (int i = 0; i < match->config.players; i++) {
+    if (players->state[i] == WALKING) {
+      players->progress[i] += match->deltaTime * players->speed[i];
+      if (players->progress[i] >= 1.0f) {
+        players->progress[i] = 0;
+        setPlayerPosition(match, i, players->targetPosition[i]);
+        UpdatePlayerState(match, i, IDLE);
+      }
+    }
+  }
+}
+
+void UpdatePlayerState(Match *match, int player, PlayerState state) {
+  match->players.state[player] = state;
+}
+
+void PlantBomb(Match *match, int player) {
+  PlayerTable *players = &match->players;
+  BombTable *bombs = &match->bombs;
+  if (players->activeBombs[player] >= players->bombs[player]) {
+    return;
+  }
+  Position position = players->position[player];
+  if (GetCell(match, position).type == CELL_BOMB) {
+    return;
+  }
+  LOG_INFO("Bomb planted", NULL);
+  int bomb = bombs->count++;
+  bombs->position[bomb] = position;
+  bombs->startTime[bomb] = match->time;
+  bombs->endTime[bomb] = match->time + BOMB_FUSE_TIME;
+  bombs->owner[bomb] = player;
+  bombs->radius[bomb] = players->blastRadius[player];
+  bombs->flames[bomb] = 0;
+  players->activeBombs[player]++;
+  updateCell(match, position, CELL_BOMB);
+  setBombAt(match, position, bomb);
+  // Planted into a burning cell
+  if (match->burning[GetCellIndex(match, position)] > 0) {
+    bombs->endTime[bomb] = match->time;
+  }
+};
+
+void UpdateBombTimer(Match *match) {
+  BombTable *bombs = &match->bombs;
+  for (int i = 0; i < bombs->count; i++) {
+    if (bombs->endTime[i] <= match->time && bombs->endTime[i] != 0) {
+      detonateBomb(match, i);
+    }
+  }
+}
+
+void RemoveExplodedBombs(Match *match) {
+  BombTable *bombs = &match->bombs;
+  ExplosionTable *explosions = &match->explosions;
+  int i = 0;
+  while (i < bombs->count) {
+    if (bombs->endTime[i] != 0 || bombs->flames[i] > 0) {
+      i++;
+      continue;
+    }
+    match->players.activeBombs[bombs->owner[i]]--;
+    // Move the last row into the gap and repoint its explosions
+    int last = --bombs->count;
+    if (i != last) {
+      bombs->position[i] = bombs->position[last];
+      bombs->startTime[i] = bombs->startTime[last];
+      bombs->endTime[i] = bombs->endTime[last];
+      bombs->owner[i] = bombs->owner[last];
+      bombs->radius[i] = bombs->radius[last];
+      bombs->flames[i] = bombs->flames[last];
+      if (bombs->endTime[i] != 0) {
+        setBombAt(match, bombs->position[i], i);
+      }
+      for (int j = 0; j < explosions->count; j++) {
+        if (explosions->bomb[j] == last) {
+          explosions->bomb[j] = i;
+        }
+      }
+    }
+  }
+}
+
+void detonateBomb(Match *match, int bomb) {
+  BombTable *bombs = &match->bombs;
+  // The owner's blast radius at detonation applies
+  bombs->radius[bomb] = match->players.blastRadius[bombs->owner[bomb]];
+  for (int i = 0; i < _DIRECTION_NUM; i++) {
+    createExplosion(match, bomb, (Direction)i);
+  }
+  bombs->startTime[bomb] = 0;
+  bombs->endTime[bomb] = 0;
+  updateCell(match, bombs->position[bomb], CELL_EMPTY);
+  setBombAt(match, bombs->position[bomb], -1);
+}
+
+void createExplosion(Match *match, int bomb, Direction direction) {
+  BombTable *bombs = &match->bombs;
+  ExplosionTable *explosions = &match->explosions;
+  if (explosions->count == explosions->capacity) {
+    LOG_WARN("Explosion table full!", NULL);
+    return;
+  }
+  int i = explosions->count++;
+  Position pos = bombs->position[bomb];
+  int radius = bombs->radius[bomb];
+  explosions->position[i] = pos;
+  explosions->targetPosition[i] = StepPosition(pos, direction, radius);
+  explosions->direction[i] = direction;
+  explosions->speed[i] = EXPLOSION_SPEED;
+  explosions->startTime[i] = match->time;
+  explosions->radius[i] = radius;
+  explosions->bomb[i] = bomb;
+  explosions->front[i] = 0;
+  explosions->blocked[i] = findBlocker(match, pos, direction, 1, radius);
+  bombs->flames[bomb]++;
+  scheduleBlastEvent(match, match->time, i);
+}
+
+void processBlastEvents(Match *match) {
+  BlastQueue *queue = &match->blastQueue;
+  while (queue->count > 0 && queue->event[0].time <= match->time) {
+    BlastEvent event = popBlastEvent(match);
+    advanceFlameFront(match, event.explosion);
+  }
+}
+
+// First wall or crate of the ray from cell first on, radius + 1 if none.
+// The border walls keep the ray inside the grid.
+int findBlocker(Match *match, Position pos, Direction direction, int first,
+                int radius) {
+  for (int k = first; k <= radius; k++) {
+    CellType type = GetCell(match, StepPosition(pos, direction, k)).type;
+    if (type == CELL_SOLID_WALL || type == CELL_DESTRUCTIBLE) {
+      return k;
+    }
+  }
+  return radius + 1;
+}
+
+void advanceFlameFront(Match *match, int explosion) {
+  ExplosionTable *explosions = &match->explosions;
+  int k = explosions->front[explosion];
+  int radius = explosions->radius[explosion];
+  // Burnt out
+  if (k > radius) {
+    removeExplosion(match, explosion);
+    return;
+  }
+  Position cellPos = StepPosition(explosions->position[explosion],
+                                  explosions->direction[explosion], k);
+  if (k == explosions->blocked[explosion]) {
+    CellType type = GetCell(match, cellPos).type;
+    if (type == CELL_SOLID_WALL || type == CELL_DESTRUCTIBLE) {
+      if (type == CELL_DESTRUCTIBLE) {
+        breakDestructibel(match, cellPos);
+      }
+      removeExplosion(match, explosion);
+      return;
+    }
+    // Another blast broke the crate since the ray was traced
+    explosions->blocked[explosion] =
+        findBlocker(match, explosions->position[explosion],
+                    explosions->direction[explosion], k + 1, radius);
+  }
+  updateBurning(match, cellPos, 1);
+  explosions->front[explosion]++;
+  int otherBomb = getBomb(match, cellPos);
+  if (otherBomb >= 0) {
+    LOG_INFO("trigger Bomb: %d.%d", cellPos.x, cellPos.y);
+    match->bombs.endTime[otherBomb] = match->time;
+  }
+  if (killPlayersAt(match, cellPos)) {
+    removeExplosion(match, explosion);
+    return;
+  }
+  // The front crosses radius + 1 cells over the lifetime of the explosion
+  float speed = explosions->speed[explosion];
+  double next = k == radius ? 1.0 / speed : (k + 1) / (speed * (radius + 1));
+  scheduleBlastEvent(match, explosions->startTime[explosion] + next,
+                     explosion);
+}
+
+// Kill the living players at pos, returns whether there were any
+_Bool killPlayersAt(Match *match, Position pos) {
+  uint64_t occupants = match->playersAt[GetCellIndex(match, pos)];
+  _Bool killed = 0;
+  for (int i = 0; occupants; i++, occupants >>= 1) {
+    if ((occupants & 1) && match->players.isAlive[i]) {
+      match->players.isAlive[i] = 0;
+      killed = 1;
+    }
+  }
+  return killed;
+}
+
+void removeExplosion(Match *match, int explosion) {
+  ExplosionTable *explosions = &match->explosions;
+  for (int k = 0; k < explosions->front[explosion]; k++) {
+    Position pos = StepPosition(explosions->position[explosion],
+                                explosions->direction[explosion], k);
+    updateBurning(match, pos, -1);
+  }
+  match->bombs.flames[explosions->bomb[explosion]]--;
+  int last = --explosions->count;
+  if (explosion == last) {
+    return;
+  }
+  explosions->position[explosion] = explosions->position[last];
+  explosions->targetPosition[explosion] = explosions->targetPosition[last];
+  explosions->direction[explosion] = explosions->direction[last];
+  explosions->speed[explosion] = explosions->speed[last];
+  explosions->startTime[explosion] = explosions->startTime[last];
+  explosions->radius[explosion] = explosions->radius[last];
+  explosions->bomb[explosion] = explosions->bomb[last];
+  explosions->front[explosion] = explosions->front[last];
+  explosions->blocked[explosion] = explosions->blocked[last];
+  // Repoint the pending event of the moved row
+  BlastQueue *queue = &match->blastQueue;
+  for (int i = 0; i < queue->count; i++) {
+    if (queue->event[i].explosion == last) {
+      queue->event[i].explosion = explosion;
+      break;
+    }
+  }
+}
+
+void scheduleBlastEvent(Match *match, double time, int explosion) {
+  BlastQueue *queue = &match->blastQueue;
+  int i = queue->count++;
+  // Sift up
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (queue->event[parent].time <= time) {
+      break;
+    }
+    queue->event[i] = queue->event[parent];
+    i = parent;
+  }
+  queue->event[i] = (BlastEvent){time, explosion};
+}
+
+BlastEvent popBlastEvent(Match *match) {
+  BlastQueue *queue = &match->blastQueue;
+  BlastEvent top = queue->event[0];
+  BlastEvent last = queue->event[--queue->count];
+  // Sift down
+  int i = 0;
+  while (1) {
+    int child = 2 * i + 1;
+    if (child >= queue->count) {
+      break;
+    }
+    if (child + 1 < queue->count &&
+        queue->event[child + 1].time < queue->event[child].time) {
+      child++;
+    }
+    if (last.time <= queue->event[child].time) {
+      break;
+    }
+    queue->event[i] = queue->event[child];
+    i = child;
+  }
+  queue->event[i] = last;
+  return top;
+}
+
+void checkPlayerAlive(Match *match) {
+  PlayerTable *players = &match->players;
+  for (int i = 0; i < match->config.players; i++) {
+    // Walked into a flame that had already passed
+    Position pos = players->position[i];
+    if (match->burning[GetCellIndex(match, pos)] > 0) {
+      players->isAlive[i] = 0;
+    }
+    if (players->isAlive[i] == 0) {
+      players->state[i] = DEATH;
+    }
+  }
+}
+
+void breakDestructibel(Match *match, Position pos) {
+  if ((matchRand(match) % 10) < 2) {
+    updateCell(match, pos, CELL_POWERUP);
+  } else {
+    updateCell(match, pos, CELL_EMPTY);
+  }
+}
+
+// Row of the live bomb at pos or -1
+int getBomb(Match *match, Position pos) {
+  return match->bombAt[GetCellIndex(match, pos)];
+}
+
+void checkPlayerOnPowerUp(Match *match) {
+  for (int i = 0; i < match->config.players; i++) {
+    Position pos = match->players.position[i];
+    if (GetCell(match, pos).type == CELL_POWERUP) {
+      collectPowerUp(match, pos, i);
+    }
+  }
+}
+
+void collectPowerUp(Match *match, Position pos, int player) {
+  PlayerTable *players = &match->players;
+  int r = matchRand(match) % _POWERUP_NUM;
+  switch (r) {
+  case POWERUP_SPEED:
+    LOG_INFO("speed collected", NULL);
+    players->speed[player]++;
+    break;
+  case POWERUP_BOMB:
+    LOG_INFO("bomb collected", NULL);
+    if (players->bombs[player] < MAX_PLAYER_BOMBS) {
+      players->bombs[player]++;
+    }
+    break;
+  case POWERUP_BLAST_RADIUS:
+    LOG_INFO("blast radius collected", NULL);
+    players->blastRadius[player]++;
+    break;
+  }
+  updateCell(match, pos, CELL_EMPTY);
+}
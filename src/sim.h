@@ -0,0 +1,291 @@
+#ifndef SIM_H
+#define SIM_H
+
+// Headless simulation core. Nothing in here may depend on raylib so that
+// matches can be stepped without a window or GL context.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed simulation rate. Stepping with TICK_TIME keeps outcomes independent
+// of the rendering frame rate.
+#define TICK_RATE 60
+#define TICK_TIME (1.0f / TICK_RATE)
+
+// Map size is chosen per match. Width and height must be odd so the border
+// and the pillar pattern close.
+#define MIN_GRID_SIZE 7
+#define MAX_GRID_SIZE 255
+#define DEFAULT_GRID_SIZE 15
+// Per-cell layers are stored in square tiles of 8x8 cells, so a cell and its
+// neighbours mostly share cache lines and small maps stay small
+#define GRID_TILE_SHIFT 3
+#define GRID_TILE (1 << GRID_TILE_SHIFT)
+
+typedef enum {
+  CELL_EMPTY,
+  CELL_SOLID_WALL,
+  CELL_DESTRUCTIBLE,
+  CELL_BOMB,
+  CELL_POWERUP,
+} CellType;
+
+typedef struct {
+  CellType type;
+} Cell;
+
+// One bit per cell, bit x of row y is the cell (x, y). A row has room for
+// the widest map, only the first width bits are used. The rows live
+// wherever the owner of the board put them: height rows, placed through
+// layoutMatch for the layers of a match. Kernels working on bitboards are
+// in bitboard.h.
+#define BOARD_WORDS ((MAX_GRID_SIZE + 63) / 64)
+
+typedef uint64_t BoardRow[BOARD_WORDS];
+
+typedef struct {
+  int width;
+  int height;
+  BoardRow *row;
+} Bitboard;
+
+// Bitboard view of the grid, kept in sync by every cell update
+typedef struct {
+  Bitboard walls;
+  Bitboard crates;
+  Bitboard bombs;
+  Bitboard powerUps;
+  // Cells with a burning count above zero
+  Bitboard flames;
+} BoardLayers;
+
+typedef enum {
+  POWERUP_SPEED,
+  POWERUP_BOMB,
+  POWERUP_BLAST_RADIUS,
+  _POWERUP_NUM,
+} PowerUpType;
+
+typedef struct {
+  int x;
+  int y;
+} Position;
+
+typedef enum {
+  NORTH,
+  EAST,
+  SOUTH,
+  WEST,
+  _DIRECTION_NUM,
+} Direction;
+
+#define MAX_PLAYERS 64
+#define DEFAULT_PLAYERS 4
+// Players on a cell are kept as a bit mask
+_Static_assert(MAX_PLAYERS <= 64, "MAX_PLAYERS exceeds occupancy mask");
+#define MAX_PLAYER_BOMBS 20
+
+typedef struct {
+  int width;
+  int height;
+  int players;
+} MatchConfig;
+
+// Seconds until the spawn animation has played and a player may move
+#define PLAYER_SPAWN_TIME 1.1f
+
+typedef enum {
+  SPAWN,
+  IDLE,
+  WALKING,
+  DEATH,
+  _PLAYER_STATE_NUM,
+} PlayerState;
+
+// Entities are stored as structure-of-arrays tables so every system of a
+// tick is a linear pass over the columns it needs. Players are indexed by
+// their id. Bomb and explosion rows are dense: a finished row is replaced by
+// the last row, so row indices are only valid within a tick. All columns
+// are sized by the player count and live in the match allocation.
+
+typedef struct {
+  Position *spawn;
+  Position *position;
+  Position *targetPosition;
+  float *progress;
+  // Progress at the start of the last tick, used for render interpolation
+  float *prevProgress;
+  Direction *facing;
+  float *speed;
+  _Bool *isAlive;
+  PlayerState *state;
+  // Bombs a player may have on the board and bombs currently on it
+  int *bombs;
+  int *activeBombs;
+  int *blastRadius;
+} PlayerTable;
+
+// Seconds from planting a bomb to its detonation
+#define BOMB_FUSE_TIME 3
+// An explosion burns for 1 / EXPLOSION_SPEED seconds, its front reaches the
+// end of the ray at the end
+#define EXPLOSION_SPEED 6
+
+typedef struct {
+  int capacity;
+  int count;
+  Position *position;
+  double *startTime;
+  // Zero once the bomb has detonated
+  double *endTime;
+  int *owner;
+  int *radius;
+  // Explosion rows still burning for a detonated bomb
+  int *flames;
+} BombTable;
+
+// An explosion is one ray of a detonated bomb. Its path is fixed at
+// ignition, afterwards the flame front only advances through timed events.
+typedef struct {
+  int capacity;
+  int count;
+  Position *position;
+  Position *targetPosition;
+  Direction *direction;
+  float *speed;
+  double *startTime;
+  int *radius;
+  // Row of the bomb in the bomb table
+  int *bomb;
+  // Next cell the front reaches, cells before it are burning
+  int *front;
+  // Cell of the first wall or crate on the ray, radius + 1 if there is none
+  int *blocked;
+} ExplosionTable;
+
+// Min-heap on time. Every explosion has exactly one pending event: the
+// arrival of its front at the next cell or burning out.
+typedef struct {
+  double time;
+  int explosion;
+} BlastEvent;
+
+typedef struct {
+  int count;
+  BlastEvent *event;
+} BlastQueue;
+
+#define CELL_JOURNAL_SIZE 256
+
+// A match is a single allocation: this header followed by the tiled cell
+// layers and the table columns, all sized by the config. The pointers below
+// point into that allocation and are the only pointers in it, everything
+// else refers to entities by index. Copying the allocation copies the match,
+// see SnapshotMatch.
+typedef struct {
+  MatchConfig config;
+  size_t size;
+  // Seed the match was created with and the current random state. Every
+  // random decision of the rules is drawn from here, never from rand(), so
+  // matches on different threads stay independent and reproducible.
+  unsigned int seed;
+  unsigned int rngState;
+  // Simulation clock in seconds and steps so far, advanced only by StepMatch
+  double time;
+  long tick;
+  // Tick at which the match was decided, -1 while it is running
+  long overTick;
+  float deltaTime;
+  float countdown;
+  // Tiles per tile row, cells are indexed through GetCellIndex
+  int tilesX;
+  Cell *grid;
+  // Occupancy layer next to the grid so chain reactions and kills are
+  // lookups: the row of the live bomb on a cell or -1, and one bit per
+  // player whose position is the cell
+  int *bombAt;
+  uint64_t *playersAt;
+  // Number of explosions whose front has passed a cell
+  int *burning;
+  BoardLayers layers;
+  PlayerTable players;
+  BombTable bombs;
+  ExplosionTable explosions;
+  BlastQueue blastQueue;
+  // Cells changed by the rules so far and the last CELL_JOURNAL_SIZE of
+  // them, for readers that keep boards of their own in sync (see bot.h).
+  // A reader that fell further behind has to rebuild.
+  long cellChanges;
+  Position changedCells[CELL_JOURNAL_SIZE];
+} Match;
+
+// Default map and player count
+Match *InitMatch(unsigned int seed);
+// NULL if the config is out of range or the players do not fit the map
+Match *InitMatchWithConfig(MatchConfig config, unsigned int seed);
+// Bytes of a match, 0 if the config is out of range
+size_t GetMatchSize(MatchConfig config);
+// Starts a match in memory the caller owns, GetMatchSize(config) bytes with
+// malloc alignment. Starting over in the memory of a finished match of the
+// same config needs no allocation.
+Match *InitMatchAt(void *memory, MatchConfig config, unsigned int seed);
+// Starts match over with seed in the memory it has
+void ResetMatch(Match *match, unsigned int seed);
+void FreeMatch(Match *match);
+
+// Batches for training, see vecenv.h. A batch lays out count matches column
+// by column: the headers come first, then every column holds that column of
+// all matches back to back, so a system of a tick walks the whole batch in
+// one pass. The state of a match in a batch is not one block, it can not be
+// snapshotted or cloned.
+size_t GetMatchBatchSize(MatchConfig config, int count);
+// Lays out the batch in memory the caller owns, GetMatchBatchSize bytes
+// with malloc alignment, and returns its first match. The matches are
+// started with ResetMatch.
+Match *InitMatchBatch(void *memory, MatchConfig config, int count);
+// Steps the matches of a batch system by system. Matches that are over are
+// left as they are, the others advance as with StepMatch.
+void StepMatchBatch(Match *matches, int count, float deltaTime);
+
+// Snapshots. The whole state of a match is its allocation, so a snapshot is
+// a plain copy of match->size bytes. Restoring re-points the layers to the
+// target, which may be any match of the same config, not only the one the
+// snapshot was taken from.
+void SnapshotMatch(Match *match, void *snapshot);
+// Returns 0 if the snapshot is of a different config
+_Bool RestoreMatch(Match *match, const void *snapshot);
+Match *CloneMatch(Match *match);
+
+// Advance the match by deltaTime seconds
+void StepMatch(Match *match, float deltaTime);
+
+// A match is over once at most one player is left alive
+_Bool IsMatchOver(Match *match);
+
+// Hash of the simulated state, equal for matches that played the same
+// commands from the same seed
+uint64_t HashMatch(Match *match);
+
+// Grid
+Cell GetCell(Match *match, Position position);
+// Index of a cell in the tiled layers
+int GetCellIndex(Match *match, Position position);
+// The cell steps cells from position in direction, may be off the grid
+Position StepPosition(Position position, Direction direction, int steps);
+
+// Player
+void MovePlayer(Match *match, int player, Direction direction);
+void UpdatePlayerPositionProgress(Match *match);
+void UpdatePlayerState(Match *match, int player, PlayerState state);
+
+// Bomb
+void PlantBomb(Match *match, int player);
+void UpdateBombTimer(Match *match);
+void RemoveExplodedBombs(Match *match);
+
+// Scenario setup for tools and benchmarks. SetCell keeps the layers in sync
+// and refuses bombs, those are planted. PlacePlayer moves a player without
+// walking.
+void SetCell(Match *match, Position position, CellType type);
+void PlacePlayer(Match *match, int player, Position position);
+#endif // SIM_H
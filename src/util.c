@@ -3,3 +3,13 @@
 float Lerp(float start, float end, float t) {
   return start + (end - start) * t;
 }
+
+float Clamp(float value, float min, float max) {
+  if (value < min) {
+    return min;
+  }
+  if (value > max) {
+    return max;
+  }
+  return value;
+}
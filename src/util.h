@@ -1,9 +1,10 @@
 #ifndef UTIL_H
 #define UTIL_H
+#include "atlas.h"
 #include <raylib.h>
 
 typedef struct {
-  Texture2D *frames;
+  AtlasSprite *frames;
   int numFrames;
   float frameSpeed;
   int currentFrame;
@@ -11,4 +12,5 @@ typedef struct {
 } Animation;
 
 float Lerp(float start, float end, float t);
+float Clamp(float value, float min, float max);
 #endif // UTIL_H
@@ -0,0 +1,307 @@
+#include "vecenv.h"
+#include "log.h"
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Slices start on a multiple of this many envs, so slices on different
+// threads rarely share a cache line of a column
+#define VEC_SLICE_ALIGN 16
+// Slices per thread, more than one lets the pool balance uneven matches
+#define VEC_SLICES_PER_THREAD 4
+
+// Envs first to first + count - 1, stepped by one task
+typedef struct {
+  VecEnv *env;
+  int first;
+  int count;
+} VecSlice;
+
+struct VecEnv {
+  VecEnvConfig config;
+  // The batch of matches, see InitMatchBatch
+  void *memory;
+  Match *matches;
+  // Episodes each env has started, picks the seed of its next one
+  long *episodes;
+  // Tick each episode ended its countdown, for maxTicks
+  long *startTicks;
+  // Player isAlive columns of the batch before the running step
+  _Bool *wasAlive;
+  int observationSize;
+  _Bool started;
+  // Byte i of entry b is bit i of b, spreads eight cells of a bitboard
+  // word to their cell bytes at once
+  uint64_t spread[256];
+  // NULL for a single thread
+  ThreadPool *pool;
+  int numSlices;
+  VecSlice *slices;
+  // Arrays of the running call, shared by its slices
+  const uint8_t *actions;
+  float *rewards;
+  uint8_t *dones;
+  uint8_t *observations;
+};
+
+// Batch functions
+int getSliceStart(int envs, int slice, int numSlices);
+void runSlices(VecEnv *env, TaskFunction function);
+void resetSlice(void *arg);
+void stepSlice(void *arg);
+void startEpisode(VecEnv *env, int e);
+void writeObservation(VecEnv *env, Match *match, uint8_t *observation);
+
+VecEnv *CreateVecEnv(VecEnvConfig config) {
+  size_t size = GetMatchBatchSize(config.match, config.envs);
+  if (size == 0 || config.match.players < 2) {
+    LOG_ERROR("Invalid environment config!", NULL);
+    return NULL;
+  }
+  if (config.threads < 1) {
+    config.threads = 1;
+  }
+  if (config.ticksPerStep < 1) {
+    config.ticksPerStep = 1;
+  }
+  VecEnv *env = (VecEnv *)malloc(sizeof(VecEnv));
+  if (env == NULL) {
+    LOG_ERROR("Allocation of environment failed!", NULL);
+    return NULL;
+  }
+  env->config = config;
+  env->memory = malloc(size);
+  env->episodes = (long *)calloc(config.envs, sizeof(long));
+  env->startTicks = (long *)calloc(config.envs, sizeof(long));
+  env->wasAlive = (_Bool *)malloc(config.envs * config.match.players);
+  env->observationSize = config.match.width * config.match.height +
+                         config.match.players * VEC_PLAYER_FEATURES;
+  env->started = 0;
+  for (int b = 0; b < 256; b++) {
+    env->spread[b] = 0;
+    for (int i = 0; i < 8; i++) {
+      env->spread[b] |= (uint64_t)((b >> i) & 1) << (8 * i);
+    }
+  }
+  env->pool = config.threads > 1 ? CreateThreadPool(config.threads) : NULL;
+  // Slices start on multiples of VEC_SLICE_ALIGN, more would stay empty
+  int maxSlices = (config.envs + VEC_SLICE_ALIGN - 1) / VEC_SLICE_ALIGN;
+  int numSlices = config.threads * VEC_SLICES_PER_THREAD;
+  if (numSlices > maxSlices) {
+    numSlices = maxSlices;
+  }
+  env->slices = (VecSlice *)malloc(sizeof(VecSlice) * numSlices);
+  if (env->memory == NULL || env->episodes == NULL ||
+      env->startTicks == NULL || env->wasAlive == NULL ||
+      env->slices == NULL || (config.threads > 1 && env->pool == NULL)) {
+    LOG_ERROR("Allocation of environment failed!", NULL);
+    FreeVecEnv(env);
+    return NULL;
+  }
+  env->matches = InitMatchBatch(env->memory, config.match, config.envs);
+  // Rounding the starts can leave a slice without envs, it is dropped
+  env->numSlices = 0;
+  for (int i = 0; i < numSlices; i++) {
+    int first = getSliceStart(config.envs, i, numSlices);
+    int count = getSliceStart(config.envs, i + 1, numSlices) - first;
+    if (count > 0) {
+      env->slices[env->numSlices++] = (VecSlice){env, first, count};
+    }
+  }
+  return env;
+}
+
+void FreeVecEnv(VecEnv *env) {
+  if (env->pool != NULL) {
+    FreeThreadPool(env->pool);
+  }
+  free(env->slices);
+  free(env->wasAlive);
+  free(env->startTicks);
+  free(env->episodes);
+  free(env->memory);
+  free(env);
+}
+
+int GetVecObservationSize(VecEnv *env) { return env->observationSize; }
+
+void ResetVecEnv(VecEnv *env, uint8_t *observations) {
+  env->observations = observations;
+  runSlices(env, resetSlice);
+  env->started = 1;
+}
+
+void StepVecEnv(VecEnv *env, const uint8_t *actions, float *rewards,
+                uint8_t *dones, uint8_t *observations) {
+  if (!env->started) {
+    LOG_ERROR("Environment stepped before ResetVecEnv!", NULL);
+    return;
+  }
+  env->actions = actions;
+  env->rewards = rewards;
+  env->dones = dones;
+  env->observations = observations;
+  runSlices(env, stepSlice);
+}
+
+// First env of slice, the end of the batch for numSlices
+int getSliceStart(int envs, int slice, int numSlices) {
+  if (slice == numSlices) {
+    return envs;
+  }
+  int first = (long)envs * slice / numSlices;
+  first = (first + VEC_SLICE_ALIGN / 2) / VEC_SLICE_ALIGN * VEC_SLICE_ALIGN;
+  return first < envs ? first : envs;
+}
+
+void runSlices(VecEnv *env, TaskFunction function) {
+  if (env->pool == NULL) {
+    for (int i = 0; i < env->numSlices; i++) {
+      function(&env->slices[i]);
+    }
+    return;
+  }
+  for (int i = 0; i < env->numSlices; i++) {
+    SubmitTask(env->pool, function, &env->slices[i]);
+  }
+  WaitThreadPool(env->pool);
+}
+
+// The rules log plants and pickups, far too many at training speed
+void resetSlice(void *arg) {
+  VecSlice *slice = (VecSlice *)arg;
+  VecEnv *env = slice->env;
+  LogLevel logLevel = threadLogLevel;
+  threadLogLevel = LOG_LEVEL_WARN;
+  for (int e = slice->first; e < slice->first + slice->count; e++) {
+    startEpisode(env, e);
+    writeObservation(env, &env->matches[e],
+                     env->observations + (size_t)e * env->observationSize);
+  }
+  threadLogLevel = logLevel;
+}
+
+// Every phase is one pass over the envs of the slice: actions, the ticks,
+// rewards and dones from the player columns, restarts and observations
+void stepSlice(void *arg) {
+  VecSlice *slice = (VecSlice *)arg;
+  VecEnv *env = slice->env;
+  LogLevel logLevel = threadLogLevel;
+  threadLogLevel = LOG_LEVEL_WARN;
+  int numPlayers = env->config.match.players;
+  Match *matches = &env->matches[slice->first];
+  // The player columns of the slice are contiguous across its envs
+  size_t first = (size_t)slice->first * numPlayers;
+  size_t rows = (size_t)slice->count * numPlayers;
+  const _Bool *isAlive = matches->players.isAlive;
+  _Bool *wasAlive = env->wasAlive + first;
+  const uint8_t *action = env->actions + first;
+  memcpy(wasAlive, isAlive, rows);
+  for (int e = 0; e < slice->count; e++) {
+    for (int p = 0; p < numPlayers; p++) {
+      int i = e * numPlayers + p;
+      if (!isAlive[i]) {
+        continue;
+      }
+      if (action[i] == VEC_PLANT) {
+        PlantBomb(&matches[e], p);
+      } else if (action[i] >= VEC_NORTH && action[i] <= VEC_WEST) {
+        MovePlayer(&matches[e], p, (Direction)(action[i] - VEC_NORTH));
+      }
+    }
+  }
+  // Matches that are decided stay as they are for the rest of the step
+  for (int t = 0; t < env->config.ticksPerStep; t++) {
+    StepMatchBatch(matches, slice->count, TICK_TIME);
+  }
+  float *reward = env->rewards + first;
+  for (size_t i = 0; i < rows; i++) {
+    reward[i] = wasAlive[i] && !isAlive[i] ? -1 : 0;
+  }
+  uint8_t *done = env->dones + slice->first;
+  const long *startTick = env->startTicks + slice->first;
+  long maxTicks = env->config.maxTicks;
+  for (int e = 0; e < slice->count; e++) {
+    Match *match = &matches[e];
+    _Bool over = IsMatchOver(match);
+    if (over) {
+      for (int p = 0; p < numPlayers; p++) {
+        reward[e * numPlayers + p] += isAlive[e * numPlayers + p];
+      }
+    }
+    long ticks = match->tick - startTick[e];
+    done[e] = over || (maxTicks > 0 && ticks >= maxTicks);
+  }
+  for (int e = slice->first; e < slice->first + slice->count; e++) {
+    if (env->dones[e]) {
+      startEpisode(env, e);
+    }
+    writeObservation(env, &env->matches[e],
+                     env->observations + (size_t)e * env->observationSize);
+  }
+  threadLogLevel = logLevel;
+}
+
+// New match in the batch slot of env e, played from the end of the
+// countdown
+void startEpisode(VecEnv *env, int e) {
+  VecEnvConfig *config = &env->config;
+  unsigned int seed =
+      config->seed + e + (unsigned int)env->episodes[e]++ * config->envs;
+  Match *match = &env->matches[e];
+  ResetMatch(match, seed);
+  while (match->countdown > 0.0f) {
+    StepMatch(match, TICK_TIME);
+  }
+  env->startTicks[e] = match->tick;
+}
+
+// Cell bytes come straight from the layer bitboards, eight cells at a time.
+// The layers are disjoint, so their spread bytes times the cell type add up
+// without carries.
+void writeObservation(VecEnv *env, Match *match, uint8_t *observation) {
+  int width = match->config.width;
+  int height = match->config.height;
+  BoardLayers *layers = &match->layers;
+  const uint64_t *spread = env->spread;
+  uint8_t *cell = observation;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x += 8) {
+      int w = x >> 6;
+      int shift = x & 63;
+      uint64_t bytes =
+          spread[(layers->walls.row[y][w] >> shift) & 0xff] * CELL_SOLID_WALL |
+          spread[(layers->crates.row[y][w] >> shift) & 0xff] *
+              CELL_DESTRUCTIBLE |
+          spread[(layers->bombs.row[y][w] >> shift) & 0xff] * CELL_BOMB |
+          spread[(layers->powerUps.row[y][w] >> shift) & 0xff] *
+              CELL_POWERUP |
+          spread[(layers->flames.row[y][w] >> shift) & 0xff] * VEC_CELL_FLAME;
+      int count = width - x < 8 ? width - x : 8;
+      // Little endian: byte i is cell x + i
+      for (int i = 0; i < count; i++) {
+        cell[i] = bytes >> (8 * i);
+      }
+      cell += count;
+    }
+  }
+  PlayerTable *players = &match->players;
+  uint8_t *feature = observation + width * height;
+  for (int p = 0; p < match->config.players; p++) {
+    Position position = players->position[p];
+    if (players->isAlive[p]) {
+      observation[position.y * width + position.x] |= VEC_CELL_PLAYER;
+    }
+    int radius = players->blastRadius[p];
+    int speed = (int)players->speed[p];
+    feature[0] = position.x;
+    feature[1] = position.y;
+    feature[2] = players->isAlive[p];
+    feature[3] = players->state[p];
+    feature[4] = players->bombs[p] - players->activeBombs[p];
+    feature[5] = radius < 255 ? radius : 255;
+    feature[6] = speed < 255 ? speed : 255;
+    feature[7] = (uint8_t)(players->progress[p] * 255);
+    feature += VEC_PLAYER_FEATURES;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef VECENV_H
+#define VECENV_H
+
+#include "sim.h"
+
+// Vectorized environment for training agents. Steps a batch of matches in
+// lockstep: one call takes an action for every player of every match and
+// returns rewards, done flags and observations for all of them. A match
+// that is done starts over with the next seed in the same call, so the
+// observation of a done env is the first one of its new episode.
+//
+// The matches are one batch, see InitMatchBatch: every column of the rules
+// holds that column of all envs, and a tick steps a slice of the batch
+// system by system, see StepMatchBatch. Slices run on a thread pool. Every
+// array of the API is batch-major, the entries of env e are contiguous:
+//
+//   actions       uint8 [envs][players], a VecAction
+//   rewards       float [envs][players]
+//   dones         uint8 [envs]
+//   observations  uint8 [envs][GetVecObservationSize()]
+//
+// An observation is a byte per cell, row by row (VEC_CELL_ bits), followed
+// by VEC_PLAYER_FEATURES bytes per player. A player gets -1 for dying and
+// the last one standing +1 when the match is decided. Matches cut off at
+// maxTicks are done without rewards.
+
+typedef enum {
+  VEC_WAIT,
+  VEC_NORTH,
+  VEC_EAST,
+  VEC_SOUTH,
+  VEC_WEST,
+  VEC_PLANT,
+  _VEC_ACTION_NUM,
+} VecAction;
+
+// Low bits of a cell byte are its CellType
+#define VEC_CELL_TYPE 0x07
+#define VEC_CELL_FLAME 0x08
+// A living player stands on the cell
+#define VEC_CELL_PLAYER 0x10
+
+// x, y, alive, state, bombs left to plant, blast radius, speed and walk
+// progress in 1/255
+#define VEC_PLAYER_FEATURES 8
+
+typedef struct {
+  MatchConfig match;
+  int envs;
+  // Threads stepping the batch, 1 steps on the calling thread
+  int threads;
+  // Ticks per step, the actions are issued before the first one
+  int ticksPerStep;
+  // Ticks an episode lasts at most, counted from the end of the countdown,
+  // 0 for no limit
+  long maxTicks;
+  // Env e plays the seeds seed + e, seed + e + envs and so on
+  unsigned int seed;
+} VecEnvConfig;
+
+typedef struct VecEnv VecEnv;
+
+// NULL for an invalid match config or if an allocation fails
+VecEnv *CreateVecEnv(VecEnvConfig config);
+void FreeVecEnv(VecEnv *env);
+int GetVecObservationSize(VecEnv *env);
+
+// Starts every env over and writes the first observations
+void ResetVecEnv(VecEnv *env, uint8_t *observations);
+void StepVecEnv(VecEnv *env, const uint8_t *actions, float *rewards,
+                uint8_t *dones, uint8_t *observations);
+#endif // VECENV_H